@@ -0,0 +1,104 @@
+/**
+ * @file bench_resize.c
+ * @brief Benchmarks hash_table_resize() with each rehash strategy
+ *
+ * For every table size, a table is filled up to its load threshold with random keys,
+ * then a single resize is timed. The "huge" column is the serial strategy with the bucket
+ * arrays allocated by hash_table_huge_page_allocator(). Each measurement is the best of a few runs.
+ * Run it from a Release build, the output is a table of milliseconds per resize.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "../src/hash_table/hash_table.h"
+#include "../src/hash_table/hash_table_internal.h"
+
+static constexpr int RUNS = 3;
+static constexpr size_t MIN_ENTRIES = 1 << 14;
+static constexpr size_t MAX_ENTRIES = 1 << 24;
+
+static const struct {
+    const char *name;
+    RehashStrategy strategy;
+    bool huge_pages;
+} strategies[] = {
+    {"serial", HT_REHASH_SERIAL, false},
+    {"radix", HT_REHASH_RADIX, false},
+    {"parallel", HT_REHASH_PARALLEL, false},
+    {"huge", HT_REHASH_SERIAL, true}
+};
+
+static constexpr size_t STRATEGY_COUNT = sizeof(strategies) / sizeof(strategies[0]);
+
+/** @brief Wall clock time in milliseconds */
+static double now_ms(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec * 1e3 + (double) ts.tv_nsec / 1e6;
+}
+
+/** @brief xorshift32 pseudo random number generator, keeps the runs reproducible */
+static unsigned int next_random(unsigned int *state) {
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/**
+ * @brief Times a single resize of a table holding `entries` random keys
+ * @return Resize time in milliseconds, or a negative number if the table couldn't be created
+ */
+static double time_resize(size_t entries, RehashStrategy strategy, bool huge_pages) {
+    const HashTableAllocator allocator = hash_table_huge_page_allocator(0);
+    struct table_memory *memory = table_memory_create(huge_pages ? &allocator : nullptr);
+    if (memory == nullptr) return -1.0;
+
+    HashTable *table = create_table(next_prime((size_t) ((double) entries / HT_LOAD_THRESHOLD) + 1), memory);
+    if (table == nullptr) return -1.0;
+
+    table->rehash_strategy = strategy;
+    hash_table_set_parallel_resize(table, 0, HT_PARALLEL_RESIZE_THREADS);
+
+    unsigned int state = 2463534242u;
+    while (table->count < entries) {
+        hash_table_insert(table, (int) next_random(&state), 0);
+    }
+
+    const double start = now_ms();
+    hash_table_resize(table);
+    const double elapsed = now_ms() - start;
+
+    hash_table_destroy(table);
+
+    return elapsed;
+}
+
+int main(void) {
+    printf("%12s", "entries");
+    for (size_t s = 0; s < STRATEGY_COUNT; s++) {
+        printf("%12s", strategies[s].name);
+    }
+    printf("\n");
+
+    for (size_t entries = MIN_ENTRIES; entries <= MAX_ENTRIES; entries *= 2) {
+        printf("%12zu", entries);
+
+        for (size_t s = 0; s < STRATEGY_COUNT; s++) {
+            double best = -1.0;
+            for (int run = 0; run < RUNS; run++) {
+                const double elapsed = time_resize(entries, strategies[s].strategy, strategies[s].huge_pages);
+                if (elapsed >= 0.0 && (best < 0.0 || elapsed < best)) best = elapsed;
+            }
+            printf("%12.3f", best);
+        }
+
+        printf("\n");
+        fflush(stdout);
+    }
+
+    return 0;
+}
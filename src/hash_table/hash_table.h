@@ -6,6 +6,10 @@
 #ifndef CHASHTABLE_HASH_TABLE_H
 #define CHASHTABLE_HASH_TABLE_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
 /**
  * @defgroup hash_table Hash Table
  * @brief Public API for the HashTable struct
@@ -45,6 +49,80 @@ typedef struct hash_table HashTable;
  */
 HashTable *hash_table_create(void);
 
+/**
+ * @brief Memory allocator of a table, see hash_table_create_with_allocator()
+ * @relates HashTable
+ *
+ * Every call gets the size of the block, so sized deallocation and memory budgets need no bookkeeping.
+ * The bulk functions serve the large blocks: bucket arrays, the node block of a clone and resize scratch buffers.
+ * They are optional, set both or neither. Without them, large blocks go through `allocate` too.
+ * The functions are called from the threads using the table, including its maintenance thread and
+ * the reclaimer thread of hash_table_destroy_async(), so they must be thread-safe if those are used.
+ */
+typedef struct {
+    void *(*allocate)(size_t size, void *user_data);                /**< Allocates a block, nullptr on failure */
+    void (*deallocate)(void *ptr, size_t size, void *user_data);    /**< Frees a block returned by `allocate` */
+    void *(*allocate_bulk)(size_t size, void *user_data);           /**< Allocates a large block, may be nullptr */
+    void (*deallocate_bulk)(void *ptr, size_t size, void *user_data); /**< Frees a block returned by `allocate_bulk`, may be nullptr */
+    void *user_data;                                                /**< Generic user data that is injected into the functions */
+    bool bulk_zeroed;                                               /**< `allocate_bulk` returns zeroed memory, so bucket arrays aren't cleared */
+} HashTableAllocator;
+
+/** @brief Bulk blocks of at least this many bytes are mapped by hash_table_huge_page_allocator() */
+constexpr size_t HT_HUGE_PAGE_SIZE = 2 << 20;
+
+/**
+ * @brief Options of hash_table_huge_page_allocator(), combine them with `|`
+ */
+typedef enum {
+    HT_HUGE_PAGES_PREFAULT = 1 << 0,    /**< Fault the pages in right after the allocation, instead of on first touch */
+    HT_HUGE_PAGES_LOCK = 1 << 1         /**< Lock the pages into memory with mlock(), which faults them in too */
+} HashTableHugePageOptions;
+
+/**
+ * @brief Allocator backing the large blocks of a table with 2 MiB pages
+ *
+ * Bucket arrays and clone node blocks of at least HT_HUGE_PAGE_SIZE bytes are anonymous mappings
+ * aligned to HT_HUGE_PAGE_SIZE and advised with MADV_HUGEPAGE, so transparent huge pages can back
+ * them. The kernel zeroes the pages lazily, so new bucket arrays skip the clearing loop.
+ * Smaller blocks and the entries use malloc.
+ *
+ * The pages are faulted in or locked right after the allocation, for tables with background
+ * resizing on the maintenance thread, without holding the table lock. Locking fails silently
+ * above RLIMIT_MEMLOCK. Without mmap, every block uses malloc.
+ *
+ * @param options Combination of HashTableHugePageOptions, 0 faults the pages in on first touch
+ * @return Allocator for hash_table_create_with_allocator()
+ * @relates HashTable
+ */
+HashTableAllocator hash_table_huge_page_allocator(unsigned options);
+
+/**
+ * @brief Creates a new empty HashTable object whose contents use a custom allocator
+ *
+ * The allocator serves the bucket arrays, the entries and the optional state of the contents,
+ * such as the Merkle summary. Copies and clones of the table use the same allocator.
+ * The table object itself and the maintenance thread state are allocated with malloc.
+ *
+ * @param allocator Allocator to use, copied into the table. nullptr uses malloc and free
+ * @return Pointer to empty HashTable, nullptr if the allocation failed or the allocator is invalid
+ * @relates HashTable
+ */
+HashTable *hash_table_create_with_allocator(const HashTableAllocator *allocator);
+
+/**
+ * @brief Bytes currently allocated through the allocator of a table
+ *
+ * Exact, counted on every allocation and deallocation. A table and its copies made by
+ * hash_table_copy() share their entries, so they also share this count.
+ * hash_table_swap() exchanges it together with the contents.
+ *
+ * @param table Pointer to HashTable object
+ * @return Live bytes, 0 if table is nullptr
+ * @relates HashTable
+ */
+size_t hash_table_allocated_bytes(const HashTable *table);
+
 /**
  * @brief Frees a HashTable from memory
  *
@@ -56,6 +134,64 @@ HashTable *hash_table_create(void);
  */
 bool hash_table_destroy(HashTable *table);
 
+/**
+ * @brief Destroys a table on a background reclaimer thread
+ *
+ * The table is queued and the call returns in O(1). A single reclaimer thread, started by the
+ * first call, frees the queued tables in order. Like hash_table_destroy(), the table must not be
+ * used after the call. Builds using debugmalloc, which isn't thread-safe, destroy the table
+ * before returning.
+ *
+ * @param table Pointer to HashTable object
+ * @return true if the table was queued or destroyed, false if table is nullptr
+ * @relates HashTable
+ */
+bool hash_table_destroy_async(HashTable *table);
+
+/**
+ * @brief Waits until every table queued by hash_table_destroy_async() is freed
+ *
+ * Call it before the program exits, the reclaimer thread is stopped with the process.
+ */
+void hash_table_reclaim_wait(void);
+
+/**
+ * @brief Removes every entry, keeping the capacity of the table
+ *
+ * The bucket array is kept, so refilling the table to its previous size doesn't resize it.
+ *
+ * @param table Pointer to HashTable object
+ * @return true if the table was cleared, false if table is nullptr
+ * @relates HashTable
+ */
+bool hash_table_clear(HashTable *table);
+
+/**
+ * @brief Swaps the contents of two tables in O(1)
+ *
+ * The entries, bucket arrays and Merkle summaries are exchanged, together with the allocator serving them.
+ * The settings, such as the resize configuration and background resizing, stay with the table.
+ *
+ * @param table1 Table 1
+ * @param table2 Table 2
+ * @return true if the contents were swapped, false if either table is nullptr
+ * @relates HashTable
+ */
+bool hash_table_swap(HashTable *table1, HashTable *table2);
+
+/**
+ * @brief Replaces the contents of a table with the contents of another one
+ *
+ * The contents are swapped with hash_table_swap(), then `src`, now holding the old contents of `dst`,
+ * is destroyed. Pointers to `dst` stay valid, and its settings are kept.
+ *
+ * @param dst Table receiving the contents
+ * @param src Table giving its contents, destroyed by the call
+ * @return true if the contents were moved, false if either table is nullptr or they are the same table
+ * @relates HashTable
+ */
+bool hash_table_move_into(HashTable *dst, HashTable *src);
+
 /**
  * @brief Inserts a key-value pair into a HashTable
  *
@@ -89,6 +225,11 @@ bool hash_table_delete(HashTable *table, int key);
 
 /**
  * @brief Checks if two tables have the same key-value pairs
+ *
+ * Tables keep an order-independent fingerprint of their contents, updated by every insert and delete.
+ * Tables with different counts or fingerprints are rejected in O(1), the entries are only compared
+ * if both match.
+ *
  * @param table1 Table 1
  * @param table2 Table 2
  * @return true if all key-value paris match, false otherwise
@@ -98,12 +239,89 @@ bool hash_table_equal(const HashTable *table1, const HashTable *table2);
 
 /**
  * @brief Creates a copy of a hash table
+ *
+ * The copy is a copy-on-write snapshot: only the bucket array is copied, the entries are shared
+ * until a later insert or delete on either table duplicates the chunk of buckets it touches.
+ * Entries returned by hash_table_get() are invalidated by writes to either table.
+ *
  * @param table Table to copy
- * @return Copy of table or nullptr if the original table was also nullptr
+ * @return Copy of table or nullptr if the original table was also nullptr, or the allocation failed
  * @relates HashTable
  */
 HashTable *hash_table_copy(const HashTable *table);
 
+/**
+ * @brief Creates an independent deep copy of a hash table
+ *
+ * Unlike hash_table_copy(), no entry is shared with the source. All entries of the clone are
+ * allocated in a single block, and the chains are reproduced bucket by bucket in the same order,
+ * without hashing a single key. Prefer it over hash_table_copy() if most entries of the copy
+ * will be modified anyway.
+ *
+ * @param table Table to clone
+ * @return Clone of table or nullptr if the original table was also nullptr, or the allocation failed
+ * @relates HashTable
+ */
+HashTable *hash_table_clone(const HashTable *table);
+
+/**
+ * @brief Inserts every key-value pair of `src` into `dst`
+ *
+ * `dst` is grown at most once. Tables of the same size are walked bucket by bucket in a single pass
+ * and resized at the end, otherwise `dst` is presized for all keys of `src` before the walk.
+ *
+ * @param dst Destination table, modified in place
+ * @param src Source table, must be a different table
+ * @param conflict Called for keys present in both tables, returns the merged value.
+ *                 If nullptr, the value of `src` wins
+ * @param user_data Generic user data that is injected into the conflict function
+ * @return false if either table is nullptr, they are the same table, or an allocation failed.
+ *         A failed merge may be partially applied
+ * @relates HashTable
+ */
+bool hash_table_merge(
+    HashTable *dst,
+    const HashTable *src,
+    int (*conflict)(int key, int dst_value, int src_value, void *),
+    void *user_data
+);
+
+/**
+ * @brief Removes every key from `dst` that isn't present in `src`
+ * @param dst Destination table, modified in place
+ * @param src Table whose keys are kept
+ * @return false if either table is nullptr or an allocation failed
+ * @relates HashTable
+ */
+bool hash_table_intersect(HashTable *dst, const HashTable *src);
+
+/**
+ * @brief Removes every key of `src` from `dst`
+ *
+ * If `src` is the smaller table, its keys are looked up in `dst`, otherwise every entry of `dst`
+ * is looked up in `src`.
+ *
+ * @param dst Destination table, modified in place
+ * @param src Table whose keys are removed
+ * @return false if either table is nullptr or an allocation failed
+ * @relates HashTable
+ */
+bool hash_table_subtract(HashTable *dst, const HashTable *src);
+
+/**
+ * @brief Removes every entry rejected by a predicate in a single sweep
+ *
+ * Rejected entries are unlinked and freed while the buckets are walked once, without looking up
+ * any key. If the table became sparse, it is shrunk once at the end.
+ *
+ * @param table Pointer to HashTable object
+ * @param predicate Returns true for the entries to keep. Called exactly once per entry, must not modify the table
+ * @param user_data Generic user data that is injected into the predicate
+ * @return Number of removed entries
+ * @relates HashTable
+ */
+size_t hash_table_retain(HashTable *table, bool (*predicate)(int key, int value, void *), void *user_data);
+
 /**
  * @brief Iterates through each key-value pair in a HashTable
  * @param table Pointer to HashTable object
@@ -113,10 +331,405 @@ HashTable *hash_table_copy(const HashTable *table);
  */
 void hash_table_foreach(const HashTable *table, void (*callback)(int key, int value, void *), void *user_data);
 
+/**
+ * @brief External iterator over a HashTable
+ * @relates HashTable
+ *
+ * Initialize with hash_table_iter_init() and advance with hash_table_iter_next().
+ * The iterator stays valid across inserts, deletes and resizes: every key present during the
+ * whole iteration is returned exactly once, keys inserted or deleted meanwhile may or may not be.
+ * It holds no resources, so it can be abandoned at any point.
+ */
+typedef struct {
+    const HashTable *table;     /**< Iterated table */
+    uint64_t position;          /**< Hash position of the next key to return, 2^32 when finished */
+} HashTableIter;
+
+/**
+ * @brief Initializes an iterator at the start of a table
+ * @param iter Iterator to initialize
+ * @param table Table to iterate
+ * @relates HashTable
+ */
+void hash_table_iter_init(HashTableIter *iter, const HashTable *table);
+
+/**
+ * @brief Advances an iterator
+ *
+ * Walks the table in hash position order. The table may be modified between calls.
+ *
+ * @param iter Iterator initialized with hash_table_iter_init()
+ * @return The next entry or nullptr if the iteration is finished
+ * @relates HashTable
+ */
+const Entry *hash_table_iter_next(HashTableIter *iter);
+
+/**
+ * @brief Incrementally iterates over a table with a resumable cursor
+ *
+ * Works like the Redis SCAN command. Start with cursor 0 and pass the returned cursor to
+ * the next call until it returns 0. Each call visits `count` buckets.
+ *
+ * Every key present during the whole scan is visited exactly once, even if the table is resized
+ * between calls. Buckets are indexed by the high bits of the key's hash position, so walking the
+ * positions upwards keeps a cursor valid in any table size. This is the same guarantee Redis gets
+ * from its reverse-binary cursor, which it needs because its buckets are indexed by the low bits.
+ *
+ * @param table Pointer to HashTable object
+ * @param cursor 0 to start a scan, otherwise the value returned by the previous call
+ * @param count Number of buckets to visit in this call, at least 1
+ * @param callback Called for every visited key-value pair. Must not modify the table, do that between calls
+ * @param user_data Generic user data that is injected into the callback
+ * @return Cursor for the next call, 0 if the scan is complete
+ * @relates HashTable
+ */
+uint64_t hash_table_scan(
+    const HashTable *table,
+    uint64_t cursor,
+    size_t count,
+    void (*callback)(int key, int value, void *),
+    void *user_data
+);
+
+/**
+ * @brief Starts maintaining a Merkle summary of the table contents
+ *
+ * The hash position space is split into 1024 fixed ranges. The summary keeps the fingerprint of
+ * every range and of every pair of neighbouring subtrees, adding O(log 1024) work to each insert and delete.
+ * The ranges don't depend on the table size, so tables of different sizes can be compared with hash_table_diff().
+ * The summary is kept until the table is destroyed, and copies and clones inherit it.
+ *
+ * @param table Pointer to HashTable object
+ * @return true if the summary is maintained, false if table is nullptr or the allocation failed
+ * @relates HashTable
+ */
+bool hash_table_enable_merkle(HashTable *table);
+
+/**
+ * @brief Reports every key whose entry differs between two tables
+ *
+ * If both tables have a Merkle summary (see hash_table_enable_merkle()), only the subtrees whose
+ * fingerprints mismatch are descended into, so the cost scales with the number of differences.
+ * Otherwise every range is compared.
+ *
+ * @param a First table
+ * @param b Second table
+ * @param callback Called once for every differing key, with its entry in `a` and in `b`.
+ *                 An entry is nullptr if the key is missing from that table. Must not modify the tables
+ * @param user_data Generic user data that is injected into the callback
+ * @return Number of differing keys
+ * @relates HashTable
+ */
+size_t hash_table_diff(
+    const HashTable *a,
+    const HashTable *b,
+    void (*callback)(int key, const Entry *a, const Entry *b, void *),
+    void *user_data
+);
+
+/**
+ * @brief Configures multithreaded resizing for large tables
+ *
+ * When the table grows while holding at least `min_count` entries, the old buckets
+ * are split into `thread_count` ranges which are rehashed in parallel.
+ * Smaller tables always resize on the calling thread.
+ * Defaults are 2^20 entries and 4 threads.
+ *
+ * @param table Pointer to HashTable object
+ * @param min_count Entry count from which resizing is multithreaded
+ * @param thread_count Number of threads, 0 or 1 disables parallel resizing. Capped at 64
+ * @return true if the settings were applied, false if table is nullptr
+ * @relates HashTable
+ */
+bool hash_table_set_parallel_resize(HashTable *table, size_t min_count, size_t thread_count);
+
+/**
+ * @brief Moves resizing to a dedicated maintenance thread
+ *
+ * Once enabled, crossing the load threshold in hash_table_insert() only signals the thread.
+ * It builds the new bucket array and migrates the entries in small batches, while
+ * insert, get and delete keep working against the old and new arrays.
+ * Single key operations take a table lock and may be called from multiple threads.
+ * Operations walking the whole table (foreach, copy, equal, save, print)
+ * first wait for a running migration to finish.
+ *
+ * The thread is stopped by hash_table_destroy(). Builds using debugmalloc, which isn't thread-safe,
+ * can't enable it, and keep resizing on the inserting thread.
+ *
+ * @param table Pointer to HashTable object
+ * @return true if background resizing is enabled, false if table is nullptr, the build uses debugmalloc,
+ *         or the thread couldn't be started
+ * @relates HashTable
+ */
+bool hash_table_enable_background_resize(HashTable *table);
+
+/**
+ * @brief Resize progress and duration counters
+ * @relates HashTable
+ */
+typedef struct {
+    bool in_progress;           /**< A background resize is migrating entries */
+    size_t migrated_buckets;    /**< Old buckets migrated so far by the running resize */
+    size_t total_buckets;       /**< Old bucket count of the running resize */
+    size_t resize_count;        /**< Completed resizes since the table was created */
+    double last_duration_ms;    /**< Duration of the last completed resize */
+    double total_duration_ms;   /**< Total duration of all completed resizes */
+} HashTableResizeProgress;
+
+/**
+ * @brief Reports the progress of a running resize and resize duration counters
+ *
+ * Works for both inline and background resizing.
+ *
+ * @param table Pointer to HashTable object
+ * @return Progress counters, all zero if table is nullptr
+ * @relates HashTable
+ */
+HashTableResizeProgress hash_table_resize_progress(const HashTable *table);
+
+/** @brief Number of slots in the chain length histogram of HashTableStats */
+constexpr size_t HT_STATS_CHAIN_HISTOGRAM = 16;
+
+/**
+ * @brief Table statistics, see hash_table_stats()
+ * @relates HashTable
+ */
+typedef struct {
+    size_t count;               /**< Number of entries */
+    size_t size;                /**< Number of buckets */
+    double load_factor;         /**< count / size */
+    size_t empty_buckets;       /**< Buckets without any entry */
+    size_t longest_chain;       /**< Entries in the longest chain */
+    size_t chain_histogram[HT_STATS_CHAIN_HISTOGRAM]; /**< Buckets holding `i` entries, the last slot counts the longer chains too */
+    size_t resize_count;        /**< Completed resizes since the table was created */
+    size_t bucket_bytes;        /**< Bytes of the bucket array */
+    size_t entry_bytes;         /**< Bytes of the entries, including unused slots of a node block */
+    size_t overhead_bytes;      /**< Bytes of the table object and its optional state */
+    size_t total_bytes;         /**< Sum of the above, without the allocator's own overhead */
+    size_t allocated_bytes;     /**< Bytes live in the table's allocator, see hash_table_allocated_bytes() */
+} HashTableStats;
+
+/**
+ * @brief Collects statistics about the bucket array and memory usage
+ *
+ * Walks every bucket once, O(size + count). Entries shared with a copy by hash_table_copy()
+ * are counted by both tables.
+ *
+ * @param table Pointer to HashTable object
+ * @param stats Filled with the statistics
+ * @return true if the statistics were collected, false if table or stats is nullptr
+ * @relates HashTable
+ */
+bool hash_table_stats(const HashTable *table, HashTableStats *stats);
+
+/**
+ * @brief Writes the statistics of a table in the Prometheus text exposition format
+ *
+ * Renders the gauges of hash_table_stats(), the chain length histogram and the resize counters.
+ * With instrumentation compiled in, the operation counters and latency histograms of
+ * hash_table_instrumentation_snapshot() are added, with latency buckets at every power of two
+ * nanoseconds from 64 ns to about 1 s.
+ *
+ * @param table Pointer to HashTable object
+ * @param file Stream to write to
+ * @return false if table or file is nullptr, or writing failed
+ * @relates HashTable
+ */
+bool hash_table_stats_write_prometheus(const HashTable *table, FILE *file);
+
+/**
+ * @brief Timed operations, see hash_table_instrumentation_snapshot() and hash_table_slowlog_get()
+ */
+typedef enum {
+    HT_OP_INSERT,   /**< hash_table_insert(), including the resize it may trigger */
+    HT_OP_GET,      /**< hash_table_get() */
+    HT_OP_DELETE,   /**< hash_table_delete() */
+    HT_OP_RESIZE,   /**< A resize, inline or a background migration */
+    HT_OP_SAVE,     /**< hash_table_save() */
+    HT_OP_LOAD,     /**< hash_table_load() */
+    HT_OP_COUNT     /**< Number of operations */
+} HashTableOp;
+
+/**
+ * @brief Counters of the instrumentation, see hash_table_instrumentation_snapshot()
+ */
+typedef enum {
+    HT_COUNTER_GET_HITS,        /**< Lookups that found the key */
+    HT_COUNTER_GET_MISSES,      /**< Lookups that didn't find the key */
+    HT_COUNTER_INSERT_NEW,      /**< Inserts that added a new entry */
+    HT_COUNTER_INSERT_UPDATES,  /**< Inserts that updated an existing entry */
+    HT_COUNTER_DELETE_HITS,     /**< Deletes that removed an entry */
+    HT_COUNTER_DELETE_MISSES,   /**< Deletes of missing keys */
+    HT_COUNTER_NODES_TRAVERSED, /**< Entries compared by inserts, gets and deletes */
+    HT_COUNTER_RESIZES,         /**< Completed resizes */
+    HT_COUNTER_RESIZE_NS,       /**< Time spent resizing */
+    HT_COUNTER_COUNT            /**< Number of counters */
+} HashTableCounter;
+
+/** @brief Number of buckets in a latency histogram, enough for any 64-bit nanosecond value */
+constexpr size_t HT_LATENCY_BUCKETS = 496;
+
+/**
+ * @brief Counters and latency histograms of all tables, aggregated across threads
+ * @relates HashTable
+ */
+typedef struct {
+    uint64_t counters[HT_COUNTER_COUNT];                /**< Counters, indexed by HashTableCounter */
+    uint64_t latency[HT_OP_COUNT][HT_LATENCY_BUCKETS];  /**< Latency histograms in nanoseconds, see hash_table_latency_bucket_value() */
+} HashTableInstrumentation;
+
+/**
+ * @brief Aggregates the instrumentation counters of every thread since the last reset
+ *
+ * Instrumentation is compiled in with the CHASHTABLE_INSTRUMENT option, without it the
+ * hot paths aren't touched at all and this function only zeroes the snapshot.
+ * The counts of exited threads are kept.
+ *
+ * @param snapshot Filled with the aggregated counters
+ * @return false if instrumentation is compiled out or snapshot is nullptr
+ * @relates HashTable
+ */
+bool hash_table_instrumentation_snapshot(HashTableInstrumentation *snapshot);
+
+/**
+ * @brief Restarts the instrumentation counters of every thread from zero
+ * @relates HashTable
+ */
+void hash_table_instrumentation_reset(void);
+
+/**
+ * @brief Lower bound of a latency histogram bucket
+ *
+ * Values below 8 ns have a bucket each, above that every power of two is split into 8 buckets,
+ * so a bucket covers values within 12.5% of its lower bound.
+ *
+ * @param bucket Bucket index, less than HT_LATENCY_BUCKETS
+ * @return Smallest latency in nanoseconds counted in the bucket
+ */
+uint64_t hash_table_latency_bucket_value(size_t bucket);
+
+/**
+ * @brief Estimates a latency percentile from a snapshot
+ *
+ * @param snapshot Snapshot from hash_table_instrumentation_snapshot()
+ * @param op Operation
+ * @param percentile Percentile between 0 and 100, e.g. 99 for p99
+ * @return Lower bound of the bucket holding the percentile in nanoseconds, 0 if nothing was recorded
+ */
+uint64_t hash_table_latency_percentile(const HashTableInstrumentation *snapshot, HashTableOp op, double percentile);
+
+/**
+ * @brief Name of an operation, e.g. "insert"
+ * @param op Operation
+ * @return Static string, "unknown" for invalid values
+ */
+const char *hash_table_op_name(HashTableOp op);
+
+/** @brief Number of entries kept by the slowlog, older entries are overwritten */
+constexpr size_t HT_SLOWLOG_CAPACITY = 128;
+
+/** @brief Slowlog threshold that disables the slowlog, the default */
+constexpr uint64_t HT_SLOWLOG_DISABLED = UINT64_MAX;
+
+/**
+ * @brief An operation recorded by the slowlog, see hash_table_slowlog_get()
+ * @relates HashTable
+ */
+typedef struct {
+    uint64_t id;            /**< Sequence number, increases with every recorded operation */
+    HashTableOp op;         /**< Operation */
+    int key;                /**< Key of an insert, get or delete, 0 for other operations */
+    uint64_t duration_ns;   /**< Duration of the operation */
+    size_t chain_length;    /**< Entries in the chain of the key after an insert, get or delete */
+    size_t table_size;      /**< Table size after the operation */
+    size_t count;           /**< Entry count after the operation */
+    bool resized;           /**< The operation resized the table */
+} HashTableSlowlogEntry;
+
+/**
+ * @brief Sets the latency from which operations are recorded by the slowlog
+ *
+ * The slowlog is shared by all tables and records inserts, gets, deletes, resizes, saves and loads.
+ * While it is disabled, operations aren't timed at all.
+ *
+ * @param threshold_ns Operations taking at least this long are recorded. 0 records every operation,
+ *                     HT_SLOWLOG_DISABLED disables the slowlog
+ */
+void hash_table_slowlog_set_threshold(uint64_t threshold_ns);
+
+/**
+ * @brief Current slowlog threshold
+ * @return Threshold in nanoseconds, HT_SLOWLOG_DISABLED if the slowlog is disabled
+ */
+uint64_t hash_table_slowlog_threshold(void);
+
+/**
+ * @brief Copies the recorded slow operations, newest first
+ *
+ * Never blocks operations recording concurrently. An entry being written while it is read is skipped.
+ *
+ * @param entries Array to copy the entries into
+ * @param max_entries Length of the array, at most HT_SLOWLOG_CAPACITY entries are kept
+ * @return Number of copied entries
+ */
+size_t hash_table_slowlog_get(HashTableSlowlogEntry *entries, size_t max_entries);
+
+/**
+ * @brief Clears the slowlog
+ */
+void hash_table_slowlog_reset(void);
+
+/** @brief Chains at least this long fire the HT_TRACE_LONG_CHAIN event when walked */
+constexpr size_t HT_TRACE_LONG_CHAIN_LENGTH = 8;
+
+/**
+ * @brief Events reported to the trace hook, see hash_table_set_trace_hook()
+ */
+typedef enum {
+    HT_TRACE_RESIZE_START,  /**< A resize starts, inline or a background migration */
+    HT_TRACE_RESIZE_END,    /**< A resize completed */
+    HT_TRACE_SAVE_START,    /**< hash_table_save() starts */
+    HT_TRACE_SAVE_END,      /**< hash_table_save() completed */
+    HT_TRACE_LOAD_START,    /**< hash_table_load() starts */
+    HT_TRACE_LOAD_END,      /**< hash_table_load() completed */
+    HT_TRACE_LONG_CHAIN     /**< An insert, get or delete walked at least HT_TRACE_LONG_CHAIN_LENGTH entries */
+} HashTableTraceType;
+
+/**
+ * @brief A trace event, the fields that don't apply to the event type are zero
+ * @relates HashTable
+ */
+typedef struct {
+    HashTableTraceType type;    /**< Event type */
+    const HashTable *table;     /**< Table of the event, nullptr for load starts and failed loads */
+    const char *filename;       /**< File of a save or load */
+    size_t old_size;            /**< Table size before a resize */
+    size_t size;                /**< Table size, the new size for resize events */
+    size_t count;               /**< Entry count */
+    size_t bytes;               /**< Bytes written by a save, or read by a load */
+    uint64_t duration_ns;       /**< Duration of a completed resize */
+    size_t chain_length;        /**< Entries walked by the operation of a long chain event */
+    int key;                    /**< Key of a long chain event */
+    bool success;               /**< An end event completed successfully */
+} HashTableTraceEvent;
+
+/**
+ * @brief Registers a callback receiving the trace events of all tables
+ *
+ * The same events fire the USDT probes of the `chashtable` provider, when they are compiled in.
+ * The hook is called synchronously on the thread causing the event, for resizes with the table
+ * locked, so it must not call back into the table. Register it while no other thread uses the library.
+ *
+ * @param hook Callback, nullptr unregisters the current one
+ * @param user_data Generic user data that is injected into the hook
+ */
+void hash_table_set_trace_hook(void (*hook)(const HashTableTraceEvent *event, void *), void *user_data);
+
 /**
  * @brief Serializes a HashTable object into a .txt file
  *
  * Can be loaded with hash_table_load()
+ * Written through a buffer of HT_SAVE_BUFFER_SIZE bytes, see hash_table_save_buffered().
  *
  * @param table Pointer to HashTable object
  * @param filename Save file name
@@ -125,6 +738,39 @@ void hash_table_foreach(const HashTable *table, void (*callback)(int key, int va
  */
 bool hash_table_save(const HashTable *table, const char *filename);
 
+/** @brief Buffer size of hash_table_save(), the text is written in chunks of this many bytes */
+constexpr size_t HT_SAVE_BUFFER_SIZE = 4 << 20;
+
+/**
+ * @brief hash_table_save() with a chosen buffer size
+ *
+ * The entries are formatted into a buffer without printf, and each full buffer is written with a single write.
+ * Larger buffers mean fewer system calls, smaller ones less memory for the duration of the save.
+ *
+ * @param table Pointer to HashTable object
+ * @param filename Save file name
+ * @param buffer_size Size of the buffer in bytes, raised to a minimum of a few lines
+ * @return Success, false if the file couldn't be written
+ * @relates HashTable
+ */
+bool hash_table_save_buffered(const HashTable *table, const char *filename, size_t buffer_size);
+
+/**
+ * @brief Serializes a HashTable object into a binary snapshot
+ *
+ * Version 2 of the save format, loaded by hash_table_load() too. After the `CHashTable v2.0` header line,
+ * a fixed header holds the version, the entries per block, the entry count and the table size.
+ * The entries follow in blocks of packed little-endian 32-bit key-value pairs, each block and
+ * the header are followed by their CRC-32C. About half the size of the text format, and loaded
+ * with a single read per block into a table of the saved size.
+ *
+ * @param table Pointer to HashTable object
+ * @param filename Save file name
+ * @return Success, false if the file couldn't be written
+ * @relates HashTable
+ */
+bool hash_table_save_binary(const HashTable *table, const char *filename);
+
 /**
  * @enum HashTable_LoadError
  * @brief Error codes for the hash_table_load function.
@@ -139,12 +785,16 @@ typedef enum {
     HT_LOAD_ERROR_MALFORMED_COUNT,// Failed to parse the item count
     HT_LOAD_ERROR_ALLOC_FAILED,   // Failed to allocate memory for the hash table
     HT_LOAD_ERROR_PREMATURE_EOF,  // File ended before all items were read
-    HT_LOAD_ERROR_MALFORMED_LINE  // File contains malformed key-value pairs, or item count mismatch.
+    HT_LOAD_ERROR_MALFORMED_LINE, // File contains malformed key-value pairs, or item count mismatch.
+    HT_LOAD_ERROR_CHECKSUM,       // A block of a binary snapshot doesn't match its checksum
+    HT_LOAD_ERROR_UNCLEAN_SHUTDOWN // A table file was modified and not checkpointed or closed
 } HashTable_LoadError;
 
 /**
  * @brief Loads a hash table from a specified file.
  *
+ * Reads both the text format of hash_table_save() and the binary format of hash_table_save_binary(),
+ * told apart by the version in the header line. The file is mapped and parsed in place.
  * Instead of returning the table, it returns an error code.
  * The created hash table is returned via the `out_table` pointer.
  * On error, `out_table` is set to nullptr (or an intermediate state).
@@ -158,6 +808,45 @@ typedef enum {
  */
 HashTable_LoadError hash_table_load(const char *filename, HashTable **out_table);
 
+/**
+ * @brief Where hash_table_load_with_info() stopped, and where it found the first problem
+ * @relates HashTable
+ */
+typedef struct {
+    size_t bytes_read;      /**< Bytes of the file consumed */
+    size_t error_offset;    /**< Byte offset of the first malformed line or binary block, SIZE_MAX on success */
+    size_t error_line;      /**< Line number of the error from 1, 0 on success and in the binary format */
+} HashTableLoadInfo;
+
+/**
+ * @brief hash_table_load() that also reports the location of an error
+ *
+ * Returns the same error codes as hash_table_load(). For HT_LOAD_ERROR_MALFORMED_LINE,
+ * the offset and line point at the first line that isn't a `key=value` pair.
+ *
+ * @param filename The path to the file to load.
+ * @param out_table Set to the loaded table, or to nullptr on failure.
+ * @param info Filled with the location of the error, may be nullptr
+ * @return A HashTable_LoadError code indicating success (HT_LOAD_OK) or the type of failure.
+ * @relates HashTable
+ */
+HashTable_LoadError hash_table_load_with_info(const char *filename, HashTable **out_table, HashTableLoadInfo *info);
+
+/**
+ * @brief hash_table_load() on multiple threads
+ *
+ * The entries are split into parts at line or block boundaries, parsed by one thread each,
+ * then inserted into the pre-sized table by bucket range, so the threads never share a bucket.
+ * Returns the same error codes as hash_table_load() for the same file, and an equal table.
+ *
+ * @param filename The path to the file to load.
+ * @param thread_count Number of threads, including the calling one. At most 64, 1 loads on the calling thread only
+ * @param out_table Set to the loaded table, or to nullptr on failure.
+ * @return A HashTable_LoadError code indicating success (HT_LOAD_OK) or the type of failure.
+ * @relates HashTable
+ */
+HashTable_LoadError hash_table_load_parallel(const char *filename, size_t thread_count, HashTable **out_table);
+
 /**
  * @brief Converts a hash table load error code into a static, human-readable string.
  *
@@ -167,6 +856,155 @@ HashTable_LoadError hash_table_load(const char *filename, HashTable **out_table)
  */
 const char *hash_table_error_string(HashTable_LoadError error_code);
 
+/**
+ * @brief An opaque handle to a read-only table image, see hash_table_open_image()
+ * @relates hash_table
+ */
+typedef struct hash_table_image HashTableImage;
+
+/**
+ * @brief Writes a table as an image, which can be queried without loading it
+ *
+ * The image is laid out as an open-addressing table with linear probing, at most half full.
+ * It is written in the byte order of the machine, and opened only on machines of the same order.
+ * The file is written under a temporary name and renamed over `filename`,
+ * so processes that have the previous image open keep reading it unchanged.
+ *
+ * @param table Pointer to HashTable object
+ * @param filename Image file name
+ * @return Success, false if the file couldn't be written
+ * @relates HashTable
+ */
+bool hash_table_save_image(const HashTable *table, const char *filename);
+
+/**
+ * @brief Opens an image written by hash_table_save_image()
+ *
+ * The file is mapped read-only and only the header is read, so opening takes the same time for any size.
+ * Lookups read the pages they touch, and processes opening the same image share them in the page cache.
+ * The header is checked against its checksum, the slots aren't, since that would read the whole file.
+ * Close the image with hash_table_close_image().
+ *
+ * @param filename The path to the image.
+ * @param out_image Set to the opened image, or to nullptr on failure.
+ * @return HT_LOAD_OK, or the HashTable_LoadError describing the problem with the file.
+ * @relates HashTableImage
+ */
+HashTable_LoadError hash_table_open_image(const char *filename, HashTableImage **out_image);
+
+/**
+ * @brief Looks up a key in an image
+ *
+ * Images are read-only, so safe to query from any number of threads.
+ *
+ * @param image Image opened by hash_table_open_image()
+ * @param key Key to look up
+ * @param out_value Set to the value of the key if found, may be nullptr
+ * @return The key is in the image
+ * @relates HashTableImage
+ */
+bool hash_table_image_get(const HashTableImage *image, int key, int *out_value);
+
+/**
+ * @brief Number of entries in an image
+ * @relates HashTableImage
+ */
+size_t hash_table_image_count(const HashTableImage *image);
+
+/**
+ * @brief Unmaps an image and frees its handle
+ * @relates HashTableImage
+ */
+void hash_table_close_image(HashTableImage *image);
+
+/**
+ * @brief An opaque handle to a writable table stored in a file, see hash_table_file_create()
+ * @relates hash_table
+ */
+typedef struct hash_table_file HashTableFile;
+
+/**
+ * @brief Creates an empty table stored in a file, replacing the file if it exists
+ *
+ * The bucket array and the entries live in a shared mapping of the file, linked by indices instead of pointers.
+ * Changes reach the file through the page cache, and the table can be reopened with hash_table_file_open()
+ * after hash_table_file_close(), without loading it. The table grows like a HashTable,
+ * extending the file and remapping it. Only one process may have the file open at a time.
+ * Not thread-safe.
+ *
+ * @param filename Path of the table file
+ * @return Handle of the table, nullptr if the file couldn't be created or mapped
+ * @relates HashTableFile
+ */
+HashTableFile *hash_table_file_create(const char *filename);
+
+/**
+ * @brief Opens a table file for reading and writing
+ *
+ * Only maps the file and checks its header. A file modified after its last checkpoint is refused with
+ * HT_LOAD_ERROR_UNCLEAN_SHUTDOWN, its contents may be half written. Rebuild it from a snapshot then.
+ *
+ * @param filename Path of the table file
+ * @param out_file Set to the opened table, or to nullptr on failure.
+ * @return HT_LOAD_OK, or the HashTable_LoadError describing the problem with the file.
+ * @relates HashTableFile
+ */
+HashTable_LoadError hash_table_file_open(const char *filename, HashTableFile **out_file);
+
+/**
+ * @brief Inserts or updates a key-value pair, see hash_table_insert()
+ * @return Success, false if the file couldn't grow
+ * @relates HashTableFile
+ */
+bool hash_table_file_insert(HashTableFile *file, int key, int value);
+
+/**
+ * @brief Looks up a key in a table file
+ * @param file Table file
+ * @param key Key to look up
+ * @param out_value Set to the value of the key if found, may be nullptr
+ * @return The key is in the table
+ * @relates HashTableFile
+ */
+bool hash_table_file_get(const HashTableFile *file, int key, int *out_value);
+
+/**
+ * @brief Deletes a key, see hash_table_delete()
+ * @return The key was found and deleted
+ * @relates HashTableFile
+ */
+bool hash_table_file_delete(HashTableFile *file, int key);
+
+/**
+ * @brief Number of entries in a table file
+ * @relates HashTableFile
+ */
+size_t hash_table_file_count(const HashTableFile *file);
+
+/**
+ * @brief Calls a function on every key-value pair of a table file, see hash_table_foreach()
+ * @relates HashTableFile
+ */
+void hash_table_file_foreach(const HashTableFile *file, void (*callback)(int key, int value, void *), void *user_data);
+
+/**
+ * @brief Writes the table to disk and marks the file clean
+ *
+ * Syncs the mapping with msync(), then clears the dirty flag in the header. The first change after
+ * a checkpoint sets the flag again, so a process dying between checkpoints leaves it set.
+ *
+ * @return Success, false if the file couldn't be synced
+ * @relates HashTableFile
+ */
+bool hash_table_file_checkpoint(HashTableFile *file);
+
+/**
+ * @brief Checkpoints a table file, then unmaps and closes it
+ * @return The checkpoint succeeded. The handle is freed either way
+ * @relates HashTableFile
+ */
+bool hash_table_file_close(HashTableFile *file);
+
 /**
  * @brief Print a HashTable for debugging
  *
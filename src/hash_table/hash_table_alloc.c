@@ -0,0 +1,125 @@
+/**
+ * @file hash_table_alloc.c
+ * @brief Pluggable allocators and the memory accounting of a table
+ *
+ * Every block of the contents of a table comes from its memory domain, which holds the allocator
+ * and counts the bytes live in it. The domain is reference counted, a table shares it with its copies,
+ * since any of them may free the entries they share. Without a custom allocator, malloc and free are used.
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+#ifndef CHASHTABLE_NO_DEBUGMALLOC
+#include "../debugmalloc/debugmalloc.h"
+#endif
+
+/**
+ * @brief Allocator of the contents of a table, and the bytes live in it
+ *
+ * Shared by a table and its copies, which may run on different threads, so the counts are atomic.
+ */
+struct table_memory {
+    HashTableAllocator allocator;   /**< Allocator of the contents */
+    atomic_size_t live_bytes;       /**< Bytes allocated and not freed yet */
+    atomic_size_t refs;             /**< Number of tables using the domain */
+};
+
+static void *default_allocate(size_t size, void *user_data) {
+    return malloc(size);
+}
+
+static void default_deallocate(void *ptr, size_t size, void *user_data) {
+    free(ptr);
+}
+
+struct table_memory *table_memory_create(const HashTableAllocator *allocator) {
+    if (allocator != nullptr) {
+        if (allocator->allocate == nullptr || allocator->deallocate == nullptr) return nullptr;
+        if ((allocator->allocate_bulk == nullptr) != (allocator->deallocate_bulk == nullptr)) return nullptr;
+        // Blocks falling back to `allocate` aren't zeroed
+        if (allocator->bulk_zeroed && allocator->allocate_bulk == nullptr) return nullptr;
+    }
+
+    struct table_memory *memory = (struct table_memory *) malloc(sizeof(struct table_memory));
+    if (memory == nullptr) return nullptr;
+
+    memory->allocator = allocator != nullptr ? *allocator : (HashTableAllocator){
+        .allocate = default_allocate,
+        .deallocate = default_deallocate,
+        .allocate_bulk = nullptr,
+        .deallocate_bulk = nullptr,
+        .user_data = nullptr,
+        .bulk_zeroed = false
+    };
+    atomic_init(&memory->live_bytes, 0);
+    atomic_init(&memory->refs, 1);
+
+    return memory;
+}
+
+void table_memory_retain(struct table_memory *memory) {
+    atomic_fetch_add_explicit(&memory->refs, 1, memory_order_relaxed);
+}
+
+void table_memory_release(struct table_memory *memory) {
+    if (memory == nullptr) return;
+    if (atomic_fetch_sub_explicit(&memory->refs, 1, memory_order_acq_rel) == 1) free(memory);
+}
+
+HashTableAllocator table_memory_allocator(const struct table_memory *memory) {
+    return memory->allocator;
+}
+
+size_t table_memory_live_bytes(const struct table_memory *memory) {
+    return atomic_load_explicit(&memory->live_bytes, memory_order_relaxed);
+}
+
+void *memory_alloc(struct table_memory *memory, size_t size) {
+    void *ptr = memory->allocator.allocate(size, memory->allocator.user_data);
+    if (ptr != nullptr) atomic_fetch_add_explicit(&memory->live_bytes, size, memory_order_relaxed);
+
+    return ptr;
+}
+
+void memory_free(struct table_memory *memory, void *ptr, size_t size) {
+    if (ptr == nullptr) return;
+
+    memory->allocator.deallocate(ptr, size, memory->allocator.user_data);
+    atomic_fetch_sub_explicit(&memory->live_bytes, size, memory_order_relaxed);
+}
+
+void *memory_alloc_bulk(struct table_memory *memory, size_t size) {
+    if (memory->allocator.allocate_bulk == nullptr) return memory_alloc(memory, size);
+
+    void *ptr = memory->allocator.allocate_bulk(size, memory->allocator.user_data);
+    if (ptr != nullptr) atomic_fetch_add_explicit(&memory->live_bytes, size, memory_order_relaxed);
+
+    return ptr;
+}
+
+void memory_free_bulk(struct table_memory *memory, void *ptr, size_t size) {
+    if (memory->allocator.deallocate_bulk == nullptr) {
+        memory_free(memory, ptr, size);
+        return;
+    }
+    if (ptr == nullptr) return;
+
+    memory->allocator.deallocate_bulk(ptr, size, memory->allocator.user_data);
+    atomic_fetch_sub_explicit(&memory->live_bytes, size, memory_order_relaxed);
+}
+
+bool memory_bulk_zeroed(const struct table_memory *memory) {
+    return memory->allocator.bulk_zeroed;
+}
+
+void memory_prefault(const struct table_memory *memory, void *ptr, size_t size) {
+    huge_page_prefault(&memory->allocator, ptr, size);
+}
+
+size_t hash_table_allocated_bytes(const HashTable *table) {
+    if (table == nullptr) return 0;
+    return table_memory_live_bytes(table->memory);
+}
@@ -0,0 +1,497 @@
+/**
+ * @file hash_table_background.c
+ * @brief Background resizing on a dedicated maintenance thread
+ *
+ * When the load threshold is crossed, the maintenance thread allocates the new bucket array
+ * and migrates the old buckets in batches of HT_BACKGROUND_RESIZE_BATCH, releasing the table
+ * lock between batches. Until the migration finishes, a key lives in the new array if its
+ * old bucket has already been migrated, and in the old array otherwise.
+ */
+
+#include <stdlib.h>
+#include <threads.h>
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+#ifndef CHASHTABLE_NO_DEBUGMALLOC
+#include "../debugmalloc/debugmalloc.h"
+#endif
+
+/**
+ * @brief State of the maintenance thread of a table
+ *
+ * Every field, and the bucket arrays of the table, are protected by `lock`.
+ */
+struct background_resize {
+    mtx_t lock;                 /**< Table lock, held by every operation on the table */
+    cnd_t wake;                 /**< Signals the maintenance thread */
+    cnd_t done;                 /**< Broadcast when a migration finishes */
+    thrd_t thread;              /**< Maintenance thread */
+    bool requested;             /**< The load threshold was crossed, a resize should start */
+    bool preparing;             /**< Shared entries are being duplicated or the new array built, with the lock released */
+    bool migrating;             /**< Entries are being migrated into new_buckets */
+    bool stopping;              /**< The thread should exit */
+    bool paused;                /**< Migration stops between batches, see background_resize_pause() */
+    Entry **new_buckets;        /**< Bucket array being filled */
+    size_t new_size;            /**< Size of new_buckets */
+    size_t migrated;            /**< Old buckets below this index have been migrated */
+};
+
+/**
+ * @brief Finds the bucket currently holding a key
+ *
+ * The table lock must be held.
+ *
+ * @param table Table with background resizing enabled
+ * @param key Key to look for
+ * @param old_hash Set to the index of the bucket in the old array, or table->size if the key is in the new array.
+ *                 May be nullptr
+ * @return Pointer to the head of the bucket, in the old or the new array
+ */
+static Entry **locate_bucket(const HashTable *table, int key, size_t *old_hash) {
+    const struct background_resize *background = table->background;
+    const size_t hash = hash_function(key, table->size);
+
+    if (background->migrating && hash < background->migrated) {
+        if (old_hash != nullptr) *old_hash = table->size;
+        return &background->new_buckets[hash_function(key, background->new_size)];
+    }
+
+    if (old_hash != nullptr) *old_hash = hash;
+    return &table->buckets[hash];
+}
+
+/**
+ * @brief Builds a new bucket array and migrates all entries into it
+ *
+ * Called by the maintenance thread with the lock held. The lock is released while the new
+ * array is zeroed or prefaulted, and between every batch of unshared or migrated buckets.
+ * Operations on the whole table wait meanwhile, see background_resize_lock_idle().
+ *
+ * @param table Table to resize
+ */
+static void migrate(HashTable *table) {
+    struct background_resize *background = table->background;
+
+    // Requested again while the last migration was being prepared, which already fixed the load
+    if (table->count <= table->load_threshold_count) return;
+
+    const uint64_t start = monotonic_ns();
+    const size_t old_size = table->size;
+    const size_t new_size = next_prime(old_size * 2);
+
+    // Entries shared with a copy can't be relinked, duplicate them first. That is O(n) with an
+    // allocation per entry, so it is done in batches too, with whole-table operations kept out
+    background->preparing = true;
+    for (size_t first = 0; table->chunks != nullptr && first < old_size; first += HT_BACKGROUND_RESIZE_BATCH) {
+        const size_t last = first + HT_BACKGROUND_RESIZE_BATCH < old_size ? first + HT_BACKGROUND_RESIZE_BATCH : old_size;
+        if (!cow_own_range(table, first, last)) {
+            background->preparing = false;
+            return;
+        }
+
+        mtx_unlock(&background->lock);
+        thrd_yield();
+        mtx_lock(&background->lock);
+    }
+
+    // Every chunk is private by now, only the reference counts are left to free
+    if (!cow_unshare(table)) {
+        background->preparing = false;
+        return;
+    }
+
+    // Allocate under the lock, the memory domain of the table may only change while it is held
+    struct table_memory *memory = table->memory;
+    Entry **new_buckets = (Entry **) memory_alloc_bulk(memory, sizeof(Entry *) * new_size);
+    // Silently fail, the next insert above the threshold retries
+    if (new_buckets == nullptr) {
+        background->preparing = false;
+        return;
+    }
+
+    // Zeroing and prefaulting are O(size), don't block the foreground while doing them.
+    // A swap may hand the domain to another table meanwhile, keep it alive until the array is freed
+    table_memory_retain(memory);
+    mtx_unlock(&background->lock);
+    if (!memory_bulk_zeroed(memory)) {
+        for (size_t i = 0; i < new_size; i++) {
+            new_buckets[i] = nullptr;
+        }
+    }
+    memory_prefault(memory, new_buckets, sizeof(Entry *) * new_size);
+    mtx_lock(&background->lock);
+    background->preparing = false;
+
+    // Only entries and values may change meanwhile. Should the table have been shared, resized
+    // or swapped after all, the array doesn't fit it anymore. Retry
+    if (table->memory != memory || table->chunks != nullptr || table->size != old_size) {
+        free_buckets(memory, new_buckets, new_size);
+        table_memory_release(memory);
+        background->requested = table->count > table->load_threshold_count;
+        return;
+    }
+    table_memory_release(memory);
+
+    trace_resize_start(table, new_size);
+
+    background->new_buckets = new_buckets;
+    background->new_size = new_size;
+    background->migrated = 0;
+    background->migrating = true;
+
+    while (background->migrated < old_size) {
+        size_t last = background->migrated + HT_BACKGROUND_RESIZE_BATCH;
+        if (last > old_size) last = old_size;
+
+        rehash_range(table->buckets, background->migrated, last, new_buckets, new_size);
+        background->migrated = last;
+
+        // Let waiting foreground operations in
+        mtx_unlock(&background->lock);
+        thrd_yield();
+        mtx_lock(&background->lock);
+
+        while (background->paused && !background->stopping) {
+            cnd_wait(&background->wake, &background->lock);
+        }
+    }
+
+    Entry **old_buckets = table->buckets;
+    table->buckets = new_buckets;
+    table->size = new_size;
+    table->load_threshold_count = calc_load_threshold_count(new_size);
+
+    background->migrating = false;
+    background->new_buckets = nullptr;
+    free_buckets(table->memory, old_buckets, old_size);
+
+    const uint64_t elapsed = monotonic_ns() - start;
+    table->resize_count++;
+    table->resize_last_ns = elapsed;
+    table->resize_total_ns += elapsed;
+    INSTRUMENT_COUNT(HT_COUNTER_RESIZES, 1);
+    INSTRUMENT_COUNT(HT_COUNTER_RESIZE_NS, elapsed);
+    op_record(HT_OP_RESIZE, table, 0, elapsed, true);
+    trace_resize_end(table, old_size, elapsed);
+
+    // Inserts during the migration may have crossed the new threshold already
+    if (table->count > table->load_threshold_count) background->requested = true;
+}
+
+static int maintenance_thread(void *arg) {
+    HashTable *table = (HashTable *) arg;
+    struct background_resize *background = table->background;
+
+    mtx_lock(&background->lock);
+
+    while (true) {
+        while (!background->requested && !background->stopping) {
+            cnd_wait(&background->wake, &background->lock);
+        }
+
+        if (background->stopping) break;
+
+        background->requested = false;
+        migrate(table);
+
+        if (!background->requested) cnd_broadcast(&background->done);
+    }
+
+    mtx_unlock(&background->lock);
+
+    return 0;
+}
+
+bool hash_table_enable_background_resize(HashTable *table) {
+    if (table == nullptr) return false;
+
+#ifndef CHASHTABLE_NO_DEBUGMALLOC
+    // The maintenance thread allocates and frees while other threads may do the same for other tables,
+    // and debugmalloc isn't thread-safe
+    return false;
+#endif
+    if (table->background != nullptr) return true;
+
+    struct background_resize *background = (struct background_resize *) malloc(sizeof(struct background_resize));
+    if (background == nullptr) return false;
+
+    *background = (struct background_resize){
+        .requested = false,
+        .preparing = false,
+        .migrating = false,
+        .stopping = false,
+        .paused = false,
+        .new_buckets = nullptr,
+        .new_size = 0,
+        .migrated = 0
+    };
+
+    if (mtx_init(&background->lock, mtx_plain) != thrd_success) {
+        free(background);
+        return false;
+    }
+
+    if (cnd_init(&background->wake) != thrd_success) {
+        mtx_destroy(&background->lock);
+        free(background);
+        return false;
+    }
+
+    if (cnd_init(&background->done) != thrd_success) {
+        cnd_destroy(&background->wake);
+        mtx_destroy(&background->lock);
+        free(background);
+        return false;
+    }
+
+    table->background = background;
+
+    if (thrd_create(&background->thread, maintenance_thread, table) != thrd_success) {
+        table->background = nullptr;
+        cnd_destroy(&background->done);
+        cnd_destroy(&background->wake);
+        mtx_destroy(&background->lock);
+        free(background);
+        return false;
+    }
+
+    return true;
+}
+
+bool background_resize_insert(HashTable *table, int key, int value) {
+    struct background_resize *background = table->background;
+    bool success = true;
+
+    mtx_lock(&background->lock);
+
+    // Migrations unshare the table first, so only the old array may hold shared entries
+    size_t old_hash;
+    Entry **bucket = locate_bucket(table, key, &old_hash);
+    if (!cow_own_range(table, old_hash, old_hash + 1)) {
+        mtx_unlock(&background->lock);
+        return false;
+    }
+
+    size_t length = 0;
+    for (Entry *entry = *bucket; entry != nullptr; entry = entry->next) {
+        length++;
+        if (entry->key == key) {
+            fingerprint_add(table, key, entry_fingerprint(key, value) - entry_fingerprint(key, entry->value));
+            entry->value = value;
+            chain_walked(table, key, length);
+            INSTRUMENT_COUNT(HT_COUNTER_INSERT_UPDATES, 1);
+            mtx_unlock(&background->lock);
+            return true;
+        }
+    }
+
+    chain_walked(table, key, length);
+
+    Entry *new_entry = (Entry *) memory_alloc(table->memory, sizeof(Entry));
+    if (new_entry == nullptr) {
+        success = false;
+    } else {
+        *new_entry = (Entry){
+            .key = key,
+            .value = value,
+            .next = *bucket
+        };
+
+        *bucket = new_entry;
+        table->count++;
+        fingerprint_add(table, key, entry_fingerprint(key, value));
+        INSTRUMENT_COUNT(HT_COUNTER_INSERT_NEW, 1);
+
+        // Only signal the maintenance thread, never resize on the caller's thread
+        if (table->count > table->load_threshold_count && !background->preparing && !background->migrating &&
+            !background->requested) {
+            background->requested = true;
+            cnd_signal(&background->wake);
+        }
+    }
+
+    mtx_unlock(&background->lock);
+
+    return success;
+}
+
+const Entry *background_resize_get(const HashTable *table, int key) {
+    struct background_resize *background = table->background;
+    const Entry *result = nullptr;
+
+    mtx_lock(&background->lock);
+
+    size_t length = 0;
+    for (const Entry *entry = *locate_bucket(table, key, nullptr); entry != nullptr; entry = entry->next) {
+        length++;
+        if (entry->key == key) {
+            result = entry;
+            break;
+        }
+    }
+
+    chain_walked(table, key, length);
+    INSTRUMENT_COUNT(result != nullptr ? HT_COUNTER_GET_HITS : HT_COUNTER_GET_MISSES, 1);
+
+    mtx_unlock(&background->lock);
+
+    return result;
+}
+
+bool background_resize_delete(HashTable *table, int key) {
+    struct background_resize *background = table->background;
+    bool deleted = false;
+
+    mtx_lock(&background->lock);
+
+    size_t old_hash;
+    Entry **bucket = locate_bucket(table, key, &old_hash);
+
+    // Don't duplicate a shared chunk for a key that isn't there
+    if (table->chunks != nullptr) {
+        bool found = false;
+        for (const Entry *entry = *bucket; entry != nullptr && !found; entry = entry->next) {
+            found = entry->key == key;
+        }
+
+        if (!found) INSTRUMENT_COUNT(HT_COUNTER_DELETE_MISSES, 1);
+        if (!found || !cow_own_range(table, old_hash, old_hash + 1)) {
+            mtx_unlock(&background->lock);
+            return false;
+        }
+    }
+
+    size_t length = 0;
+    for (Entry **indirect = bucket; *indirect != nullptr; indirect = &(*indirect)->next) {
+        length++;
+        if ((*indirect)->key == key) {
+            Entry *to_delete = *indirect;
+            *indirect = to_delete->next;
+            fingerprint_add(table, key, 0 - entry_fingerprint(key, to_delete->value));
+            entry_free(table, to_delete);
+            table->count--;
+            deleted = true;
+            break;
+        }
+    }
+
+    chain_walked(table, key, length);
+    INSTRUMENT_COUNT(deleted ? HT_COUNTER_DELETE_HITS : HT_COUNTER_DELETE_MISSES, 1);
+
+    mtx_unlock(&background->lock);
+
+    return deleted;
+}
+
+void background_resize_pause(HashTable *table, bool paused) {
+    struct background_resize *background = table->background;
+
+    mtx_lock(&background->lock);
+    background->paused = paused;
+    cnd_signal(&background->wake);
+    mtx_unlock(&background->lock);
+}
+
+void background_resize_lock(const HashTable *table) {
+    if (table->background != nullptr) mtx_lock(&table->background->lock);
+}
+
+void background_resize_unlock(const HashTable *table) {
+    if (table->background != nullptr) mtx_unlock(&table->background->lock);
+}
+
+const Entry *background_resize_chain_at(const HashTable *table, uint32_t position, uint64_t *range_end) {
+    const struct background_resize *background = table->background;
+    const size_t old_hash = (size_t) (((uint64_t) position * table->size) >> 32);
+
+    if (background->migrating && old_hash < background->migrated) {
+        // Positions below the first unmigrated old bucket live in the new array
+        const size_t new_hash = (size_t) (((uint64_t) position * background->new_size) >> 32);
+        const uint64_t new_end = hash_range_start(new_hash + 1, background->new_size);
+        const uint64_t migrated_end = hash_range_start(background->migrated, table->size);
+
+        *range_end = new_end < migrated_end ? new_end : migrated_end;
+        return background->new_buckets[new_hash];
+    }
+
+    *range_end = hash_range_start(old_hash + 1, table->size);
+    return table->buckets[old_hash];
+}
+
+void background_resize_lock_idle(const HashTable *table) {
+    if (table->background == nullptr) return;
+
+    struct background_resize *background = table->background;
+
+    mtx_lock(&background->lock);
+    while (background->requested || background->preparing || background->migrating) {
+        cnd_wait(&background->done, &background->lock);
+    }
+}
+
+void background_resize_wait(const HashTable *table) {
+    if (table == nullptr || table->background == nullptr) return;
+
+    background_resize_lock_idle(table);
+    mtx_unlock(&table->background->lock);
+}
+
+size_t background_resize_bytes(const HashTable *table) {
+    const struct background_resize *background = table->background;
+    if (background == nullptr) return 0;
+
+    size_t bytes = sizeof(struct background_resize);
+    if (background->migrating) bytes += sizeof(Entry *) * background->new_size;
+
+    return bytes;
+}
+
+void background_resize_stop(HashTable *table) {
+    struct background_resize *background = table->background;
+
+    // A running migration is finished before the thread exits
+    mtx_lock(&background->lock);
+    background->stopping = true;
+    cnd_signal(&background->wake);
+    mtx_unlock(&background->lock);
+
+    thrd_join(background->thread, nullptr);
+
+    cnd_destroy(&background->done);
+    cnd_destroy(&background->wake);
+    mtx_destroy(&background->lock);
+    free(background);
+
+    table->background = nullptr;
+}
+
+HashTableResizeProgress hash_table_resize_progress(const HashTable *table) {
+    HashTableResizeProgress progress = {
+        .in_progress = false,
+        .migrated_buckets = 0,
+        .total_buckets = 0,
+        .resize_count = 0,
+        .last_duration_ms = 0.0,
+        .total_duration_ms = 0.0
+    };
+
+    if (table == nullptr) return progress;
+
+    struct background_resize *background = table->background;
+    if (background != nullptr) mtx_lock(&background->lock);
+
+    if (background != nullptr && background->migrating) {
+        progress.in_progress = true;
+        progress.migrated_buckets = background->migrated;
+        progress.total_buckets = table->size;
+    }
+
+    progress.resize_count = table->resize_count;
+    progress.last_duration_ms = (double) table->resize_last_ns / 1e6;
+    progress.total_duration_ms = (double) table->resize_total_ns / 1e6;
+
+    if (background != nullptr) mtx_unlock(&background->lock);
+
+    return progress;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file hash_table_clone.c
+ * @brief Deep copy of a HashTable into a single block of entries
+ *
+ * hash_table_clone() allocates every entry of the clone in one contiguous node block, and
+ * reproduces the chains of the source bucket by bucket, so no key is hashed or looked up.
+ * Entries of a node block are freed one by one like any other entry, but their memory is
+ * only returned once the whole block is unused, see entry_free().
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+#ifndef CHASHTABLE_NO_DEBUGMALLOC
+#include "../debugmalloc/debugmalloc.h"
+#endif
+
+/**
+ * @brief Contiguous storage of the entries of a cloned table
+ *
+ * Copies of the clone share the block together with its entries, so the reference count is atomic.
+ */
+struct node_block {
+    atomic_size_t refs; /**< Live entries in the block, plus one for every table that may free them */
+    size_t capacity;    /**< Number of entries in the block */
+    Entry entries[];    /**< The entries */
+};
+
+void node_block_retain(struct node_block *block) {
+    if (block != nullptr) atomic_fetch_add_explicit(&block->refs, 1, memory_order_relaxed);
+}
+
+/** @brief Bytes of a node block holding `capacity` entries */
+static size_t block_bytes(size_t capacity) {
+    return sizeof(struct node_block) + sizeof(Entry) * capacity;
+}
+
+void node_block_release(struct table_memory *memory, struct node_block *block) {
+    if (block == nullptr) return;
+    if (atomic_fetch_sub_explicit(&block->refs, 1, memory_order_acq_rel) == 1) {
+        memory_free_bulk(memory, block, block_bytes(block->capacity));
+    }
+}
+
+struct node_block *node_block_create(struct table_memory *memory, size_t capacity) {
+    struct node_block *block = (struct node_block *) memory_alloc_bulk(memory, block_bytes(capacity));
+    if (block == nullptr) return nullptr;
+
+    memory_prefault(memory, block, block_bytes(capacity));
+    block->capacity = capacity;
+    atomic_init(&block->refs, 1);
+
+    return block;
+}
+
+Entry *node_block_entries(struct node_block *block) {
+    return block->entries;
+}
+
+void node_block_add_entries(struct node_block *block, size_t used) {
+    atomic_fetch_add_explicit(&block->refs, used, memory_order_relaxed);
+}
+
+bool entry_in_block(const HashTable *table, const Entry *entry) {
+    const struct node_block *block = table->nodes;
+    if (block == nullptr) return false;
+
+    const uintptr_t address = (uintptr_t) entry;
+    const uintptr_t begin = (uintptr_t) block->entries;
+    const uintptr_t end = (uintptr_t) (block->entries + block->capacity);
+
+    return address >= begin && address < end;
+}
+
+size_t node_block_bytes(const HashTable *table) {
+    if (table->nodes == nullptr) return 0;
+    return block_bytes(table->nodes->capacity);
+}
+
+void entry_free(const HashTable *table, Entry *entry) {
+    if (entry_in_block(table, entry)) node_block_release(table->memory, table->nodes);
+    else memory_free(table->memory, entry, sizeof(Entry));
+}
+
+HashTable *hash_table_clone(const HashTable *table) {
+    if (table == nullptr) return nullptr;
+
+    HashTable *new_table = nullptr;
+    struct node_block *block = nullptr;
+
+    // The clone shares nothing, so it gets a memory domain of its own, with the same allocator
+    const HashTableAllocator allocator = table_memory_allocator(table->memory);
+    struct table_memory *memory = table_memory_create(&allocator);
+    if (memory == nullptr) return nullptr;
+
+    background_resize_lock_idle(table);
+
+    Entry **buckets = (Entry **) memory_alloc_bulk(memory, sizeof(Entry *) * table->size);
+    uint64_t *merkle = merkle_duplicate(table, memory);
+    new_table = (HashTable *) malloc(sizeof(HashTable));
+    if (table->count > 0) {
+        block = (struct node_block *) memory_alloc_bulk(memory, block_bytes(table->count));
+    }
+
+    if (buckets == nullptr || (table->merkle != nullptr && merkle == nullptr) || new_table == nullptr ||
+        (table->count > 0 && block == nullptr)) {
+        free_buckets(memory, buckets, table->size);
+        memory_free(memory, merkle, merkle_bytes(table));
+        free(new_table);
+        memory_free_bulk(memory, block, block_bytes(table->count));
+        table_memory_release(memory);
+        new_table = nullptr;
+        goto cleanup;
+    }
+
+    if (block != nullptr) memory_prefault(memory, block, block_bytes(table->count));
+
+    // Chain by chain, in the same order, the entries are written sequentially
+    size_t used = 0;
+    for (size_t i = 0; i < table->size; i++) {
+        Entry **tail = &buckets[i];
+
+        for (const Entry *entry = table->buckets[i]; entry != nullptr; entry = entry->next) {
+            Entry *new_entry = &block->entries[used++];
+            *new_entry = (Entry){
+                .key = entry->key,
+                .value = entry->value,
+                .next = nullptr
+            };
+
+            *tail = new_entry;
+            tail = &new_entry->next;
+        }
+
+        *tail = nullptr;
+    }
+
+    if (block != nullptr) {
+        block->capacity = used;
+        atomic_init(&block->refs, used + 1);
+    }
+
+    *new_table = (HashTable){
+        .buckets = buckets,
+        .size = table->size,
+        .count = used,
+        .load_threshold_count = table->load_threshold_count,
+        .fingerprint = table->fingerprint,
+        .merkle = merkle,
+        .parallel_resize_min_count = table->parallel_resize_min_count,
+        .resize_threads = table->resize_threads,
+        .rehash_strategy = table->rehash_strategy,
+        .resize_count = 0,
+        .resize_last_ns = 0,
+        .resize_total_ns = 0,
+        .background = nullptr,
+        .chunks = nullptr,
+        .nodes = block,
+        .memory = memory
+    };
+
+cleanup:
+    background_resize_unlock(table);
+
+    return new_table;
+}
@@ -2,27 +2,44 @@
 * @file hash_table_core.c
  * @brief Core HashTable methods.
  *
- * Includes the create, destroy, insert, get, delete, and foreach HashTable methods
+ * Includes the create, destroy, clear, swap, insert, get, delete, and foreach HashTable methods
  */
 
 #include <stdlib.h>
 
 #include "hash_table.h"
 #include "hash_table_internal.h"
+#ifndef CHASHTABLE_NO_DEBUGMALLOC
 #include "../debugmalloc/debugmalloc.h"
+#endif
 
 HashTable *hash_table_create(void) {
     return hash_table_create_with_size(HT_INITIAL_SIZE);
 }
 
+HashTable *hash_table_create_with_allocator(const HashTableAllocator *allocator) {
+    struct table_memory *memory = table_memory_create(allocator);
+    if (memory == nullptr) return nullptr;
+
+    return create_table(HT_INITIAL_SIZE, memory);
+}
+
 bool hash_table_destroy(HashTable *table) {
     if (table == nullptr) return false;
 
-    // Free all entries
-    clear_buckets(table->buckets, table->size);
+    // Stop the maintenance thread first, it may be migrating entries
+    if (table->background != nullptr) background_resize_stop(table);
+
+    // Free all entries, except the ones still shared with a copy
+    cow_release(table);
 
     // Free buckets array
-    free(table->buckets);
+    free_buckets(table->memory, table->buckets, table->size);
+    node_block_release(table->memory, table->nodes);
+    merkle_free(table);
+
+    // Copies may still hold the memory domain
+    table_memory_release(table->memory);
 
     // Free table
     free(table);
@@ -30,22 +47,107 @@ bool hash_table_destroy(HashTable *table) {
     return true;
 }
 
-bool hash_table_insert(HashTable *table, int key, int value) {
+bool hash_table_clear(HashTable *table) {
     if (table == nullptr) return false;
 
+    background_resize_lock_idle(table);
+
+    // The bucket array is kept, only the entries are freed
+    cow_release(table);
+    node_block_release(table->memory, table->nodes);
+    table->nodes = nullptr;
+    table->count = 0;
+    table->fingerprint = 0;
+    merkle_reset(table);
+
+    background_resize_unlock(table);
+
+    return true;
+}
+
+/** @brief Swaps the values of two fields of the same type */
+#define SWAP_FIELD(a, b, field) do { \
+        typeof((a)->field) tmp = (a)->field; \
+        (a)->field = (b)->field; \
+        (b)->field = tmp; \
+    } while (0)
+
+bool hash_table_swap(HashTable *table1, HashTable *table2) {
+    if (table1 == nullptr || table2 == nullptr) return false;
+    if (table1 == table2) return true;
+
+    // Lock in a fixed order, so concurrent swaps of the same pair can't deadlock
+    HashTable *first = table1 < table2 ? table1 : table2;
+    HashTable *second = table1 < table2 ? table2 : table1;
+    background_resize_lock_idle(first);
+    background_resize_lock_idle(second);
+
+    // Contents only, the settings and the maintenance thread stay with the table.
+    // The memory domain goes with the contents, they must be freed by the allocator they came from
+    SWAP_FIELD(table1, table2, buckets);
+    SWAP_FIELD(table1, table2, size);
+    SWAP_FIELD(table1, table2, count);
+    SWAP_FIELD(table1, table2, load_threshold_count);
+    SWAP_FIELD(table1, table2, fingerprint);
+    SWAP_FIELD(table1, table2, merkle);
+    SWAP_FIELD(table1, table2, chunks);
+    SWAP_FIELD(table1, table2, nodes);
+    SWAP_FIELD(table1, table2, memory);
+
+    background_resize_unlock(second);
+    background_resize_unlock(first);
+
+    return true;
+}
+
+bool hash_table_move_into(HashTable *dst, HashTable *src) {
+    if (dst == nullptr || src == nullptr || dst == src) return false;
+
+    hash_table_swap(dst, src);
+
+    // src holds the old contents of dst now
+    return hash_table_destroy(src);
+}
+
+/** @brief Finds the entry of a key in a chain */
+static Entry *find_in_chain(const HashTable *table, Entry *chain, int key) {
+    size_t length = 0;
+    Entry *entry = chain;
+
+    while (entry != nullptr) {
+        length++;
+        if (entry->key == key) break;
+        entry = entry->next;
+    }
+
+    chain_walked(table, key, length);
+
+    return entry;
+}
+
+/** @brief hash_table_insert() without timing */
+static bool insert_entry(HashTable *table, int key, int value) {
+    if (table == nullptr) return false;
+    if (table->background != nullptr) return background_resize_insert(table, key, value);
+
     const size_t hash = hash_function(key, table->size);
+
+    // Never modify entries shared with a copy
+    if (table->chunks != nullptr && !cow_own_range(table, hash, hash + 1)) return false;
+
     Entry *bucket = table->buckets[hash];
 
     // If the key already exists, modify it
-    for (Entry *entry = bucket; entry != nullptr; entry = entry->next) {
-        if (entry->key == key) {
-            entry->value = value;
-            return true;
-        }
+    Entry *entry = find_in_chain(table, bucket, key);
+    if (entry != nullptr) {
+        fingerprint_add(table, key, entry_fingerprint(key, value) - entry_fingerprint(key, entry->value));
+        entry->value = value;
+        INSTRUMENT_COUNT(HT_COUNTER_INSERT_UPDATES, 1);
+        return true;
     }
 
     // Else prepend a new entry to the head of the bucket
-    Entry *new_entry = (Entry *) malloc(sizeof(Entry));
+    Entry *new_entry = (Entry *) memory_alloc(table->memory, sizeof(Entry));
     if (new_entry == nullptr) return false;
 
     *new_entry = (Entry){
@@ -57,6 +159,8 @@ bool hash_table_insert(HashTable *table, int key, int value) {
     table->buckets[hash] = new_entry;
 
     table->count++;
+    fingerprint_add(table, key, entry_fingerprint(key, value));
+    INSTRUMENT_COUNT(HT_COUNTER_INSERT_NEW, 1);
 
     // Grow table if needed
     if (table->count > table->load_threshold_count) {
@@ -65,42 +169,98 @@ bool hash_table_insert(HashTable *table, int key, int value) {
     return true;
 }
 
-const Entry *hash_table_get(const HashTable *table, int key) {
+/** @brief hash_table_get() without timing */
+static const Entry *get_entry(const HashTable *table, int key) {
     if (table == nullptr) return nullptr;
+    if (table->background != nullptr) return background_resize_get(table, key);
 
     const size_t hash = hash_function(key, table->size);
-    const Entry *bucket = table->buckets[hash];
+    const Entry *entry = find_in_chain(table, table->buckets[hash], key);
 
-    for (const Entry *entry = bucket; entry != nullptr; entry = entry->next) {
-        if (entry->key == key) {
-            return entry;
-        }
-    }
+    INSTRUMENT_COUNT(entry != nullptr ? HT_COUNTER_GET_HITS : HT_COUNTER_GET_MISSES, 1);
 
-    return nullptr;
+    return entry;
 }
 
-bool hash_table_delete(HashTable *table, int key) {
+/** @brief hash_table_delete() without timing */
+static bool delete_entry(HashTable *table, int key) {
     if (table == nullptr) return false;
+    if (table->background != nullptr) return background_resize_delete(table, key);
 
     const size_t hash = hash_function(key, table->size);
 
+    // Don't duplicate a shared chunk for a key that isn't there
+    if (table->chunks != nullptr) {
+        bool found = false;
+        for (const Entry *entry = table->buckets[hash]; entry != nullptr && !found; entry = entry->next) {
+            found = entry->key == key;
+        }
+
+        if (!found) {
+            INSTRUMENT_COUNT(HT_COUNTER_DELETE_MISSES, 1);
+            return false;
+        }
+        if (!cow_own_range(table, hash, hash + 1)) return false;
+    }
+
+    size_t length = 0;
     for (Entry **indirect = &table->buckets[hash]; *indirect != nullptr; indirect = &(*indirect)->next) {
+        length++;
         if ((*indirect)->key == key) {
             Entry *to_delete = *indirect;
             *indirect = to_delete->next;
-            free(to_delete);
+            fingerprint_add(table, key, 0 - entry_fingerprint(key, to_delete->value));
+            entry_free(table, to_delete);
             table->count--;
+            chain_walked(table, key, length);
+            INSTRUMENT_COUNT(HT_COUNTER_DELETE_HITS, 1);
             return true;
         }
     }
 
+    chain_walked(table, key, length);
+    INSTRUMENT_COUNT(HT_COUNTER_DELETE_MISSES, 1);
+
     return false;
 }
 
+bool hash_table_insert(HashTable *table, int key, int value) {
+    if (!op_timing_enabled()) return insert_entry(table, key, value);
+
+    const OpTimer timer = op_timer_start(table);
+    const bool result = insert_entry(table, key, value);
+    op_timer_stop(&timer, HT_OP_INSERT, table, key);
+
+    return result;
+}
+
+const Entry *hash_table_get(const HashTable *table, int key) {
+    if (!op_timing_enabled()) return get_entry(table, key);
+
+    const OpTimer timer = op_timer_start(table);
+    const Entry *result = get_entry(table, key);
+    op_timer_stop(&timer, HT_OP_GET, table, key);
+
+    return result;
+}
+
+bool hash_table_delete(HashTable *table, int key) {
+    if (!op_timing_enabled()) return delete_entry(table, key);
+
+    const OpTimer timer = op_timer_start(table);
+    const bool result = delete_entry(table, key);
+    op_timer_stop(&timer, HT_OP_DELETE, table, key);
+
+    return result;
+}
+
 bool hash_table_equal(const HashTable *table1, const HashTable *table2) {
+    background_resize_wait(table1);
     if (table1->count != table2->count) return false;
 
+    // Different fingerprints mean different contents, matching ones still need a full check
+    if (table1->fingerprint != table2->fingerprint) return false;
+
     for (size_t i = 0; i < table1->size; i++) {
         Entry *bucket = table1->buckets[i];
         for (Entry *ht_1entry = bucket; ht_1entry != nullptr; ht_1entry = ht_1entry->next) {
@@ -113,23 +273,9 @@ bool hash_table_equal(const HashTable *table1, const HashTable *table2) {
     return true;
 }
 
-static void copy_callback(int key, int value, void *user_data) {
-    HashTable *table = (HashTable *) (user_data);
-    hash_table_insert(table, key, value);
-}
-
-HashTable *hash_table_copy(const HashTable *table) {
-    if (table == nullptr) return nullptr;
-
-    HashTable *new_table = hash_table_create_with_size(table->size);
-    if (new_table == nullptr) return nullptr;
-    hash_table_foreach(table, copy_callback, new_table);
-
-    return new_table;
-}
-
 void hash_table_foreach(const HashTable *table, void (*callback)(int key, int value, void *), void *user_data) {
     if (table == nullptr) return;
+    background_resize_wait(table);
 
     for (size_t i = 0; i < table->size; i++) {
         Entry *bucket = table->buckets[i];
@@ -0,0 +1,270 @@
+/**
+ * @file hash_table_cow.c
+ * @brief Copy-on-write sharing between a table and its copies
+ *
+ * The bucket array is split into chunks of HT_COW_CHUNK_BUCKETS buckets. hash_table_copy()
+ * copies the bucket pointers only, so the entries of every chunk are shared, and counted by a
+ * reference counted cell per chunk. Before a table modifies a chunk that is still shared,
+ * it duplicates the chunk's entries and drops its reference to the shared ones.
+ * Tables that were never copied have no cells, and skip all of this.
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+#ifndef CHASHTABLE_NO_DEBUGMALLOC
+#include "../debugmalloc/debugmalloc.h"
+#endif
+
+/**
+ * @brief Reference count of a chunk of entries
+ *
+ * Shared by every table holding the same entries in the chunk. The count may be changed by
+ * the threads of different tables, so it is atomic.
+ */
+struct cow_chunk {
+    atomic_size_t refs; /**< Number of tables sharing the entries of the chunk */
+};
+
+/** @brief Number of chunks of a bucket array */
+static size_t chunk_count(size_t size) {
+    return (size + HT_COW_CHUNK_BUCKETS - 1) / HT_COW_CHUNK_BUCKETS;
+}
+
+/** @brief Frees every entry of a chain, see entry_free() */
+static void free_chain(const HashTable *table, Entry *entry) {
+    while (entry != nullptr) {
+        Entry *next = entry->next;
+        entry_free(table, entry);
+        entry = next;
+    }
+}
+
+/**
+ * @brief Duplicates a chain, keeping the order of its entries
+ * @param table Table owning the chain
+ * @param head Chain to duplicate
+ * @param copy Set to the head of the duplicate
+ * @return false if an entry couldn't be allocated, nothing is duplicated in that case
+ */
+static bool duplicate_chain(const HashTable *table, const Entry *head, Entry **copy) {
+    Entry *new_head = nullptr;
+    Entry **tail = &new_head;
+
+    for (const Entry *entry = head; entry != nullptr; entry = entry->next) {
+        Entry *new_entry = (Entry *) memory_alloc(table->memory, sizeof(Entry));
+        if (new_entry == nullptr) {
+            free_chain(table, new_head);
+            return false;
+        }
+
+        *new_entry = (Entry){
+            .key = entry->key,
+            .value = entry->value,
+            .next = nullptr
+        };
+
+        *tail = new_entry;
+        tail = &new_entry->next;
+    }
+
+    *copy = new_head;
+    return true;
+}
+
+/**
+ * @brief Makes the entries of a chunk private to the table
+ * @param table Table with shared chunks
+ * @param chunk Chunk index
+ * @return false if the entries couldn't be duplicated, the chunk stays shared in that case
+ */
+static bool own_chunk(HashTable *table, size_t chunk) {
+    struct cow_chunk *cell = table->chunks[chunk];
+    if (atomic_load_explicit(&cell->refs, memory_order_acquire) == 1) return true;
+
+    const size_t first = chunk * HT_COW_CHUNK_BUCKETS;
+    const size_t last = first + HT_COW_CHUNK_BUCKETS < table->size ? first + HT_COW_CHUNK_BUCKETS : table->size;
+
+    struct cow_chunk *own = (struct cow_chunk *) memory_alloc(table->memory, sizeof(struct cow_chunk));
+    if (own == nullptr) return false;
+
+    Entry *copies[HT_COW_CHUNK_BUCKETS];
+    for (size_t i = first; i < last; i++) {
+        if (!duplicate_chain(table, table->buckets[i], &copies[i - first])) {
+            for (size_t j = first; j < i; j++) {
+                free_chain(table, copies[j - first]);
+            }
+            memory_free(table->memory, own, sizeof(struct cow_chunk));
+            return false;
+        }
+    }
+
+    Entry *shared[HT_COW_CHUNK_BUCKETS];
+    for (size_t i = first; i < last; i++) {
+        shared[i - first] = table->buckets[i];
+        table->buckets[i] = copies[i - first];
+    }
+
+    atomic_init(&own->refs, 1);
+    table->chunks[chunk] = own;
+
+    // The other tables may have dropped the chunk since the check above
+    if (atomic_fetch_sub_explicit(&cell->refs, 1, memory_order_acq_rel) == 1) {
+        for (size_t i = first; i < last; i++) {
+            free_chain(table, shared[i - first]);
+        }
+        memory_free(table->memory, cell, sizeof(struct cow_chunk));
+    }
+
+    return true;
+}
+
+bool cow_own_range(HashTable *table, size_t first, size_t last) {
+    if (table->chunks == nullptr || first >= last) return true;
+
+    for (size_t chunk = first / HT_COW_CHUNK_BUCKETS; chunk <= (last - 1) / HT_COW_CHUNK_BUCKETS; chunk++) {
+        if (!own_chunk(table, chunk)) return false;
+    }
+
+    return true;
+}
+
+bool cow_unshare(HashTable *table) {
+    if (table->chunks == nullptr) return true;
+    if (!cow_own_range(table, 0, table->size)) return false;
+
+    // Every chunk is private now, the cells aren't needed anymore
+    const size_t chunks = chunk_count(table->size);
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        memory_free(table->memory, table->chunks[chunk], sizeof(struct cow_chunk));
+    }
+    memory_free(table->memory, table->chunks, sizeof(struct cow_chunk *) * chunks);
+    table->chunks = nullptr;
+
+    return true;
+}
+
+size_t cow_bytes(const HashTable *table) {
+    if (table->chunks == nullptr) return 0;
+    return chunk_count(table->size) * (sizeof(struct cow_chunk *) + sizeof(struct cow_chunk));
+}
+
+void cow_release(HashTable *table) {
+    if (table->chunks == nullptr) {
+        clear_buckets(table);
+        return;
+    }
+
+    const size_t chunks = chunk_count(table->size);
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        struct cow_chunk *cell = table->chunks[chunk];
+        const size_t first = chunk * HT_COW_CHUNK_BUCKETS;
+        const size_t last = first + HT_COW_CHUNK_BUCKETS < table->size ? first + HT_COW_CHUNK_BUCKETS : table->size;
+
+        // Only the last table holding the chunk frees its entries
+        if (atomic_fetch_sub_explicit(&cell->refs, 1, memory_order_acq_rel) == 1) {
+            for (size_t i = first; i < last; i++) {
+                free_chain(table, table->buckets[i]);
+            }
+            memory_free(table->memory, cell, sizeof(struct cow_chunk));
+        }
+
+        for (size_t i = first; i < last; i++) {
+            table->buckets[i] = nullptr;
+        }
+    }
+
+    memory_free(table->memory, table->chunks, sizeof(struct cow_chunk *) * chunks);
+    table->chunks = nullptr;
+}
+
+/**
+ * @brief Creates a reference counted cell for every chunk of a table
+ * @param table Table without shared chunks
+ * @return false if the cells couldn't be allocated
+ */
+static bool share(HashTable *table) {
+    const size_t chunks = chunk_count(table->size);
+
+    struct cow_chunk **cells = (struct cow_chunk **) memory_alloc(table->memory, sizeof(struct cow_chunk *) * chunks);
+    if (cells == nullptr) return false;
+
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        cells[chunk] = (struct cow_chunk *) memory_alloc(table->memory, sizeof(struct cow_chunk));
+        if (cells[chunk] == nullptr) {
+            for (size_t i = 0; i < chunk; i++) {
+                memory_free(table->memory, cells[i], sizeof(struct cow_chunk));
+            }
+            memory_free(table->memory, cells, sizeof(struct cow_chunk *) * chunks);
+            return false;
+        }
+        atomic_init(&cells[chunk]->refs, 1);
+    }
+
+    table->chunks = cells;
+    return true;
+}
+
+HashTable *hash_table_copy(const HashTable *table) {
+    if (table == nullptr) return nullptr;
+
+    // Sharing only adds reference counts to the source, its entries are left untouched
+    HashTable *source = (HashTable *) table;
+    HashTable *new_table = nullptr;
+
+    background_resize_lock_idle(source);
+
+    if (source->chunks == nullptr && !share(source)) goto cleanup;
+
+    // The copy shares the entries, and so the memory domain they were allocated from
+    struct table_memory *memory = source->memory;
+    const size_t chunks = chunk_count(source->size);
+    Entry **buckets = (Entry **) memory_alloc_bulk(memory, sizeof(Entry *) * source->size);
+    struct cow_chunk **cells = (struct cow_chunk **) memory_alloc(memory, sizeof(struct cow_chunk *) * chunks);
+    uint64_t *merkle = merkle_duplicate(source, memory);
+    new_table = (HashTable *) malloc(sizeof(HashTable));
+
+    if (buckets == nullptr || cells == nullptr || (source->merkle != nullptr && merkle == nullptr) || new_table == nullptr) {
+        free_buckets(memory, buckets, source->size);
+        memory_free(memory, cells, sizeof(struct cow_chunk *) * chunks);
+        memory_free(memory, merkle, merkle_bytes(source));
+        free(new_table);
+        new_table = nullptr;
+        goto cleanup;
+    }
+
+    memcpy(buckets, source->buckets, sizeof(Entry *) * source->size);
+    memcpy(cells, source->chunks, sizeof(struct cow_chunk *) * chunks);
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        atomic_fetch_add_explicit(&cells[chunk]->refs, 1, memory_order_relaxed);
+    }
+
+    *new_table = (HashTable){
+        .buckets = buckets,
+        .size = source->size,
+        .count = source->count,
+        .load_threshold_count = source->load_threshold_count,
+        .fingerprint = source->fingerprint,
+        .merkle = merkle,
+        .parallel_resize_min_count = source->parallel_resize_min_count,
+        .resize_threads = source->resize_threads,
+        .rehash_strategy = source->rehash_strategy,
+        .resize_count = 0,
+        .resize_last_ns = 0,
+        .resize_total_ns = 0,
+        .background = nullptr,
+        .chunks = cells,
+        .nodes = source->nodes,
+        .memory = memory
+    };
+    node_block_retain(source->nodes);
+    table_memory_retain(memory);
+
+cleanup:
+    background_resize_unlock(source);
+
+    return new_table;
+}
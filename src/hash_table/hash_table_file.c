@@ -0,0 +1,421 @@
+/**
+ * @file hash_table_file.c
+ * @brief Writable tables stored in a memory-mapped file
+ *
+ * The bucket array and the entries live in the mapping, linked by node indices instead of pointers,
+ * so the file is the table and a reopen serves it without a load step. Deleted entries are
+ * replaced by the last one, keeping the nodes contiguous: a resize rehashes them with a linear scan.
+ *
+ * Layout: a header page, `size` bucket heads, then `capacity` nodes. The capacity is the load
+ * threshold count of the size, so the nodes run out exactly when a HashTable would resize.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+#ifndef CHASHTABLE_NO_DEBUGMALLOC
+#include "../debugmalloc/debugmalloc.h"
+#endif
+
+/** @brief Header line of a table file */
+static constexpr char FILE_HEADER_LINE[16] = "CHashTable f1.0\n";
+static constexpr uint32_t FILE_VERSION = 1;
+static constexpr uint32_t FILE_BYTE_ORDER = 0x01020304u;
+/** @brief Bytes reserved for the header, the bucket array starts on its own page */
+static constexpr size_t FILE_HEADER_BYTES = 4096;
+/** @brief Index of no node, ends a chain */
+static constexpr uint32_t NODE_NONE = UINT32_MAX;
+
+/** @brief Header at the start of a table file */
+typedef struct {
+    char header_line[16];   /**< FILE_HEADER_LINE */
+    uint32_t version;       /**< FILE_VERSION */
+    uint32_t byte_order;    /**< FILE_BYTE_ORDER */
+    uint32_t dirty;         /**< Modified since the last checkpoint, set if the process died before closing */
+    uint32_t reserved;      /**< Zero */
+    uint64_t size;          /**< Number of buckets, a prime */
+    uint64_t capacity;      /**< Number of nodes */
+    uint64_t count;         /**< Number of entries, held by the first `count` nodes */
+    uint32_t checksum;      /**< CRC-32C of the header up to this field, written by checkpoints */
+} FileHeader;
+
+static_assert(sizeof(FileHeader) <= FILE_HEADER_BYTES, "file header must fit its page");
+
+/** @brief Entry of a table file */
+typedef struct {
+    int32_t key;
+    int32_t value;
+    uint32_t next;          /**< Index of the next node of the chain, NODE_NONE at the end */
+} FileNode;
+
+struct hash_table_file {
+    int fd;                 /**< Open descriptor of the file */
+    uint8_t *data;          /**< Shared mapping of the whole file */
+    size_t bytes;           /**< Size of the file and the mapping */
+};
+
+#ifdef HT_HAVE_MMAP
+
+static FileHeader *file_header(const HashTableFile *file) {
+    return (FileHeader *) file->data;
+}
+
+static uint32_t *file_buckets(const HashTableFile *file) {
+    return (uint32_t *) (file->data + FILE_HEADER_BYTES);
+}
+
+static FileNode *file_nodes(const HashTableFile *file) {
+    return (FileNode *) (file->data + FILE_HEADER_BYTES + file_header(file)->size * sizeof(uint32_t));
+}
+
+/** @brief Size of a file with the given bucket and node counts */
+static size_t file_bytes(uint64_t size, uint64_t capacity) {
+    return FILE_HEADER_BYTES + size * sizeof(uint32_t) + capacity * sizeof(FileNode);
+}
+
+/** @brief Sets the dirty flag and writes it out before the first change after a checkpoint */
+static void mark_dirty(HashTableFile *file) {
+    FileHeader *header = file_header(file);
+    if (header->dirty != 0) return;
+
+    header->dirty = 1;
+    msync(file->data, FILE_HEADER_BYTES, MS_SYNC);
+}
+
+/** @brief Links the first `count` nodes into the cleared bucket array */
+static void relink_nodes(HashTableFile *file) {
+    const FileHeader *header = file_header(file);
+    uint32_t *buckets = file_buckets(file);
+    FileNode *nodes = file_nodes(file);
+
+    memset(buckets, 0xff, header->size * sizeof(uint32_t));
+    for (uint64_t i = 0; i < header->count; i++) {
+        const size_t hash = hash_function(nodes[i].key, header->size);
+        nodes[i].next = buckets[hash];
+        buckets[hash] = (uint32_t) i;
+    }
+}
+
+/**
+ * @brief Maps a file of a new size in place of the current mapping
+ *
+ * The new mapping is made before the old one is dropped, a failure leaves the table usable.
+ */
+static bool remap_file(HashTableFile *file, size_t bytes) {
+    uint8_t *data = (uint8_t *) mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if (data == MAP_FAILED) return false;
+
+    if (file->data != nullptr) munmap(file->data, file->bytes);
+    file->data = data;
+    file->bytes = bytes;
+
+    return true;
+}
+
+/**
+ * @brief Grows the file to the next size, like hash_table_resize()
+ *
+ * The file is extended, the nodes are moved past the larger bucket array, and relinked into it.
+ * If the disk is full, the file is cut back and the table stays as it was.
+ */
+static bool grow_file(HashTableFile *file) {
+    const FileHeader *header = file_header(file);
+    const uint64_t new_size = next_prime(header->size * 2);
+    const uint64_t new_capacity = calc_load_threshold_count(new_size);
+    if (new_capacity >= NODE_NONE) return false;
+
+    const size_t old_bytes = file->bytes;
+    const size_t bytes = file_bytes(new_size, new_capacity);
+    if (!file_reserve(file->fd, old_bytes, bytes - old_bytes) || !remap_file(file, bytes)) {
+        ftruncate(file->fd, (off_t) old_bytes);
+        return false;
+    }
+
+    FileHeader *grown = file_header(file);
+    const FileNode *old_nodes = file_nodes(file);
+    grown->size = new_size;
+    grown->capacity = new_capacity;
+    memmove(file_nodes(file), old_nodes, grown->count * sizeof(FileNode));
+
+    relink_nodes(file);
+
+    return true;
+}
+
+/** @brief Opens and maps a file, the size of the file is stored into `file->bytes` */
+static HashTable_LoadError map_file(const char *filename, int flags, HashTableFile *file) {
+    file->fd = open(filename, flags, 0644);
+    if (file->fd < 0) return HT_LOAD_ERROR_FILE_OPEN;
+
+    struct stat st;
+    if (fstat(file->fd, &st) != 0) return HT_LOAD_ERROR_FILE_OPEN;
+
+    file->bytes = (size_t) st.st_size;
+    if (file->bytes == 0) return HT_LOAD_OK;
+
+    file->data = (uint8_t *) mmap(nullptr, file->bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if (file->data == MAP_FAILED) {
+        file->data = nullptr;
+        return HT_LOAD_ERROR_ALLOC_FAILED;
+    }
+
+    return HT_LOAD_OK;
+}
+
+/** @brief Checks the header against the size of the file */
+static HashTable_LoadError check_file(const HashTableFile *file) {
+    if (file->bytes == 0) return HT_LOAD_ERROR_EMPTY;
+
+    const FileHeader *header = file_header(file);
+    if (file->bytes < sizeof(header->header_line) ||
+        memcmp(header->header_line, FILE_HEADER_LINE, sizeof(header->header_line)) != 0) {
+        return HT_LOAD_ERROR_INVALID_HEADER;
+    }
+    if (file->bytes < FILE_HEADER_BYTES) return HT_LOAD_ERROR_MISSING_COUNT;
+
+    // The checksum is only up to date after a checkpoint
+    if (header->dirty != 0) return HT_LOAD_ERROR_UNCLEAN_SHUTDOWN;
+    if (header->checksum != crc32c(header, offsetof(FileHeader, checksum))) return HT_LOAD_ERROR_CHECKSUM;
+    if (header->version != FILE_VERSION || header->byte_order != FILE_BYTE_ORDER) {
+        return HT_LOAD_ERROR_INVALID_HEADER;
+    }
+
+    if (header->size < HT_INITIAL_SIZE || header->size > UINT32_MAX || !is_prime(header->size) ||
+        header->capacity != calc_load_threshold_count(header->size) || header->count > header->capacity) {
+        return HT_LOAD_ERROR_MALFORMED_COUNT;
+    }
+
+    const size_t expected = file_bytes(header->size, header->capacity);
+    if (file->bytes < expected) return HT_LOAD_ERROR_PREMATURE_EOF;
+    if (file->bytes > expected) return HT_LOAD_ERROR_MALFORMED_LINE;
+
+    return HT_LOAD_OK;
+}
+
+/** @brief Unmaps and closes a file, and frees its handle */
+static void release_file(HashTableFile *file) {
+    if (file->data != nullptr) munmap(file->data, file->bytes);
+    if (file->fd >= 0) close(file->fd);
+    free(file);
+}
+
+HashTableFile *hash_table_file_create(const char *filename) {
+    HashTableFile *file = (HashTableFile *) malloc(sizeof(HashTableFile));
+    if (file == nullptr) return nullptr;
+    *file = (HashTableFile){.fd = -1, .data = nullptr, .bytes = 0};
+
+    const size_t capacity = calc_load_threshold_count(HT_INITIAL_SIZE);
+    const size_t bytes = file_bytes(HT_INITIAL_SIZE, capacity);
+
+    if (map_file(filename, O_RDWR | O_CREAT | O_TRUNC, file) != HT_LOAD_OK ||
+        !file_reserve(file->fd, 0, bytes) || !remap_file(file, bytes)) {
+        release_file(file);
+        return nullptr;
+    }
+
+    FileHeader *header = file_header(file);
+    memcpy(header->header_line, FILE_HEADER_LINE, sizeof(header->header_line));
+    header->version = FILE_VERSION;
+    header->byte_order = FILE_BYTE_ORDER;
+    header->size = HT_INITIAL_SIZE;
+    header->capacity = capacity;
+    header->count = 0;
+    relink_nodes(file);
+
+    if (!hash_table_file_checkpoint(file)) {
+        release_file(file);
+        return nullptr;
+    }
+
+    return file;
+}
+
+HashTable_LoadError hash_table_file_open(const char *filename, HashTableFile **out_file) {
+    *out_file = nullptr;
+
+    HashTableFile *file = (HashTableFile *) malloc(sizeof(HashTableFile));
+    if (file == nullptr) return HT_LOAD_ERROR_ALLOC_FAILED;
+    *file = (HashTableFile){.fd = -1, .data = nullptr, .bytes = 0};
+
+    HashTable_LoadError error_code = map_file(filename, O_RDWR, file);
+    if (error_code == HT_LOAD_OK) error_code = check_file(file);
+
+    if (error_code != HT_LOAD_OK) {
+        release_file(file);
+        return error_code;
+    }
+
+    *out_file = file;
+
+    return HT_LOAD_OK;
+}
+
+bool hash_table_file_insert(HashTableFile *file, int key, int value) {
+    if (file == nullptr) return false;
+
+    FileHeader *header = file_header(file);
+    FileNode *nodes = file_nodes(file);
+    const size_t hash = hash_function(key, header->size);
+
+    // If the key already exists, modify it
+    for (uint32_t i = file_buckets(file)[hash]; i != NODE_NONE; i = nodes[i].next) {
+        if (nodes[i].key == key) {
+            mark_dirty(file);
+            nodes[i].value = value;
+            return true;
+        }
+    }
+
+    mark_dirty(file);
+
+    // Out of nodes, the load threshold is reached
+    if (header->count == header->capacity) {
+        if (!grow_file(file)) return false;
+        header = file_header(file);
+    }
+
+    // Else append a node, and prepend it to the chain
+    nodes = file_nodes(file);
+    uint32_t *bucket = &file_buckets(file)[hash_function(key, header->size)];
+    const uint32_t index = (uint32_t) header->count;
+
+    nodes[index] = (FileNode){.key = key, .value = value, .next = *bucket};
+    *bucket = index;
+    header->count++;
+
+    return true;
+}
+
+bool hash_table_file_get(const HashTableFile *file, int key, int *out_value) {
+    if (file == nullptr) return false;
+
+    const FileNode *nodes = file_nodes(file);
+    const size_t hash = hash_function(key, file_header(file)->size);
+
+    for (uint32_t i = file_buckets(file)[hash]; i != NODE_NONE; i = nodes[i].next) {
+        if (nodes[i].key == key) {
+            if (out_value != nullptr) *out_value = nodes[i].value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool hash_table_file_delete(HashTableFile *file, int key) {
+    if (file == nullptr) return false;
+
+    FileHeader *header = file_header(file);
+    uint32_t *buckets = file_buckets(file);
+    FileNode *nodes = file_nodes(file);
+
+    uint32_t *link = &buckets[hash_function(key, header->size)];
+    while (*link != NODE_NONE && nodes[*link].key != key) {
+        link = &nodes[*link].next;
+    }
+    if (*link == NODE_NONE) return false;
+
+    mark_dirty(file);
+
+    const uint32_t index = *link;
+    *link = nodes[index].next;
+
+    // Move the last node into the hole, redirecting the link pointing to it
+    const uint32_t last = (uint32_t) header->count - 1;
+    if (index != last) {
+        uint32_t *last_link = &buckets[hash_function(nodes[last].key, header->size)];
+        while (*last_link != last) {
+            last_link = &nodes[*last_link].next;
+        }
+
+        nodes[index] = nodes[last];
+        *last_link = index;
+    }
+
+    header->count--;
+
+    return true;
+}
+
+size_t hash_table_file_count(const HashTableFile *file) {
+    if (file == nullptr) return 0;
+    return (size_t) file_header(file)->count;
+}
+
+void hash_table_file_foreach(const HashTableFile *file, void (*callback)(int key, int value, void *), void *user_data) {
+    if (file == nullptr) return;
+
+    const FileNode *nodes = file_nodes(file);
+    const uint64_t count = file_header(file)->count;
+    for (uint64_t i = 0; i < count; i++) {
+        callback(nodes[i].key, nodes[i].value, user_data);
+    }
+}
+
+bool hash_table_file_checkpoint(HashTableFile *file) {
+    if (file == nullptr) return false;
+
+    // The contents reach the disk before the header claims they are complete
+    if (msync(file->data, file->bytes, MS_SYNC) != 0 || fsync(file->fd) != 0) return false;
+
+    FileHeader *header = file_header(file);
+    header->dirty = 0;
+    header->checksum = crc32c(header, offsetof(FileHeader, checksum));
+
+    return msync(file->data, FILE_HEADER_BYTES, MS_SYNC) == 0;
+}
+
+bool hash_table_file_close(HashTableFile *file) {
+    if (file == nullptr) return false;
+
+    const bool success = hash_table_file_checkpoint(file);
+    release_file(file);
+
+    return success;
+}
+
+#else
+
+// Table files need a shared mapping of the file, there is nothing to fall back on
+
+HashTableFile *hash_table_file_create(const char *filename) {
+    return nullptr;
+}
+
+HashTable_LoadError hash_table_file_open(const char *filename, HashTableFile **out_file) {
+    *out_file = nullptr;
+    return HT_LOAD_ERROR_FILE_OPEN;
+}
+
+bool hash_table_file_insert(HashTableFile *file, int key, int value) {
+    return false;
+}
+
+bool hash_table_file_get(const HashTableFile *file, int key, int *out_value) {
+    return false;
+}
+
+bool hash_table_file_delete(HashTableFile *file, int key) {
+    return false;
+}
+
+size_t hash_table_file_count(const HashTableFile *file) {
+    return 0;
+}
+
+void hash_table_file_foreach(const HashTableFile *file, void (*callback)(int key, int value, void *), void *user_data) {
+}
+
+bool hash_table_file_checkpoint(HashTableFile *file) {
+    return false;
+}
+
+bool hash_table_file_close(HashTableFile *file) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,108 @@
+/**
+ * @file hash_table_hugepage.c
+ * @brief Allocator backing bucket arrays and node blocks with huge pages
+ *
+ * A table of several GB spread over 4 KiB pages takes millions of page faults to fill, and most
+ * lookups miss the TLB. Mapping the large blocks aligned to 2 MiB lets transparent huge pages
+ * back them, cutting both by a factor of 512. Anonymous mappings are zeroed by the kernel when a
+ * page is first touched, so bucket arrays need no clearing loop.
+ *
+ * debugmalloc isn't used here, its block size limit would reject the blocks just below HT_HUGE_PAGE_SIZE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+
+static void *huge_page_allocate(size_t size, void *user_data) {
+    return malloc(size);
+}
+
+static void huge_page_deallocate(void *ptr, size_t size, void *user_data) {
+    free(ptr);
+}
+
+#ifdef HT_HAVE_MMAP
+/** @brief Bytes mapped for a block, rounded up to whole huge pages */
+static size_t mapped_bytes(size_t size) {
+    return (size + HT_HUGE_PAGE_SIZE - 1) / HT_HUGE_PAGE_SIZE * HT_HUGE_PAGE_SIZE;
+}
+#endif
+
+static void *huge_page_allocate_bulk(size_t size, void *user_data) {
+#ifdef HT_HAVE_MMAP
+    if (size >= HT_HUGE_PAGE_SIZE) {
+        const size_t length = mapped_bytes(size);
+
+        // Map an extra huge page, then trim the region to a huge page boundary on both sides
+        uint8_t *region = (uint8_t *) mmap(
+            nullptr, length + HT_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+        );
+        if (region == MAP_FAILED) return nullptr;
+
+        const uintptr_t aligned = ((uintptr_t) region + HT_HUGE_PAGE_SIZE - 1) & ~(uintptr_t) (HT_HUGE_PAGE_SIZE - 1);
+        uint8_t *block = (uint8_t *) aligned;
+        const size_t head = (size_t) (block - region);
+
+        if (head > 0) munmap(region, head);
+        munmap(block + length, HT_HUGE_PAGE_SIZE - head);
+
+#ifdef MADV_HUGEPAGE
+        // Only a hint, the kernel falls back to small pages if THP is disabled
+        madvise(block, length, MADV_HUGEPAGE);
+#endif
+
+        return block;
+    }
+#endif
+
+    return calloc(1, size);
+}
+
+static void huge_page_deallocate_bulk(void *ptr, size_t size, void *user_data) {
+#ifdef HT_HAVE_MMAP
+    if (size >= HT_HUGE_PAGE_SIZE) {
+        munmap(ptr, mapped_bytes(size));
+        return;
+    }
+#endif
+
+    free(ptr);
+}
+
+HashTableAllocator hash_table_huge_page_allocator(unsigned options) {
+    return (HashTableAllocator){
+        .allocate = huge_page_allocate,
+        .deallocate = huge_page_deallocate,
+        .allocate_bulk = huge_page_allocate_bulk,
+        .deallocate_bulk = huge_page_deallocate_bulk,
+        .user_data = (void *) (uintptr_t) options,
+        .bulk_zeroed = true
+    };
+}
+
+void huge_page_prefault(const HashTableAllocator *allocator, void *ptr, size_t size) {
+#ifdef HT_HAVE_MMAP
+    if (allocator->allocate_bulk != huge_page_allocate_bulk || size < HT_HUGE_PAGE_SIZE) return;
+
+    const unsigned options = (unsigned) (uintptr_t) allocator->user_data;
+    const size_t length = mapped_bytes(size);
+
+    // mlock() faults the pages in as well. Over RLIMIT_MEMLOCK it fails, the pages stay lazy then
+    if ((options & HT_HUGE_PAGES_LOCK) != 0 && mlock(ptr, length) == 0) return;
+    if ((options & (HT_HUGE_PAGES_PREFAULT | HT_HUGE_PAGES_LOCK)) == 0) return;
+
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(ptr, length, MADV_POPULATE_WRITE) == 0) return;
+#endif
+
+    // Kernels before 5.14 don't populate on request, touch a byte of every page instead
+    const long page_size = sysconf(_SC_PAGESIZE);
+    volatile uint8_t *bytes = (volatile uint8_t *) ptr;
+    for (size_t i = 0; i < length; i += page_size > 0 ? (size_t) page_size : 4096) {
+        bytes[i] = 0;
+    }
+#endif
+}
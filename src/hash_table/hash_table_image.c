@@ -0,0 +1,275 @@
+/**
+ * @file hash_table_image.c
+ * @brief Read-only table images, queried in place from a memory mapping
+ *
+ * Loading a snapshot rebuilds the table entry by entry, which takes seconds for large tables.
+ * An image is laid out as an open-addressing table instead, so opening it only maps the file and
+ * checks the header. Pages are read on demand by the lookups, and processes opening the same image
+ * share its pages through the page cache.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+#ifndef CHASHTABLE_NO_DEBUGMALLOC
+#include "../debugmalloc/debugmalloc.h"
+#endif
+
+/** @brief Header line of an image, doesn't match the "CHashTable v" prefix of hash_table_load() */
+static constexpr char IMAGE_HEADER_LINE[16] = "CHashTable i1.0\n";
+static constexpr uint32_t IMAGE_VERSION = 1;
+/** @brief Written in native byte order, reads differently on a machine of the other byte order */
+static constexpr uint32_t IMAGE_BYTE_ORDER = 0x01020304u;
+/** @brief Smallest slot count of an image */
+static constexpr uint64_t IMAGE_MIN_CAPACITY = 16;
+
+/** @brief Header at the start of an image, the slots follow it */
+typedef struct {
+    char header_line[16];   /**< IMAGE_HEADER_LINE */
+    uint32_t version;       /**< IMAGE_VERSION */
+    uint32_t byte_order;    /**< IMAGE_BYTE_ORDER */
+    uint64_t count;         /**< Number of entries */
+    uint64_t capacity;      /**< Number of slots, a power of two */
+    int32_t empty_key;      /**< Key of the empty slots, not a key of the table */
+    uint8_t reserved[16];   /**< Zero */
+    uint32_t checksum;      /**< CRC-32C of the header up to this field */
+} ImageHeader;
+
+static_assert(sizeof(ImageHeader) == 64, "image header must be 64 bytes");
+
+/** @brief Slot of an image */
+typedef struct {
+    int32_t key;
+    int32_t value;
+} ImageSlot;
+
+struct hash_table_image {
+    const ImageSlot *slots;     /**< Slots, inside the mapping */
+    uint64_t mask;              /**< Capacity minus one */
+    size_t count;               /**< Number of entries */
+    int32_t empty_key;          /**< Key of the empty slots */
+    FileContents file;          /**< Mapping of the file, or its contents read into memory */
+};
+
+/** @brief Number of slots for a count, at most half of them are used so probe sequences stay short */
+static uint64_t image_capacity(size_t count) {
+    uint64_t capacity = IMAGE_MIN_CAPACITY;
+    while (capacity / 2 < count) {
+        capacity *= 2;
+    }
+
+    return capacity;
+}
+
+/** @brief Destination of fill_slot() */
+typedef struct {
+    ImageSlot *slots;
+    uint64_t mask;
+    int32_t empty_key;
+} ImageWriter;
+
+static void fill_slot(int key, int value, void *user_data) {
+    const ImageWriter *writer = (const ImageWriter *) user_data;
+
+    uint64_t i = key_hash(key) & writer->mask;
+    while (writer->slots[i].key != writer->empty_key) {
+        i = (i + 1) & writer->mask;
+    }
+
+    writer->slots[i] = (ImageSlot){.key = key, .value = value};
+}
+
+/**
+ * @brief Lays out the image of a table
+ * @param table Source table
+ * @param image Zeroed memory for the header and `capacity` slots
+ * @param capacity Result of image_capacity() for the count of the table
+ */
+static void fill_image(const HashTable *table, void *image, uint64_t capacity) {
+    ImageHeader *header = (ImageHeader *) image;
+    ImageSlot *slots = (ImageSlot *) (header + 1);
+
+    // The table has fewer keys than there are ints, one of the first count + 1 isn't in it
+    int32_t empty_key = INT32_MIN;
+    while (hash_table_get(table, empty_key) != nullptr) {
+        empty_key++;
+    }
+
+    for (uint64_t i = 0; i < capacity; i++) {
+        slots[i].key = empty_key;
+    }
+
+    ImageWriter writer = {.slots = slots, .mask = capacity - 1, .empty_key = empty_key};
+    hash_table_foreach(table, fill_slot, &writer);
+
+    memcpy(header->header_line, IMAGE_HEADER_LINE, sizeof(header->header_line));
+    header->version = IMAGE_VERSION;
+    header->byte_order = IMAGE_BYTE_ORDER;
+    header->count = table->count;
+    header->capacity = capacity;
+    header->empty_key = empty_key;
+    header->checksum = crc32c(header, offsetof(ImageHeader, checksum));
+}
+
+/** @brief Writes the image to a new file */
+static bool write_image(const HashTable *table, const char *filename, uint64_t capacity, size_t bytes) {
+#ifdef HT_HAVE_MMAP
+    // Laid out in the page cache directly, the table may be too large for a second copy in memory
+    const int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    // Allocated up front, a sparse file would raise SIGBUS on a full disk while being filled
+    if (!file_reserve(fd, 0, bytes)) {
+        close(fd);
+        return false;
+    }
+
+    void *image = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (image == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    fill_image(table, image, capacity);
+
+    // On disk before the rename, a crash mustn't replace the old image with an unwritten one
+    bool success = munmap(image, bytes) == 0;
+    if (fsync(fd) != 0) success = false;
+    if (close(fd) != 0) success = false;
+
+    return success;
+#else
+    void *image = calloc(1, bytes);
+    if (image == nullptr) return false;
+
+    fill_image(table, image, capacity);
+
+    FILE *file = fopen(filename, "wb");
+    bool success = file != nullptr && fwrite(image, 1, bytes, file) == bytes;
+    if (file != nullptr && fclose(file) != 0) success = false;
+
+    free(image);
+
+    return success;
+#endif
+}
+
+bool hash_table_save_image(const HashTable *table, const char *filename) {
+    if (table == nullptr) return false;
+    if (strlen(filename) == 0) return false;
+
+    trace_save_start(table, filename);
+
+    background_resize_wait(table);
+
+    const uint64_t capacity = image_capacity(table->count);
+    const size_t bytes = sizeof(ImageHeader) + capacity * sizeof(ImageSlot);
+
+    // Written next to the image and renamed over it, processes using the old image keep their mapping intact
+    const size_t name_length = strlen(filename) + sizeof(".tmp");
+    char *temporary = (char *) malloc(name_length);
+    bool success = temporary != nullptr;
+
+    if (success) {
+        snprintf(temporary, name_length, "%s.tmp", filename);
+        success = write_image(table, temporary, capacity, bytes);
+        if (success && rename(temporary, filename) != 0) success = false;
+        if (!success) remove(temporary);
+    }
+
+    free(temporary);
+
+    trace_save_end(table, filename, success ? bytes : 0, success);
+
+    return success;
+}
+
+/** @brief Checks the header against the size of the file */
+static HashTable_LoadError check_image(const void *data, size_t bytes) {
+    const ImageHeader *header = (const ImageHeader *) data;
+
+    if (bytes == 0) return HT_LOAD_ERROR_EMPTY;
+    if (bytes < sizeof(header->header_line) ||
+        memcmp(header->header_line, IMAGE_HEADER_LINE, sizeof(header->header_line)) != 0) {
+        return HT_LOAD_ERROR_INVALID_HEADER;
+    }
+    if (bytes < sizeof(ImageHeader)) return HT_LOAD_ERROR_MISSING_COUNT;
+    if (header->checksum != crc32c(header, offsetof(ImageHeader, checksum))) return HT_LOAD_ERROR_CHECKSUM;
+    if (header->version != IMAGE_VERSION || header->byte_order != IMAGE_BYTE_ORDER) {
+        return HT_LOAD_ERROR_INVALID_HEADER;
+    }
+
+    const uint64_t capacity = header->capacity;
+    if (capacity < IMAGE_MIN_CAPACITY || (capacity & (capacity - 1)) != 0 || header->count > capacity / 2 ||
+        capacity > (SIZE_MAX - sizeof(ImageHeader)) / sizeof(ImageSlot)) {
+        return HT_LOAD_ERROR_MALFORMED_COUNT;
+    }
+
+    const size_t expected = sizeof(ImageHeader) + (size_t) capacity * sizeof(ImageSlot);
+    if (bytes < expected) return HT_LOAD_ERROR_PREMATURE_EOF;
+    if (bytes > expected) return HT_LOAD_ERROR_MALFORMED_LINE;
+
+    return HT_LOAD_OK;
+}
+
+HashTable_LoadError hash_table_open_image(const char *filename, HashTableImage **out_image) {
+    *out_image = nullptr;
+
+    HashTableImage *image = (HashTableImage *) malloc(sizeof(HashTableImage));
+    if (image == nullptr) return HT_LOAD_ERROR_ALLOC_FAILED;
+    *image = (HashTableImage){.slots = nullptr, .mask = 0, .count = 0, .empty_key = 0};
+
+    // Lookups touch single slots, reading ahead would only evict other pages
+    HashTable_LoadError error_code = file_contents_open(filename, FILE_ACCESS_RANDOM, &image->file);
+    if (error_code == HT_LOAD_OK) error_code = check_image(image->file.data, image->file.bytes);
+
+    if (error_code != HT_LOAD_OK) {
+        hash_table_close_image(image);
+        return error_code;
+    }
+
+    const ImageHeader *header = (const ImageHeader *) image->file.data;
+    image->slots = (const ImageSlot *) (header + 1);
+    image->mask = header->capacity - 1;
+    image->count = (size_t) header->count;
+    image->empty_key = header->empty_key;
+
+    *out_image = image;
+
+    return HT_LOAD_OK;
+}
+
+bool hash_table_image_get(const HashTableImage *image, int key, int *out_value) {
+    if (image == nullptr || key == image->empty_key) return false;
+
+    // Bounded by the capacity, the slots aren't checksummed and a damaged image may have no empty slot
+    uint64_t i = key_hash(key) & image->mask;
+    for (uint64_t probes = 0; probes <= image->mask; probes++) {
+        const ImageSlot slot = image->slots[i];
+        if (slot.key == key) {
+            if (out_value != nullptr) *out_value = slot.value;
+            return true;
+        }
+        if (slot.key == image->empty_key) return false;
+
+        i = (i + 1) & image->mask;
+    }
+
+    return false;
+}
+
+size_t hash_table_image_count(const HashTableImage *image) {
+    if (image == nullptr) return 0;
+    return image->count;
+}
+
+void hash_table_close_image(HashTableImage *image) {
+    if (image == nullptr) return;
+
+    file_contents_close(&image->file);
+    free(image);
+}
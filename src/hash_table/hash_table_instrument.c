@@ -0,0 +1,216 @@
+/**
+ * @file hash_table_instrument.c
+ * @brief Opt-in operation counters and latency histograms
+ *
+ * Compiled in with CHASHTABLE_INSTRUMENT, otherwise the hooks in the hot paths expand to nothing
+ * and the API reports that instrumentation is unavailable.
+ *
+ * Every thread counts into its own block, so the hot paths never share a cache line.
+ * Blocks are registered in a global list on first use, which snapshots walk to aggregate them.
+ * When a thread exits, its counts are folded into the retired totals and its block is freed.
+ * Resetting doesn't touch the blocks of other threads, it records the current totals as a
+ * baseline that later snapshots subtract.
+ *
+ * Latencies go into log-linear histograms like HdrHistogram: values below 8 ns have their own
+ * bucket, above that every power of two is split into 8 buckets, a relative error of 12.5%.
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+
+/** @brief Sub-buckets per power of two, as a bit count */
+static constexpr int SUB_BUCKET_BITS = 3;
+/** @brief Sub-buckets per power of two */
+static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+size_t hash_table_latency_bucket(uint64_t ns) {
+    if (ns < SUB_BUCKETS) return (size_t) ns;
+
+    const int exponent = 63 - __builtin_clzll(ns);
+    const uint64_t sub_bucket = (ns >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+
+    return (size_t) (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub_bucket;
+}
+
+uint64_t hash_table_latency_bucket_value(size_t bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+
+    const int exponent = (int) (bucket / SUB_BUCKETS) + SUB_BUCKET_BITS - 1;
+    const uint64_t sub_bucket = bucket % SUB_BUCKETS;
+
+    return (SUB_BUCKETS + sub_bucket) << (exponent - SUB_BUCKET_BITS);
+}
+
+uint64_t hash_table_latency_percentile(const HashTableInstrumentation *snapshot, HashTableOp op, double percentile) {
+    if (snapshot == nullptr || op >= HT_OP_COUNT) return 0;
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < HT_LATENCY_BUCKETS; i++) {
+        total += snapshot->latency[op][i];
+    }
+    if (total == 0) return 0;
+
+    // Rank of the requested sample, rounded up, at least the first one
+    uint64_t rank = (uint64_t) ((percentile / 100.0) * (double) total + 0.999999);
+    if (rank == 0) rank = 1;
+    if (rank > total) rank = total;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HT_LATENCY_BUCKETS; i++) {
+        seen += snapshot->latency[op][i];
+        if (seen >= rank) return hash_table_latency_bucket_value(i);
+    }
+
+    return hash_table_latency_bucket_value(HT_LATENCY_BUCKETS - 1);
+}
+
+#ifdef CHASHTABLE_INSTRUMENT
+
+/** @brief Counts of a single thread, only written by that thread */
+struct instrument_block {
+    _Atomic uint64_t counters[HT_COUNTER_COUNT];
+    _Atomic uint64_t latency[HT_OP_COUNT][HT_LATENCY_BUCKETS];
+    struct instrument_block *prev;  /**< Previous registered block */
+    struct instrument_block *next;  /**< Next registered block */
+};
+
+/** @brief Registered blocks and totals, protected by `lock` */
+static struct {
+    mtx_t lock;
+    tss_t key;                              /**< Destructor of the thread's block */
+    bool ready;                             /**< The lock and the key were created */
+    struct instrument_block *blocks;        /**< Blocks of the running threads */
+    HashTableInstrumentation retired;       /**< Counts of the exited threads */
+    HashTableInstrumentation baseline;      /**< Totals at the last reset */
+} instrument;
+
+static once_flag instrument_once = ONCE_FLAG_INIT;
+static thread_local struct instrument_block *local_block = nullptr;
+
+/** @brief Adds a block to an aggregate */
+static void add_block(HashTableInstrumentation *total, struct instrument_block *block) {
+    for (size_t i = 0; i < HT_COUNTER_COUNT; i++) {
+        total->counters[i] += atomic_load_explicit(&block->counters[i], memory_order_relaxed);
+    }
+
+    for (size_t op = 0; op < HT_OP_COUNT; op++) {
+        for (size_t i = 0; i < HT_LATENCY_BUCKETS; i++) {
+            total->latency[op][i] += atomic_load_explicit(&block->latency[op][i], memory_order_relaxed);
+        }
+    }
+}
+
+static void retire_block(void *arg) {
+    struct instrument_block *block = (struct instrument_block *) arg;
+
+    mtx_lock(&instrument.lock);
+
+    add_block(&instrument.retired, block);
+    if (block->prev != nullptr) block->prev->next = block->next;
+    else instrument.blocks = block->next;
+    if (block->next != nullptr) block->next->prev = block->prev;
+
+    mtx_unlock(&instrument.lock);
+
+    free(block);
+}
+
+static void init_instrument(void) {
+    if (mtx_init(&instrument.lock, mtx_plain) != thrd_success) return;
+    if (tss_create(&instrument.key, retire_block) != thrd_success) return;
+    instrument.ready = true;
+}
+
+/** @brief Block of the calling thread, registered on first use. nullptr if it couldn't be created */
+static struct instrument_block *thread_block(void) {
+    if (local_block != nullptr) return local_block;
+
+    call_once(&instrument_once, init_instrument);
+    if (!instrument.ready) return nullptr;
+
+    struct instrument_block *block = (struct instrument_block *) calloc(1, sizeof(struct instrument_block));
+    if (block == nullptr) return nullptr;
+
+    mtx_lock(&instrument.lock);
+    block->next = instrument.blocks;
+    if (instrument.blocks != nullptr) instrument.blocks->prev = block;
+    instrument.blocks = block;
+    mtx_unlock(&instrument.lock);
+
+    tss_set(instrument.key, block);
+    local_block = block;
+
+    return block;
+}
+
+/** @brief Increments a counter only written by the calling thread, a plain load and store */
+static void bump(_Atomic uint64_t *counter, uint64_t amount) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+void instrument_count(HashTableCounter counter, uint64_t amount) {
+    struct instrument_block *block = thread_block();
+    if (block != nullptr) bump(&block->counters[counter], amount);
+}
+
+void instrument_latency(HashTableOp op, uint64_t ns) {
+    struct instrument_block *block = thread_block();
+    if (block != nullptr) bump(&block->latency[op][hash_table_latency_bucket(ns)], 1);
+}
+
+/** @brief Sums the retired totals and every registered block, the lock must be held */
+static void aggregate(HashTableInstrumentation *total) {
+    *total = instrument.retired;
+    for (struct instrument_block *block = instrument.blocks; block != nullptr; block = block->next) {
+        add_block(total, block);
+    }
+}
+
+bool hash_table_instrumentation_snapshot(HashTableInstrumentation *snapshot) {
+    if (snapshot == nullptr) return false;
+
+    call_once(&instrument_once, init_instrument);
+    if (!instrument.ready) return false;
+
+    mtx_lock(&instrument.lock);
+    aggregate(snapshot);
+
+    for (size_t i = 0; i < HT_COUNTER_COUNT; i++) {
+        snapshot->counters[i] -= instrument.baseline.counters[i];
+    }
+    for (size_t op = 0; op < HT_OP_COUNT; op++) {
+        for (size_t i = 0; i < HT_LATENCY_BUCKETS; i++) {
+            snapshot->latency[op][i] -= instrument.baseline.latency[op][i];
+        }
+    }
+
+    mtx_unlock(&instrument.lock);
+
+    return true;
+}
+
+void hash_table_instrumentation_reset(void) {
+    call_once(&instrument_once, init_instrument);
+    if (!instrument.ready) return;
+
+    mtx_lock(&instrument.lock);
+    aggregate(&instrument.baseline);
+    mtx_unlock(&instrument.lock);
+}
+
+#else
+
+bool hash_table_instrumentation_snapshot(HashTableInstrumentation *snapshot) {
+    if (snapshot != nullptr) memset(snapshot, 0, sizeof(HashTableInstrumentation));
+    return false;
+}
+
+void hash_table_instrumentation_reset(void) {
+}
+
+#endif
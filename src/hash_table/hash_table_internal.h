@@ -6,13 +6,48 @@
 #ifndef CHASHTABLE_HASH_TABLE_INTERNAL_H
 #define CHASHTABLE_HASH_TABLE_INTERNAL_H
 
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "hash_table.h"
 
+#if defined(__has_include)
+#if __has_include(<sys/mman.h>) && __has_include(<sys/stat.h>) && __has_include(<fcntl.h>) && __has_include(<unistd.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+/** @brief POSIX file mappings are available, the file formats are mapped instead of read */
+#define HT_HAVE_MMAP
+#endif
+#endif
+
 /** @brief Initial hash table size, always a prime number */
 constexpr size_t HT_INITIAL_SIZE = 53;
 /** @brief The hash table grows if the count/size ratio exceeds this threshold */
 constexpr double HT_LOAD_THRESHOLD = 0.75;
+/** @brief Default entry count from which resizing is split across multiple threads */
+constexpr size_t HT_PARALLEL_RESIZE_MIN_COUNT = 1 << 20;
+/** @brief Default number of threads used by a parallel resize */
+constexpr size_t HT_PARALLEL_RESIZE_THREADS = 4;
+/** @brief Upper limit for the number of parallel resize threads */
+constexpr size_t HT_PARALLEL_RESIZE_MAX_THREADS = 64;
+/** @brief Bucket count of a single radix partition, 256 KiB of bucket pointers stays cache resident */
+constexpr size_t HT_RADIX_PARTITION_BUCKETS = 32768;
+/** @brief Old buckets migrated by the background resize thread per lock acquisition */
+constexpr size_t HT_BACKGROUND_RESIZE_BATCH = 256;
+/** @brief Buckets per copy-on-write chunk, a write to a shared chunk duplicates this many chains */
+constexpr size_t HT_COW_CHUNK_BUCKETS = 64;
+
+/**
+ * @brief Strategies used by hash_table_resize() to relink the entries
+ */
+typedef enum {
+    HT_REHASH_AUTO,     /**< Serial or parallel based on the entry count, the default */
+    HT_REHASH_SERIAL,   /**< Relink chain by chain on the calling thread, rehash_range() */
+    HT_REHASH_PARALLEL, /**< Relink bucket ranges on multiple threads, rehash_parallel() */
+    HT_REHASH_RADIX     /**< Partition entries by new bucket before relinking, rehash_radix() */
+} RehashStrategy;
 
 /**
  * @biref Internal implementation of the hash table
@@ -23,6 +58,18 @@ struct hash_table {
     size_t size;                    /**< Table size. Always a prime number */
     size_t count;                   /**< Item count */
     size_t load_threshold_count;    /**< If the count exceeds this threshold, the table size will be increased */
+    uint64_t fingerprint;           /**< Sum of entry_fingerprint() over all entries, see hash_table_equal() */
+    uint64_t *merkle;               /**< Merkle summary of the fingerprint, nullptr unless enabled */
+    size_t parallel_resize_min_count; /**< Resizes of tables with at least this many entries run multithreaded */
+    size_t resize_threads;          /**< Thread count of a parallel resize, 1 means single-threaded */
+    RehashStrategy rehash_strategy; /**< Forces a rehash strategy, used for benchmarking */
+    size_t resize_count;            /**< Completed resizes since creation */
+    uint64_t resize_last_ns;        /**< Duration of the last completed resize */
+    uint64_t resize_total_ns;       /**< Total duration of all completed resizes */
+    struct background_resize *background; /**< Maintenance thread state, nullptr if resizes run inline */
+    struct cow_chunk **chunks;      /**< Reference counts of the chunks shared with copies, nullptr if nothing was shared */
+    struct node_block *nodes;       /**< Block holding the entries of a clone or a parallel load, nullptr for other tables */
+    struct table_memory *memory;    /**< Allocator of the contents, shared with copies */
 };
 
 /**
@@ -43,27 +90,141 @@ size_t calc_load_threshold_count(size_t size);
  */
 HashTable *hash_table_create_with_size(size_t size);
 
+/**
+ * @brief Creates a new empty table with a set size, whose contents use a memory domain
+ * @param size Table size
+ * @param memory Memory domain, the table takes over the caller's reference, even on failure
+ * @return Pointer to a dynamically allocated HashTable object, nullptr if the allocation failed
+ */
+HashTable *create_table(size_t size, struct table_memory *memory);
+
 /**
  * @brief Creates a dynamically allocated bucket array with a set size
+ * @param memory Memory domain of the table
  * @param size Table size
  * @return Pointer to the bucket array
  */
-Entry **create_buckets(size_t size);
+Entry **create_buckets(struct table_memory *memory, size_t size);
+
+/** @brief Frees a bucket array created by create_buckets() */
+void free_buckets(struct table_memory *memory, Entry **buckets, size_t size);
 
 /**
- * @brief Frees all entries inside a bucket array
- * @param buckets Bucket array
- * @param size Size of the bucket array
+ * @brief Creates a memory domain: an allocator and the count of the bytes live in it
+ *
+ * A table and its copies share a domain, since they share entries that any of them may free.
+ *
+ * @param allocator Allocator to use, copied. nullptr uses malloc and free
+ * @return The domain with a single reference, nullptr if the allocation failed or the allocator is invalid
  */
-void clear_buckets(Entry **buckets, size_t size);
+struct table_memory *table_memory_create(const HashTableAllocator *allocator);
+
+/** @brief Adds a reference to a memory domain */
+void table_memory_retain(struct table_memory *memory);
+
+/** @brief Drops a reference to a memory domain, freeing it with the last one. Accepts nullptr */
+void table_memory_release(struct table_memory *memory);
+
+/** @brief Copies the allocator of a memory domain */
+HashTableAllocator table_memory_allocator(const struct table_memory *memory);
+
+/** @brief Bytes live in a memory domain */
+size_t table_memory_live_bytes(const struct table_memory *memory);
+
+/**
+ * @brief Allocates a block from a memory domain
+ * @param memory Memory domain
+ * @param size Bytes to allocate
+ * @return The block, nullptr on failure
+ */
+void *memory_alloc(struct table_memory *memory, size_t size);
+
+/** @brief Frees a block allocated by memory_alloc(). Accepts nullptr */
+void memory_free(struct table_memory *memory, void *ptr, size_t size);
+
+/** @brief Allocates a large block from a memory domain, with the bulk functions of the allocator if it has them */
+void *memory_alloc_bulk(struct table_memory *memory, size_t size);
+
+/** @brief Frees a block allocated by memory_alloc_bulk(). Accepts nullptr */
+void memory_free_bulk(struct table_memory *memory, void *ptr, size_t size);
+
+/** @brief Checks if the bulk blocks of a memory domain are zeroed by its allocator */
+bool memory_bulk_zeroed(const struct table_memory *memory);
+
+/**
+ * @brief Faults in or locks a fresh bulk block, as configured by hash_table_huge_page_allocator()
+ *
+ * O(size) if it does anything, so tables with background resizing call it without the lock held.
+ * No-op for other allocators.
+ *
+ * @param memory Memory domain the block was allocated from
+ * @param ptr Block returned by memory_alloc_bulk(), not written yet
+ * @param size Size of the block
+ */
+void memory_prefault(const struct table_memory *memory, void *ptr, size_t size);
+
+/** @brief memory_prefault() for an allocator, no-op unless it was returned by hash_table_huge_page_allocator() */
+void huge_page_prefault(const HashTableAllocator *allocator, void *ptr, size_t size);
+
+/**
+ * @brief Frees all entries inside the bucket array of a table
+ *
+ * The buckets are set to nullptr, the array itself is kept.
+ *
+ * @param table Pointer to HashTable object
+ */
+void clear_buckets(HashTable *table);
+
+/**
+ * @brief Frees an entry of a table
+ *
+ * Entries inside the node block of a clone only release their reference to the block,
+ * every other entry is freed directly.
+ *
+ * @param table Table the entry was removed from
+ * @param entry Entry to free
+ */
+void entry_free(const HashTable *table, Entry *entry);
+
+/** @brief Checks if an entry is stored in the node block of a clone */
+bool entry_in_block(const HashTable *table, const Entry *entry);
+
+/** @brief Bytes of the node block of a table, 0 if it has none */
+size_t node_block_bytes(const HashTable *table);
+
+/**
+ * @brief Allocates a node block for up to `capacity` entries, filled by the caller
+ *
+ * The block only holds the reference of its table. Once entries of it are linked into the table,
+ * count them with node_block_add_entries(), before anything may free them.
+ *
+ * @param memory Memory domain of the table
+ * @param capacity Number of entries
+ * @return The block, nullptr if the allocation failed
+ */
+struct node_block *node_block_create(struct table_memory *memory, size_t capacity);
+
+/** @brief Entries of a node block */
+Entry *node_block_entries(struct node_block *block);
+
+/** @brief Counts `used` entries of a node block as live, each one is released by entry_free() */
+void node_block_add_entries(struct node_block *block, size_t used);
+
+/** @brief Adds a reference to a node block, for a table sharing its entries. Accepts nullptr */
+void node_block_retain(struct node_block *block);
+
+/** @brief Drops a reference to a node block, freeing it with the last one. Accepts nullptr */
+void node_block_release(struct table_memory *memory, struct node_block *block);
 
 /**
  * @brief Resizes the HashTable
  *
  * Steps:
+ * -# Duplicate the entries still shared with a copy, see cow_unshare()
  * -# Calculate new bucket array size. It is the next prime after the double of the current size, found using next_prime()
  * -# Create new buckets and swap out the old one
- * -# Rehash all entries into new buckets using hash_table_insert()
+ * -# Relink all entries into the new buckets. No entries are allocated or freed.
+ *    Large tables are relinked by multiple threads, see rehash_parallel()
  * -# Free old bucket
  *
  * @param table Pointer to HashTable object
@@ -71,16 +232,450 @@ void clear_buckets(Entry **buckets, size_t size);
 void hash_table_resize(HashTable *table);
 
 /**
- * @brief Hash function using division method
+ * @brief Resizes the HashTable to a given size
+ *
+ * Works like hash_table_resize(), which calls it with the next prime after the double of the current size.
+ * The new size may also be smaller than the current one.
+ *
+ * @param table Pointer to HashTable object
+ * @param new_size New table size, a prime number
+ */
+void hash_table_resize_to(HashTable *table, size_t new_size);
+
+/**
+ * @brief Grows the table once, so it can hold `count` entries without crossing the load threshold
+ *
+ * Does nothing if the table is large enough already.
+ *
+ * @param table Pointer to HashTable object
+ * @param count Number of entries the table should hold
+ */
+void hash_table_reserve(HashTable *table, size_t count);
+
+/**
+ * @brief Shrinks a table that is less than a quarter as loaded as the load threshold
+ *
+ * The new size leaves the table half as loaded as the threshold, and is at least HT_INITIAL_SIZE.
+ *
+ * @param table Pointer to HashTable object
+ */
+void hash_table_shrink_to_fit(HashTable *table);
+
+/**
+ * @brief Relinks the entries of a bucket range into a new bucket array
+ *
+ * Every entry is moved to the head of its new bucket, no entries are allocated or freed.
+ * The relinked old buckets are set to nullptr.
+ *
+ * @param old_buckets Old bucket array
+ * @param first First old bucket to relink
+ * @param last One past the last old bucket to relink
+ * @param new_buckets New bucket array
+ * @param new_size Size of the new bucket array
+ */
+void rehash_range(Entry **old_buckets, size_t first, size_t last, Entry **new_buckets, size_t new_size);
+
+/**
+ * @brief Relinks all entries into a new bucket array using multiple threads
+ *
+ * The old bucket array is split into `thread_count` equal ranges, one per thread.
+ * Since ranges relink into the same new array, entries are pushed with an atomic compare-and-swap.
+ * The calling thread takes the first range, and any range whose thread can't be started.
+ *
+ * @param old_buckets Old bucket array
+ * @param old_size Size of the old bucket array
+ * @param new_buckets New bucket array
+ * @param new_size Size of the new bucket array
+ * @param thread_count Number of threads to use
+ */
+void rehash_parallel(Entry **old_buckets, size_t old_size, Entry **new_buckets, size_t new_size, size_t thread_count);
+
+/**
+ * @brief Relinks all entries into a new bucket array in cache-sized partitions
+ *
+ * Relinking chain by chain writes the new bucket array in random order, which makes almost
+ * every relink a cache and TLB miss once the array is larger than the CPU cache.
+ * Instead, the entries are first scattered into partitions of HT_RADIX_PARTITION_BUCKETS
+ * consecutive new buckets, then each partition is linked while its slice of the array is cached.
+ *
+ * @param old_buckets Old bucket array
+ * @param old_size Size of the old bucket array
+ * @param new_buckets New bucket array
+ * @param new_size Size of the new bucket array
+ * @param count Number of entries in the old bucket array
+ * @param memory Memory domain the scratch buffers are allocated from
+ * @return false if the scratch buffers couldn't be allocated, nothing is relinked in that case
+ */
+bool rehash_radix(
+    Entry **old_buckets,
+    size_t old_size,
+    Entry **new_buckets,
+    size_t new_size,
+    size_t count,
+    struct table_memory *memory
+);
+
+/**
+ * @brief hash_table_insert() for tables with background resizing enabled
+ *
+ * While a migration runs, keys whose old bucket has been migrated live in the new bucket array,
+ * every other key still lives in the old one. All single key operations are serialized by the table lock.
+ */
+bool background_resize_insert(HashTable *table, int key, int value);
+
+/** @brief hash_table_get() for tables with background resizing enabled */
+const Entry *background_resize_get(const HashTable *table, int key);
+
+/** @brief hash_table_delete() for tables with background resizing enabled */
+bool background_resize_delete(HashTable *table, int key);
+
+/**
+ * @brief Waits until the table has no pending or running background resize
+ *
+ * Operations walking the whole bucket array call this first, so they only see a single array.
+ * Returns immediately for tables without background resizing.
+ *
+ * @param table Pointer to HashTable object
+ */
+void background_resize_wait(const HashTable *table);
+
+/**
+ * @brief Locks the table once it has no pending or running background resize
+ *
+ * Like background_resize_wait(), but the lock is kept, so no migration can start until
+ * background_resize_unlock(). No-op for tables without background resizing.
+ *
+ * @param table Pointer to HashTable object
+ */
+void background_resize_lock_idle(const HashTable *table);
+
+/**
+ * @brief Pauses or resumes a running migration between two batches
+ *
+ * Exposed for testing, so operations can be checked while entries are split between two arrays.
+ *
+ * @param table Table with background resizing enabled
+ * @param paused true to pause, false to resume
+ */
+void background_resize_pause(HashTable *table, bool paused);
+
+/** @brief Locks the table of a table with background resizing, no-op for other tables */
+void background_resize_lock(const HashTable *table);
+
+/** @brief Unlocks a table locked by background_resize_lock() */
+void background_resize_unlock(const HashTable *table);
+
+/**
+ * @brief hash_table_chain_at() for tables with background resizing enabled
+ *
+ * During a migration, a position whose old bucket was migrated is looked up in the new array,
+ * and the returned range never extends past the positions of the unmigrated old buckets.
+ */
+const Entry *background_resize_chain_at(const HashTable *table, uint32_t position, uint64_t *range_end);
+
+/** @brief Bytes of the maintenance thread state, including the array being filled by a migration */
+size_t background_resize_bytes(const HashTable *table);
+
+/**
+ * @brief Finishes the running migration, stops the maintenance thread and frees its state
+ * @param table Table with background resizing enabled
+ */
+void background_resize_stop(HashTable *table);
+
+/**
+ * @brief Makes the entries of a bucket range private to the table before modifying them
+ *
+ * Chunks overlapping `[first, last)` that are still shared with a copy get their entries
+ * duplicated. No-op for tables that share nothing.
+ *
+ * @param table Pointer to HashTable object
+ * @param first First bucket of the range
+ * @param last One past the last bucket of the range
+ * @return false if the entries couldn't be duplicated
+ */
+bool cow_own_range(HashTable *table, size_t first, size_t last);
+
+/**
+ * @brief Makes every entry private to the table and drops its reference counts
+ *
+ * Called before the entries are relinked into a new bucket array, since chunks only
+ * exist for the current bucket array.
+ *
+ * @param table Pointer to HashTable object
+ * @return false if the entries couldn't be duplicated, the table is left shared in that case
+ */
+bool cow_unshare(HashTable *table);
+
+/** @brief Bytes of the copy-on-write reference counts of a table, 0 if it shares nothing */
+size_t cow_bytes(const HashTable *table);
+
+/**
+ * @brief Frees the entries of the table that aren't shared with a copy anymore
+ *
+ * Shared chunks only lose a reference. All buckets are set to nullptr.
+ *
+ * @param table Pointer to HashTable object
+ */
+void cow_release(HashTable *table);
+
+/**
+ * @brief Reads a monotonic clock
+ * @return Nanoseconds since an unspecified starting point
+ */
+uint64_t monotonic_ns(void);
+
+/**
+ * @brief Index of the latency histogram bucket counting a value
+ * @param ns Latency in nanoseconds
+ * @return Bucket index, less than HT_LATENCY_BUCKETS
+ */
+size_t hash_table_latency_bucket(uint64_t ns);
+
+#ifdef CHASHTABLE_INSTRUMENT
+
+/** @brief Adds to a counter of the calling thread */
+void instrument_count(HashTableCounter counter, uint64_t amount);
+
+/** @brief Records an operation latency of the calling thread */
+void instrument_latency(HashTableOp op, uint64_t ns);
+
+#define INSTRUMENT_COUNT(counter, amount) instrument_count((counter), (amount))
+#define INSTRUMENT_LATENCY(op, ns) instrument_latency((op), (ns))
+
+#else
+
+// Compiled out, the arguments aren't evaluated
+#define INSTRUMENT_COUNT(counter, amount) ((void) 0)
+#define INSTRUMENT_LATENCY(op, ns) ((void) 0)
+
+#endif
+
+/** @brief Slowlog threshold, defined in hash_table_slowlog.c */
+extern _Atomic uint64_t slowlog_threshold_ns;
+
+/**
+ * @brief Checks if the public operations have to be timed
+ *
+ * A single relaxed load while the slowlog is disabled, always true with instrumentation compiled in.
+ */
+static inline bool op_timing_enabled(void) {
+#ifdef CHASHTABLE_INSTRUMENT
+    return true;
+#else
+    return atomic_load_explicit(&slowlog_threshold_ns, memory_order_relaxed) != HT_SLOWLOG_DISABLED;
+#endif
+}
+
+/** @brief Start of a timed operation, see op_timer_start() */
+typedef struct {
+    uint64_t start_ns;      /**< monotonic_ns() at the start */
+    size_t resize_count;    /**< Completed inline resizes of the table at the start */
+} OpTimer;
+
+/**
+ * @brief Starts timing an operation
+ * @param table Table of the operation, may be nullptr
+ */
+OpTimer op_timer_start(const HashTable *table);
+
+/**
+ * @brief Stops timing an operation and records it, see op_record()
+ * @param timer Timer returned by op_timer_start()
+ * @param op Operation
+ * @param table Table of the operation, may be nullptr
+ * @param key Key of an insert, get or delete
+ */
+void op_timer_stop(const OpTimer *timer, HashTableOp op, const HashTable *table, int key);
+
+/**
+ * @brief Records the latency of an operation into the instrumentation and the slowlog
+ *
+ * The slowlog entry locks tables with background resizing, except for HT_OP_RESIZE,
+ * which is recorded by the thread resizing the table.
+ *
+ * @param op Operation
+ * @param table Table of the operation, may be nullptr
+ * @param key Key of an insert, get or delete
+ * @param elapsed_ns Duration of the operation
+ * @param resized The operation resized the table
+ */
+void op_record(HashTableOp op, const HashTable *table, int key, uint64_t elapsed_ns, bool resized);
+
+/** @brief Fires the resize start tracepoint, before the table is modified */
+void trace_resize_start(const HashTable *table, size_t new_size);
+
+/** @brief Fires the resize end tracepoint, after the new bucket array is in place */
+void trace_resize_end(const HashTable *table, size_t old_size, uint64_t duration_ns);
+
+/** @brief Fires the save start tracepoint */
+void trace_save_start(const HashTable *table, const char *filename);
+
+/** @brief Fires the save end tracepoint */
+void trace_save_end(const HashTable *table, const char *filename, size_t bytes, bool success);
+
+/** @brief Fires the load start tracepoint */
+void trace_load_start(const char *filename);
+
+/** @brief Fires the load end tracepoint, table is nullptr if the load failed */
+void trace_load_end(const HashTable *table, const char *filename, size_t bytes);
+
+/** @brief Fires the long chain tracepoint */
+void trace_long_chain(const HashTable *table, int key, size_t chain_length);
+
+/**
+ * @brief Reports the entries compared by a single key operation
  *
- * The hash is `hash = key % table_size`. The hash is always positive.
+ * Feeds the instrumentation, and fires the long chain tracepoint for chains of at least HT_TRACE_LONG_CHAIN_LENGTH.
+ *
+ * @param table Table of the operation
+ * @param key Key of the operation
+ * @param length Compared entries
+ */
+static inline void chain_walked(const HashTable *table, int key, size_t length) {
+    INSTRUMENT_COUNT(HT_COUNTER_NODES_TRAVERSED, length);
+    if (length >= HT_TRACE_LONG_CHAIN_LENGTH) trace_long_chain(table, key, length);
+}
+
+/**
+ * @brief Adds a change of an entry to the table fingerprint, and to the Merkle summary if enabled
+ * @param table Pointer to HashTable object
+ * @param key Key of the changed entry
+ * @param delta Change of the fingerprint term, modulo 2^64
+ */
+void fingerprint_add(HashTable *table, int key, uint64_t delta);
+
+/**
+ * @brief Copies the Merkle summary of a table
+ * @param table Pointer to HashTable object
+ * @param memory Memory domain of the table receiving the copy
+ * @return Copy of the summary, nullptr if the table has none or the allocation failed
+ */
+uint64_t *merkle_duplicate(const HashTable *table, struct table_memory *memory);
+
+/** @brief Bytes of the Merkle summary of a table, 0 if it has none */
+size_t merkle_bytes(const HashTable *table);
+
+/** @brief Zeroes the Merkle summary of an emptied table, if any */
+void merkle_reset(HashTable *table);
+
+/** @brief Frees the Merkle summary of a table, if any */
+void merkle_free(HashTable *table);
+
+/**
+ * @brief Mixes a key into its 32-bit hash position
+ *
+ * Uses the MurmurHash3 finalizer, which is a bijection, so every key has a distinct position.
+ * The position decides the bucket in every table size, and the order of hash_table_scan().
+ *
+ * @param key Key to mix
+ * @return Hash position of the key
+ */
+uint32_t key_hash(int key);
+
+/**
+ * @brief Mixes a key-value pair into the term it adds to the table fingerprint
+ *
+ * The table fingerprint is the sum of this over all entries, modulo 2^64. A sum doesn't depend
+ * on the insertion order or the table size, and is updated in O(1) when an entry changes.
+ *
+ * @param key Key of the entry
+ * @param value Value of the entry
+ * @return Fingerprint term of the entry
+ */
+uint64_t entry_fingerprint(int key, int value);
+
+/**
+ * @brief Hash function using the multiply-shift range reduction
+ *
+ * The hash is `hash = key_hash(key) * table_size / 2^32`. Unlike the division method,
+ * the bucket index grows with the hash position, so every bucket holds a contiguous range of
+ * positions in any table size, see hash_range_start().
  *
  * @param key Key to hash
- * @param table_size Hash table size
+ * @param table_size Hash table size, less than 2^32
  * @return Hashed key
  */
 size_t hash_function(int key, size_t table_size);
 
+/**
+ * @brief First hash position mapped to a bucket
+ *
+ * Bucket `bucket` holds the keys whose hash position is in
+ * `[hash_range_start(bucket, size), hash_range_start(bucket + 1, size))`.
+ *
+ * @param bucket Bucket index, may be equal to table_size
+ * @param table_size Hash table size
+ * @return Smallest hash position mapped to the bucket, 2^32 if bucket == table_size
+ */
+uint64_t hash_range_start(size_t bucket, size_t table_size);
+
+/**
+ * @brief Finds the chain holding a hash position
+ *
+ * For tables with background resizing, the lock must be held with background_resize_lock().
+ *
+ * @param table Pointer to HashTable object
+ * @param position Hash position
+ * @param range_end Set to the end of the position range stored in the returned chain.
+ *                  The chain may also hold entries outside of `[position, range_end)`
+ * @return Head of the chain
+ */
+const Entry *hash_table_chain_at(const HashTable *table, uint32_t position, uint64_t *range_end);
+
+/**
+ * @brief CRC-32C (Castagnoli) checksum, as used by iSCSI and ext4
+ *
+ * Uses the SSE 4.2 crc32 instruction if the CPU has it, a lookup table otherwise.
+ *
+ * @param data Bytes to checksum
+ * @param length Number of bytes
+ * @return Checksum, 0xe3069283 for the ASCII string "123456789"
+ */
+uint32_t crc32c(const void *data, size_t length);
+
+/** @brief Expected access pattern of a file opened by file_contents_open() */
+typedef enum {
+    FILE_ACCESS_SEQUENTIAL, /**< Read once from start to end, like a snapshot being loaded */
+    FILE_ACCESS_RANDOM      /**< Scattered reads, like lookups in an image */
+} FileAccess;
+
+/** @brief Contents of a whole file, see file_contents_open() */
+typedef struct {
+    const void *data;       /**< Contents, nullptr for an empty file */
+    size_t bytes;           /**< Size of the file */
+    bool mapped;            /**< `data` is a read-only mapping, not a copy in memory */
+} FileContents;
+
+/**
+ * @brief Maps a whole file read-only, or reads it into memory without mmap
+ *
+ * @param filename File to open
+ * @param access Expected access pattern, passed to the kernel as a readahead hint
+ * @param contents Filled with the contents, release them with file_contents_close()
+ * @return HT_LOAD_OK, HT_LOAD_ERROR_FILE_OPEN, HT_LOAD_ERROR_ALLOC_FAILED if the file couldn't be mapped
+ *         or copied, or HT_LOAD_ERROR_PREMATURE_EOF if it was shorter than its size when read
+ */
+HashTable_LoadError file_contents_open(const char *filename, FileAccess access, FileContents *contents);
+
+/** @brief Unmaps or frees the contents of a file, and clears them */
+void file_contents_close(FileContents *contents);
+
+#ifdef HT_HAVE_MMAP
+/**
+ * @brief Extends a file, allocating its new blocks
+ *
+ * A file extended by ftruncate() is sparse. Writing through a shared mapping then allocates the
+ * blocks, and on a full disk the write raises SIGBUS instead of failing. Reserving them first
+ * reports the full disk here.
+ *
+ * @param fd Descriptor of a file of `offset` bytes, open for writing
+ * @param offset Current size of the file
+ * @param length Bytes to add
+ * @return false if the blocks couldn't be allocated, the file may have grown in that case
+ */
+bool file_reserve(int fd, size_t offset, size_t length);
+#endif
+
 /** @brief Is prime function
  *
  * Using an optimized trial division method with the 6k ± 1 rule
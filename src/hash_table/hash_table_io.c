@@ -3,131 +3,1050 @@
  * @brief Persistence and print methods for HashTable
  */
 
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 
 #include "hash_table.h"
 #include "hash_table_internal.h"
 #include "../interactive_mode/interactive_mode.h"
 
 static constexpr char VERSION[16] = "1.0";
-static constexpr size_t MAX_LINE = 256;
 static constexpr char HEADER_PREFIX[] = "CHashTable v";
 
-static void print_entry_to_file(int key, int value, void *file) {
-    file = (FILE *) file;
-    fprintf(file, "%d=%d\n", key, value);
+/** @brief Header line of the binary format, followed by the fixed binary header */
+static constexpr char BINARY_HEADER_LINE[] = "CHashTable v2.0\n";
+static constexpr uint32_t BINARY_VERSION = 2;
+/** @brief Version, entries per block, count and table size, then the CRC-32C of these */
+static constexpr size_t BINARY_HEADER_BYTES = 4 + 4 + 8 + 8 + 4;
+/** @brief Bytes of a key-value pair in a block */
+static constexpr size_t BINARY_ENTRY_BYTES = 8;
+/** @brief Entries per block written by hash_table_save_binary(), 512 KiB blocks */
+static constexpr size_t BINARY_BLOCK_ENTRIES = 65536;
+/** @brief Largest accepted block, so a corrupted header can't request a huge buffer */
+static constexpr size_t BINARY_MAX_BLOCK_ENTRIES = 1 << 20;
+
+static void put_u32(uint8_t *bytes, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = (uint8_t) (value >> (8 * i));
+    }
 }
 
-bool hash_table_save(const HashTable *table, const char *filename) {
+static void put_u64(uint8_t *bytes, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t) (value >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const uint8_t *bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= (uint32_t) bytes[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint64_t get_u64(const uint8_t *bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= (uint64_t) bytes[i] << (8 * i);
+    }
+    return value;
+}
+
+/** @brief Longest line of the text format, "-2147483648=-2147483648\n" */
+static constexpr size_t MAX_ENTRY_CHARS = 24;
+/** @brief Smallest accepted save buffer, a few lines */
+static constexpr size_t MIN_SAVE_BUFFER_SIZE = 4 * MAX_ENTRY_CHARS;
+/** @brief Decimal digits of 0 to 99, two characters each */
+static constexpr char DIGIT_PAIRS[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+/** @brief Text format being formatted into a buffer by write_text_entry() */
+typedef struct {
+    FILE *file;         /**< Destination, unbuffered */
+    char *buffer;       /**< Formatted text not written yet */
+    size_t capacity;    /**< Size of the buffer */
+    size_t length;      /**< Characters in the buffer */
+    bool failed;        /**< A write failed */
+} TextWriter;
+
+/** @brief Writes out the buffer, a single write() since the stream is unbuffered */
+static void flush_text(TextWriter *writer) {
+    if (writer->length == 0) return;
+
+    if (fwrite(writer->buffer, 1, writer->length, writer->file) != writer->length) writer->failed = true;
+    writer->length = 0;
+}
+
+/**
+ * @brief Formats an int in decimal, two digits per division
+ * @param out Destination with room for 11 characters
+ * @return End of the written characters
+ */
+static char *format_int(char *out, int value) {
+    uint32_t magnitude = (uint32_t) value;
+    if (value < 0) {
+        *out++ = '-';
+        magnitude = 0u - magnitude;
+    }
+
+    // Digits are produced from the lowest, fill a scratch buffer from its end
+    char digits[10];
+    char *first = digits + sizeof(digits);
+    while (magnitude >= 100) {
+        first -= 2;
+        memcpy(first, DIGIT_PAIRS + (magnitude % 100) * 2, 2);
+        magnitude /= 100;
+    }
+    if (magnitude >= 10) {
+        first -= 2;
+        memcpy(first, DIGIT_PAIRS + magnitude * 2, 2);
+    } else {
+        *--first = (char) ('0' + magnitude);
+    }
+
+    const size_t length = (size_t) (digits + sizeof(digits) - first);
+    memcpy(out, first, length);
+
+    return out + length;
+}
+
+static void write_text_entry(int key, int value, void *user_data) {
+    TextWriter *writer = (TextWriter *) user_data;
+    if (writer->capacity - writer->length < MAX_ENTRY_CHARS) flush_text(writer);
+
+    char *out = writer->buffer + writer->length;
+    out = format_int(out, key);
+    *out++ = '=';
+    out = format_int(out, value);
+    *out++ = '\n';
+
+    writer->length = (size_t) (out - writer->buffer);
+}
+
+/** @brief Writes the text format, version 1, through a buffer of `buffer_size` bytes */
+static bool write_text(const HashTable *table, FILE *file, size_t buffer_size) {
+    TextWriter writer = {
+        .file = file,
+        .buffer = (char *) malloc(buffer_size),
+        .capacity = buffer_size,
+        .length = 0,
+        .failed = false
+    };
+    if (writer.buffer == nullptr) return false;
+
+    // The buffer is the only one, stdio would copy every chunk once more
+    setvbuf(file, nullptr, _IONBF, 0);
+
+    writer.length = (size_t) snprintf(writer.buffer, buffer_size, "CHashTable v%s\n%zu\n", VERSION, table->count);
+    hash_table_foreach(table, write_text_entry, &writer);
+    if (writer.length == writer.capacity) flush_text(&writer);
+    writer.buffer[writer.length++] = '\n';
+    flush_text(&writer);
+
+    free(writer.buffer);
+
+    return !writer.failed && ferror(file) == 0;
+}
+
+/** @brief Block of the binary format being filled by write_binary_entry() */
+typedef struct {
+    FILE *file;         /**< Destination */
+    uint8_t *block;     /**< Entries of the block, with room for the checksum */
+    size_t entries;     /**< Entries in the block */
+    bool failed;        /**< A write failed */
+} BinaryWriter;
+
+/** @brief Appends the checksum of the block and writes it out */
+static void flush_block(BinaryWriter *writer) {
+    if (writer->entries == 0) return;
+
+    const size_t bytes = writer->entries * BINARY_ENTRY_BYTES;
+    put_u32(writer->block + bytes, crc32c(writer->block, bytes));
+    if (fwrite(writer->block, 1, bytes + 4, writer->file) != bytes + 4) writer->failed = true;
+
+    writer->entries = 0;
+}
+
+static void write_binary_entry(int key, int value, void *user_data) {
+    BinaryWriter *writer = (BinaryWriter *) user_data;
+    uint8_t *entry = writer->block + writer->entries * BINARY_ENTRY_BYTES;
+
+    put_u32(entry, (uint32_t) key);
+    put_u32(entry + 4, (uint32_t) value);
+
+    if (++writer->entries == BINARY_BLOCK_ENTRIES) flush_block(writer);
+}
+
+/** @brief Writes the binary format, version 2 */
+static bool write_binary(const HashTable *table, FILE *file) {
+    BinaryWriter writer = {
+        .file = file,
+        .block = (uint8_t *) malloc(BINARY_BLOCK_ENTRIES * BINARY_ENTRY_BYTES + 4),
+        .entries = 0,
+        .failed = false
+    };
+    if (writer.block == nullptr) return false;
+
+    background_resize_wait(table);
+
+    uint8_t header[BINARY_HEADER_BYTES];
+    put_u32(header, BINARY_VERSION);
+    put_u32(header + 4, (uint32_t) BINARY_BLOCK_ENTRIES);
+    put_u64(header + 8, table->count);
+    put_u64(header + 16, table->size);
+    put_u32(header + 24, crc32c(header, BINARY_HEADER_BYTES - 4));
+
+    fputs(BINARY_HEADER_LINE, file);
+    fwrite(header, 1, sizeof(header), file);
+
+    hash_table_foreach(table, write_binary_entry, &writer);
+    flush_block(&writer);
+
+    free(writer.block);
+
+    return !writer.failed && ferror(file) == 0;
+}
+
+/**
+ * @brief hash_table_save_buffered() and hash_table_save_binary() without timing
+ * @param buffer_size Buffer of the text format, unused by the binary one
+ */
+static bool save_file(const HashTable *table, const char *filename, bool binary, size_t buffer_size) {
     if (table == nullptr) return false;
     if (strlen(filename) == 0) return false;
 
-    FILE *file = fopen(filename, "w");
-    if (file == nullptr) return false;
+    trace_save_start(table, filename);
 
-    fprintf(file, "CHashTable v%s\n", VERSION);
-    fprintf(file, "%zu\n", table->count);
-    hash_table_foreach(table, print_entry_to_file, file);
-    fprintf(file, "\n");
+    FILE *file = fopen(filename, binary ? "wb" : "w");
+    if (file == nullptr) {
+        trace_save_end(table, filename, 0, false);
+        return false;
+    }
 
-    fclose(file);
+    bool success = binary ? write_binary(table, file) : write_text(table, file, buffer_size);
 
-    return true;
+    const long bytes = ftell(file);
+    if (fclose(file) != 0) success = false;
+
+    trace_save_end(table, filename, bytes > 0 ? (size_t) bytes : 0, success);
+
+    return success;
+}
+
+/** @brief Times a save, see save_file() */
+static bool timed_save(const HashTable *table, const char *filename, bool binary, size_t buffer_size) {
+    if (!op_timing_enabled()) return save_file(table, filename, binary, buffer_size);
+
+    const OpTimer timer = op_timer_start(table);
+    const bool result = save_file(table, filename, binary, buffer_size);
+    op_timer_stop(&timer, HT_OP_SAVE, table, 0);
+
+    return result;
+}
+
+bool hash_table_save(const HashTable *table, const char *filename) {
+    return timed_save(table, filename, false, HT_SAVE_BUFFER_SIZE);
+}
+
+bool hash_table_save_buffered(const HashTable *table, const char *filename, size_t buffer_size) {
+    if (buffer_size < MIN_SAVE_BUFFER_SIZE) buffer_size = MIN_SAVE_BUFFER_SIZE;
+    return timed_save(table, filename, false, buffer_size);
+}
+
+bool hash_table_save_binary(const HashTable *table, const char *filename) {
+    return timed_save(table, filename, true, 0);
+}
+
+/** @brief Contents of a file being loaded, and how far they were read */
+typedef struct {
+    const char *data;       /**< Contents of the file, mapped or read into memory */
+    size_t bytes;           /**< Size of the file */
+    size_t position;        /**< Offset of the next unread byte */
+    size_t line;            /**< Number of the line starting at `position`, from 1 */
+    size_t error_offset;    /**< Offset where the first error was found */
+    size_t error_line;      /**< Line of the first error, 0 in the binary format */
+} LoadSource;
+
+/** @brief Records the offset and line of an error, the first one is kept */
+static void load_error_at(LoadSource *source, size_t offset, size_t line) {
+    if (source->error_offset != SIZE_MAX) return;
+
+    source->error_offset = offset;
+    source->error_line = line;
 }
 
 /**
- * @brief Loads a hash table from a specified file.
+ * @brief Takes the next line, without its newline
+ * @return Length of the line, its start is `source->data + *start`. SIZE_MAX at the end of the file
  */
-HashTable_LoadError hash_table_load(const char *filename, HashTable **out_table) {
-    // Initialize out_table to nullptr in case of early failure
-    *out_table = nullptr;
+static size_t next_line(LoadSource *source, size_t *start) {
+    if (source->position >= source->bytes) return SIZE_MAX;
 
-    FILE *file = fopen(filename, "r");
-    if (file == nullptr) {
-        return HT_LOAD_ERROR_FILE_OPEN;
+    // memchr() scans a vector at a time in the usual C libraries
+    *start = source->position;
+    const char *newline = (const char *) memchr(source->data + *start, '\n', source->bytes - *start);
+    const size_t end = newline != nullptr ? (size_t) (newline - source->data) : source->bytes;
+
+    source->position = newline != nullptr ? end + 1 : end;
+    source->line++;
+
+    return end - *start;
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/**
+ * @brief Value of the 8 ASCII digits at `text`, or UINT64_MAX if they aren't all digits
+ *
+ * Converts them in three multiplications instead of a loop, pairs, then quads, then the whole.
+ */
+static uint64_t parse_8_digits(const char *text) {
+    uint64_t chunk;
+    memcpy(&chunk, text, sizeof(chunk));
+
+    // Each byte minus '0' must be at most 9: adding 0x76 carries into the top bit otherwise
+    const uint64_t values = chunk - 0x3030303030303030u;
+    if (((chunk & 0xf0f0f0f0f0f0f0f0u) | ((values + 0x7676767676767676u) & 0x8080808080808080u)) !=
+        0x3030303030303030u) {
+        return UINT64_MAX;
     }
 
-    char line[MAX_LINE];
-    size_t count = 0;
-    HashTable_LoadError error_code = HT_LOAD_OK;
-    HashTable *table = nullptr;
+    uint64_t result = values;
+    result = (result * 10 + (result >> 8)) & 0x00ff00ff00ff00ffu;
+    result = (result * 100 + (result >> 16)) & 0x0000ffff0000ffffu;
+    result = (result * 10000 + (result >> 32)) & 0x00000000ffffffffu;
 
-    // 1. Read and validate the header
-    if (fgets(line, sizeof(line), file) == nullptr) {
-        error_code = HT_LOAD_ERROR_EMPTY;
-        goto cleanup;
+    return result;
+}
+
+/**
+ * @brief Parses a decimal int like `%d`, after optional whitespace and sign
+ * @param text Start of the text
+ * @param end End of the line
+ * @param out_value Set to the parsed value
+ * @return Position after the digits, nullptr if there are none or the value doesn't fit an int
+ */
+static const char *parse_int(const char *text, const char *end, int *out_value) {
+    while (text < end && is_space(*text)) {
+        text++;
     }
 
-    // 2. Check if the line starts with the required prefix
-    if (strncmp(line, HEADER_PREFIX, strlen(HEADER_PREFIX)) != 0) {
-        error_code = HT_LOAD_ERROR_INVALID_HEADER;
-        goto cleanup;
+    bool negative = false;
+    if (text < end && (*text == '-' || *text == '+')) {
+        negative = *text == '-';
+        text++;
     }
 
-    // 3. Read count
-    if (fgets(line, sizeof(line), file) == nullptr) {
-        error_code = HT_LOAD_ERROR_MISSING_COUNT;
-        goto cleanup;
+    const char *digits = text;
+    uint64_t magnitude = 0;
+
+    // Long numbers take 8 digits at a time, the SWAR check only works on little-endian loads
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (end - text >= 8) {
+        const uint64_t chunk = parse_8_digits(text);
+        if (chunk != UINT64_MAX) {
+            magnitude = chunk;
+            text += 8;
+        }
     }
+#endif
 
-    // 4. Parse the count from the line
-    if (sscanf(line, "%zu", &count) != 1) {
-        error_code = HT_LOAD_ERROR_MALFORMED_COUNT;
-        goto cleanup;
+    for (; text < end && *text >= '0' && *text <= '9'; text++) {
+        magnitude = magnitude * 10 + (uint64_t) (*text - '0');
+        if (magnitude > (uint64_t) INT32_MAX + 1) return nullptr;
     }
+    if (text == digits) return nullptr;
 
-    // 5. Create the table
-    size_t initial_size = (size_t) ((double) count / HT_LOAD_THRESHOLD);
-    initial_size = initial_size < HT_INITIAL_SIZE ? HT_INITIAL_SIZE : next_prime(initial_size);
-    table = hash_table_create_with_size(initial_size);
+    if (negative) {
+        *out_value = (int) (0 - magnitude);
+    } else {
+        if (magnitude > INT32_MAX) return nullptr;
+        *out_value = (int) magnitude;
+    }
 
-    if (table == nullptr) {
-        error_code = HT_LOAD_ERROR_ALLOC_FAILED;
-        goto cleanup;
+    return text;
+}
+
+/** @brief Parses a `key=value` line like sscanf(" %d = %d "), anything after the value is ignored */
+static bool parse_entry(const char *text, const char *end, int *out_key, int *out_value) {
+    text = parse_int(text, end, out_key);
+    if (text == nullptr) return false;
+
+    while (text < end && is_space(*text)) {
+        text++;
     }
+    if (text == end || *text != '=') return false;
+
+    return parse_int(text + 1, end, out_value) != nullptr;
+}
 
-    // 6. Read key-value pairs
+/** @brief Size of a new table for `count` entries, so the load doesn't resize */
+static size_t load_table_size(uint64_t count) {
+    const size_t size = (size_t) ((double) count / HT_LOAD_THRESHOLD);
+    return size < HT_INITIAL_SIZE ? HT_INITIAL_SIZE : next_prime(size);
+}
+
+/** @brief Key-value pair parsed by a load worker */
+typedef struct {
     int key;
     int value;
-    size_t parsed_lines = 0; // Count of *successfully* parsed lines
+} LoadPair;
+
+/**
+ * @brief Part of a file parsed by one thread of hash_table_load_parallel()
+ *
+ * A worker parses its part into pairs grouped by bucket range, then inserts the pairs of one
+ * bucket range, taken from every worker in file order. No two workers touch the same bucket.
+ */
+typedef struct load_worker {
+    const LoadSource *source;   /**< Contents of the file */
+    HashTable *table;           /**< Table being loaded, pre-sized for the count */
+    struct load_worker *workers; /**< All workers, read by the insert phase */
+    size_t worker_count;        /**< Number of workers, also the number of bucket ranges */
+    size_t index;               /**< Index of this worker, and of its bucket range */
+    size_t first;               /**< Text: offset of the first line. Binary: first block */
+    size_t last;                /**< Text: offset after the last line. Binary: block after the last */
+    size_t line;                /**< Text: number of the line before the first one */
+    uint64_t lines;             /**< Text: lines in the part */
+    uint64_t budget;            /**< Text: lines to parse, the part may run past the count */
+    uint64_t block_entries;     /**< Binary: entries per block */
+    uint64_t count;             /**< Binary: entries in the file */
+    size_t data_start;          /**< Binary: offset of the first block */
+    LoadPair *pairs;            /**< Parsed pairs, grouped by bucket range */
+    size_t ranges[HT_PARALLEL_RESIZE_MAX_THREADS + 1]; /**< Start of the pairs of each bucket range */
+    size_t end;                 /**< Offset after the parsed part */
+    HashTable_LoadError error_code; /**< First error in the part */
+    size_t error_offset;        /**< Offset of the first error */
+    size_t error_line;          /**< Line of the first error */
+    Entry *entries;             /**< Node block slice for the new entries of the insert phase */
+    size_t inserted;            /**< New entries added by the insert phase */
+    uint64_t fingerprint;       /**< Fingerprint of the changes made by the insert phase */
+} LoadWorker;
+
+/** @brief Runs a function for every worker, on helper threads and the calling one */
+static void run_load_workers(LoadWorker *workers, size_t worker_count, int (*function)(void *)) {
+    thrd_t threads[HT_PARALLEL_RESIZE_MAX_THREADS];
+    bool started[HT_PARALLEL_RESIZE_MAX_THREADS];
 
+    // The calling thread takes the first worker, and those whose thread couldn't start
+    for (size_t t = 0; t < worker_count; t++) {
+        started[t] = t != 0 && thrd_create(&threads[t], function, &workers[t]) == thrd_success;
+    }
+
+    for (size_t t = 0; t < worker_count; t++) {
+        if (!started[t]) function(&workers[t]);
+    }
+
+    for (size_t t = 0; t < worker_count; t++) {
+        if (started[t]) thrd_join(threads[t], nullptr);
+    }
+}
+
+/** @brief Bucket range of a key, the bucket array is split into `worker_count` equal ranges */
+static size_t load_range(const LoadWorker *worker, int key) {
+    return hash_function(key, worker->table->size) * worker->worker_count / worker->table->size;
+}
+
+/**
+ * @brief Groups parsed pairs by bucket range, keeping their order within each range
+ * @param worker Worker whose `pairs` get the grouped pairs
+ * @param parsed Pairs in file order, freed
+ * @param count Number of pairs
+ */
+static bool group_pairs(LoadWorker *worker, LoadPair *parsed, size_t count) {
+    worker->pairs = (LoadPair *) malloc(sizeof(LoadPair) * (count + 1));
+    if (worker->pairs == nullptr) {
+        free(parsed);
+        return false;
+    }
+
+    size_t offsets[HT_PARALLEL_RESIZE_MAX_THREADS + 1] = {0};
     for (size_t i = 0; i < count; i++) {
-        // Read the next line
-        if (fgets(line, sizeof(line), file) == nullptr) {
-            // File ended before we read 'count' items
+        offsets[load_range(worker, parsed[i].key) + 1]++;
+    }
+    for (size_t r = 0; r < worker->worker_count; r++) {
+        offsets[r + 1] += offsets[r];
+    }
+    memcpy(worker->ranges, offsets, sizeof(offsets));
+
+    for (size_t i = 0; i < count; i++) {
+        worker->pairs[offsets[load_range(worker, parsed[i].key)]++] = parsed[i];
+    }
+
+    free(parsed);
+
+    return true;
+}
+
+/** @brief Counts the lines of a text part, a last line without newline included */
+static int count_lines_worker(void *arg) {
+    LoadWorker *worker = (LoadWorker *) arg;
+    const char *data = worker->source->data;
+
+    worker->lines = 0;
+    for (size_t position = worker->first; position < worker->last;) {
+        const char *newline = (const char *) memchr(data + position, '\n', worker->last - position);
+        worker->lines++;
+        position = newline != nullptr ? (size_t) (newline - data) + 1 : worker->last;
+    }
+
+    return 0;
+}
+
+/** @brief Parses the first `budget` lines of a text part */
+static int parse_text_worker(void *arg) {
+    LoadWorker *worker = (LoadWorker *) arg;
+
+    LoadSource part = *worker->source;
+    part.bytes = worker->last;
+    part.position = worker->first;
+    part.line = worker->line;
+
+    LoadPair *parsed = (LoadPair *) malloc(sizeof(LoadPair) * (worker->budget + 1));
+    if (parsed == nullptr) {
+        worker->error_code = HT_LOAD_ERROR_ALLOC_FAILED;
+        return 0;
+    }
+
+    size_t count = 0;
+    for (uint64_t i = 0; i < worker->budget; i++) {
+        size_t start;
+        const size_t length = next_line(&part, &start);
+
+        int key;
+        int value;
+        if (parse_entry(part.data + start, part.data + start + length, &key, &value)) {
+            parsed[count++] = (LoadPair){.key = key, .value = value};
+        } else if (worker->error_code == HT_LOAD_OK) {
+            worker->error_code = HT_LOAD_ERROR_MALFORMED_LINE;
+            worker->error_offset = start;
+            worker->error_line = part.line;
+        }
+    }
+    worker->end = part.position;
+
+    if (!group_pairs(worker, parsed, count) && worker->error_code == HT_LOAD_OK) {
+        worker->error_code = HT_LOAD_ERROR_ALLOC_FAILED;
+    }
+
+    return 0;
+}
+
+/** @brief Checks and reads the blocks of a binary part, stopping at the first damaged one */
+static int parse_binary_worker(void *arg) {
+    LoadWorker *worker = (LoadWorker *) arg;
+    const size_t block_bytes = worker->block_entries * BINARY_ENTRY_BYTES + 4;
+    const uint64_t first_entry = worker->first * worker->block_entries;
+    const uint64_t last_entry = worker->last * worker->block_entries;
+    const size_t capacity = (size_t) ((last_entry < worker->count ? last_entry : worker->count) - first_entry);
+
+    LoadPair *parsed = (LoadPair *) malloc(sizeof(LoadPair) * (capacity + 1));
+    if (parsed == nullptr) {
+        worker->error_code = HT_LOAD_ERROR_ALLOC_FAILED;
+        return 0;
+    }
+
+    size_t count = 0;
+    for (size_t b = worker->first; b < worker->last; b++) {
+        const uint64_t remaining = worker->count - b * worker->block_entries;
+        const size_t entries = remaining < worker->block_entries ? (size_t) remaining : worker->block_entries;
+        const size_t bytes = entries * BINARY_ENTRY_BYTES;
+        const size_t offset = worker->data_start + b * block_bytes;
+        const uint8_t *block = (const uint8_t *) worker->source->data + offset;
+
+        if (worker->source->bytes < offset || worker->source->bytes - offset < bytes + 4) {
+            worker->error_code = HT_LOAD_ERROR_PREMATURE_EOF;
+        } else if (get_u32(block + bytes) != crc32c(block, bytes)) {
+            worker->error_code = HT_LOAD_ERROR_CHECKSUM;
+        }
+        if (worker->error_code != HT_LOAD_OK) {
+            worker->error_offset = offset;
+            worker->error_line = 0;
+            break;
+        }
+
+        for (size_t i = 0; i < entries; i++) {
+            const uint8_t *entry = block + i * BINARY_ENTRY_BYTES;
+            parsed[count++] = (LoadPair){.key = (int) get_u32(entry), .value = (int) get_u32(entry + 4)};
+        }
+        worker->end = offset + bytes + 4;
+    }
+
+    if (!group_pairs(worker, parsed, count) && worker->error_code == HT_LOAD_OK) {
+        worker->error_code = HT_LOAD_ERROR_ALLOC_FAILED;
+    }
+
+    return 0;
+}
+
+/** @brief Inserts the pairs of the worker's bucket range, from every worker in file order */
+static int insert_range_worker(void *arg) {
+    LoadWorker *worker = (LoadWorker *) arg;
+    HashTable *table = worker->table;
+    const size_t range = worker->index;
+
+    for (size_t t = 0; t < worker->worker_count; t++) {
+        const LoadWorker *source = &worker->workers[t];
+
+        for (size_t i = source->ranges[range]; i < source->ranges[range + 1]; i++) {
+            const LoadPair pair = source->pairs[i];
+            const size_t hash = hash_function(pair.key, table->size);
+
+            // Later lines of a key overwrite earlier ones, like hash_table_insert()
+            Entry *entry = table->buckets[hash];
+            while (entry != nullptr && entry->key != pair.key) {
+                entry = entry->next;
+            }
+
+            if (entry != nullptr) {
+                worker->fingerprint += entry_fingerprint(pair.key, pair.value) - entry_fingerprint(pair.key, entry->value);
+                entry->value = pair.value;
+                continue;
+            }
+
+            entry = &worker->entries[worker->inserted++];
+            *entry = (Entry){.key = pair.key, .value = pair.value, .next = table->buckets[hash]};
+            table->buckets[hash] = entry;
+            worker->fingerprint += entry_fingerprint(pair.key, pair.value);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Inserts the parsed pairs into the table on all workers
+ *
+ * The entries are taken from a node block allocated up front, so the workers never call the
+ * allocator, which isn't assumed to be thread-safe. Each bucket range gets a slice with room for
+ * all of its pairs, duplicate keys leave some of it unused.
+ *
+ * @return HT_LOAD_OK, or the first error found while parsing
+ */
+static HashTable_LoadError insert_parsed(LoadSource *source, HashTable *table, LoadWorker *workers, size_t worker_count) {
+    // The first error in file order is the one a serial load stops at
+    for (size_t t = 0; t < worker_count; t++) {
+        if (workers[t].error_code != HT_LOAD_OK) {
+            load_error_at(source, workers[t].error_offset, workers[t].error_line);
+            return workers[t].error_code;
+        }
+    }
+
+    size_t slices[HT_PARALLEL_RESIZE_MAX_THREADS + 1] = {0};
+    for (size_t r = 0; r < worker_count; r++) {
+        slices[r + 1] = slices[r];
+        for (size_t t = 0; t < worker_count; t++) {
+            slices[r + 1] += workers[t].ranges[r + 1] - workers[t].ranges[r];
+        }
+    }
+    if (slices[worker_count] == 0) return HT_LOAD_OK;
+
+    struct node_block *block = node_block_create(table->memory, slices[worker_count]);
+    if (block == nullptr) return HT_LOAD_ERROR_ALLOC_FAILED;
+    table->nodes = block;
+
+    for (size_t r = 0; r < worker_count; r++) {
+        workers[r].entries = node_block_entries(block) + slices[r];
+    }
+
+    run_load_workers(workers, worker_count, insert_range_worker);
+
+    for (size_t t = 0; t < worker_count; t++) {
+        node_block_add_entries(block, workers[t].inserted);
+        table->count += workers[t].inserted;
+        table->fingerprint += workers[t].fingerprint;
+    }
+
+    return HT_LOAD_OK;
+}
+
+static void free_load_workers(LoadWorker *workers, size_t worker_count) {
+    for (size_t t = 0; t < worker_count; t++) {
+        free(workers[t].pairs);
+    }
+    free(workers);
+}
+
+/** @brief Creates the workers of a parallel load, with their shared fields set */
+static LoadWorker *create_load_workers(const LoadSource *source, HashTable *table, size_t worker_count) {
+    LoadWorker *workers = (LoadWorker *) calloc(worker_count, sizeof(LoadWorker));
+    if (workers == nullptr) return nullptr;
+
+    for (size_t t = 0; t < worker_count; t++) {
+        workers[t].source = source;
+        workers[t].table = table;
+        workers[t].workers = workers;
+        workers[t].worker_count = worker_count;
+        workers[t].index = t;
+        workers[t].error_code = HT_LOAD_OK;
+    }
+
+    return workers;
+}
+
+/**
+ * @brief Reads the key-value lines of the text format on multiple threads
+ *
+ * The lines are split into parts at newlines. The lines of each part are counted first, so every
+ * worker knows which of its lines are within the count, and the line numbers of its errors.
+ */
+static HashTable_LoadError load_text_parallel(LoadSource *source, HashTable *table, uint64_t count, size_t worker_count) {
+    LoadWorker *workers = create_load_workers(source, table, worker_count);
+    if (workers == nullptr) return HT_LOAD_ERROR_ALLOC_FAILED;
+
+    const size_t start = source->position;
+    size_t boundary = start;
+    for (size_t t = 0; t < worker_count; t++) {
+        workers[t].first = boundary;
+
+        boundary = start + (source->bytes - start) * (t + 1) / worker_count;
+        if (boundary < workers[t].first) boundary = workers[t].first;
+        if (boundary > start && boundary < source->bytes && source->data[boundary - 1] != '\n') {
+            const char *newline = (const char *) memchr(source->data + boundary, '\n', source->bytes - boundary);
+            boundary = newline != nullptr ? (size_t) (newline - source->data) + 1 : source->bytes;
+        }
+        workers[t].last = boundary;
+    }
+
+    run_load_workers(workers, worker_count, count_lines_worker);
+
+    uint64_t lines = 0;
+    for (size_t t = 0; t < worker_count; t++) {
+        workers[t].line = source->line + lines;
+        workers[t].budget = lines < count ? (count - lines < workers[t].lines ? count - lines : workers[t].lines) : 0;
+        lines += workers[t].lines;
+    }
+
+    // File ended before 'count' items
+    if (lines < count) {
+        source->position = source->bytes;
+        source->line += lines;
+        load_error_at(source, source->bytes, source->line + 1);
+        free_load_workers(workers, worker_count);
+        return HT_LOAD_ERROR_PREMATURE_EOF;
+    }
+
+    run_load_workers(workers, worker_count, parse_text_worker);
+
+    for (size_t t = 0; t < worker_count; t++) {
+        if (workers[t].budget > 0) source->position = workers[t].end;
+    }
+
+    const HashTable_LoadError error_code = insert_parsed(source, table, workers, worker_count);
+    free_load_workers(workers, worker_count);
+
+    return error_code;
+}
+
+/** @brief Checks and reads the blocks of the binary format on multiple threads, split into ranges of blocks */
+static HashTable_LoadError load_binary_parallel(
+    LoadSource *source,
+    HashTable *table,
+    uint64_t count,
+    size_t block_entries,
+    size_t worker_count
+) {
+    LoadWorker *workers = create_load_workers(source, table, worker_count);
+    if (workers == nullptr) return HT_LOAD_ERROR_ALLOC_FAILED;
+
+    const size_t block_count = (size_t) ((count + block_entries - 1) / block_entries);
+    for (size_t t = 0; t < worker_count; t++) {
+        workers[t].first = block_count * t / worker_count;
+        workers[t].last = block_count * (t + 1) / worker_count;
+        workers[t].block_entries = block_entries;
+        workers[t].count = count;
+        workers[t].data_start = source->position;
+        workers[t].end = source->position;
+    }
+
+    run_load_workers(workers, worker_count, parse_binary_worker);
+
+    // A serial load stops in front of the first damaged block
+    for (size_t t = 0; t < worker_count; t++) {
+        if (workers[t].last > workers[t].first) source->position = workers[t].end;
+        if (workers[t].error_code != HT_LOAD_OK) {
+            source->position = workers[t].error_offset;
+            break;
+        }
+    }
+
+    HashTable_LoadError error_code = insert_parsed(source, table, workers, worker_count);
+    free_load_workers(workers, worker_count);
+
+    // Duplicate keys would have been merged
+    if (error_code == HT_LOAD_OK && table->count != count) {
+        load_error_at(source, source->position, 0);
+        error_code = HT_LOAD_ERROR_MALFORMED_LINE;
+    }
+
+    return error_code;
+}
+
+/**
+ * @brief Reads the binary format after its header line
+ * @param source Contents positioned after the header line
+ * @param out_table Set to the created table, which may be partially filled on error
+ * @param thread_count Threads reading the entries, see hash_table_load_parallel()
+ * @return Load error code
+ */
+static HashTable_LoadError load_binary(LoadSource *source, HashTable **out_table, size_t thread_count) {
+    const uint8_t *header = (const uint8_t *) source->data + source->position;
+    if (source->bytes - source->position < BINARY_HEADER_BYTES) {
+        load_error_at(source, source->position, 0);
+        return HT_LOAD_ERROR_MISSING_COUNT;
+    }
+
+    const size_t block_entries = get_u32(header + 4);
+    const uint64_t count = get_u64(header + 8);
+    const uint64_t saved_size = get_u64(header + 16);
+
+    HashTable_LoadError error_code = HT_LOAD_OK;
+    if (get_u32(header + 24) != crc32c(header, BINARY_HEADER_BYTES - 4)) {
+        error_code = HT_LOAD_ERROR_CHECKSUM;
+    } else if (get_u32(header) != BINARY_VERSION) {
+        error_code = HT_LOAD_ERROR_INVALID_HEADER;
+    } else if (block_entries == 0 || block_entries > BINARY_MAX_BLOCK_ENTRIES || count > SIZE_MAX / 2) {
+        error_code = HT_LOAD_ERROR_MALFORMED_COUNT;
+    }
+    if (error_code != HT_LOAD_OK) {
+        load_error_at(source, source->position, 0);
+        return error_code;
+    }
+    source->position += BINARY_HEADER_BYTES;
+
+    // Recreate the saved size if it can hold the entries, so the load never resizes
+    size_t size = load_table_size(count);
+    if (saved_size >= size && saved_size <= UINT32_MAX && is_prime(saved_size)) size = (size_t) saved_size;
+
+    HashTable *table = hash_table_create_with_size(size);
+    if (table == nullptr) return HT_LOAD_ERROR_ALLOC_FAILED;
+    *out_table = table;
+
+    if (thread_count > 1) return load_binary_parallel(source, table, count, block_entries, thread_count);
+
+    // The blocks are checked and read in place
+    for (uint64_t remaining = count; remaining > 0;) {
+        const size_t entries = remaining < block_entries ? (size_t) remaining : block_entries;
+        const size_t bytes = entries * BINARY_ENTRY_BYTES;
+        const uint8_t *block = (const uint8_t *) source->data + source->position;
+
+        if (source->bytes - source->position < bytes + 4) {
             error_code = HT_LOAD_ERROR_PREMATURE_EOF;
-            goto cleanup; // This will destroy the partially-filled table
+        } else if (get_u32(block + bytes) != crc32c(block, bytes)) {
+            error_code = HT_LOAD_ERROR_CHECKSUM;
+        }
+        if (error_code != HT_LOAD_OK) {
+            load_error_at(source, source->position, 0);
+            return error_code;
+        }
+
+        for (size_t i = 0; i < entries; i++) {
+            const uint8_t *entry = block + i * BINARY_ENTRY_BYTES;
+            if (!hash_table_insert(table, (int) get_u32(entry), (int) get_u32(entry + 4))) {
+                return HT_LOAD_ERROR_ALLOC_FAILED;
+            }
         }
 
-        int parsed = sscanf(line, " %d = %d ", &key, &value);
+        source->position += bytes + 4;
+        remaining -= entries;
+    }
 
-        if (parsed == 2) {
-            hash_table_insert(table, key, value);
-            parsed_lines++; // Increment on success
+    // Duplicate keys would have been merged
+    if (table->count != count) {
+        load_error_at(source, source->position, 0);
+        return HT_LOAD_ERROR_MALFORMED_LINE;
+    }
+
+    return HT_LOAD_OK;
+}
+
+/**
+ * @brief Reads the text format after its header line
+ * @param source Contents positioned after the header line
+ * @param out_table Set to the created table, which may be partially filled on error
+ * @param thread_count Threads reading the entries, see hash_table_load_parallel()
+ * @return Load error code
+ */
+static HashTable_LoadError load_text(LoadSource *source, HashTable **out_table, size_t thread_count) {
+    // 3. Read count
+    size_t start;
+    size_t length = next_line(source, &start);
+    if (length == SIZE_MAX) {
+        load_error_at(source, source->position, source->line + 1);
+        return HT_LOAD_ERROR_MISSING_COUNT;
+    }
+
+    // 4. Parse the count from the line, like sscanf("%zu")
+    const char *text = source->data + start;
+    const char *end = text + length;
+    while (text < end && is_space(*text)) {
+        text++;
+    }
+
+    uint64_t count = 0;
+    const char *digits = text;
+    bool overflow = false;
+    for (; text < end && *text >= '0' && *text <= '9'; text++) {
+        overflow |= count > (SIZE_MAX - 9) / 10;
+        count = count * 10 + (uint64_t) (*text - '0');
+    }
+    if (text == digits || overflow) {
+        load_error_at(source, start, source->line);
+        return HT_LOAD_ERROR_MALFORMED_COUNT;
+    }
+
+    // 5. Create the table
+    HashTable *table = hash_table_create_with_size(load_table_size(count));
+    if (table == nullptr) return HT_LOAD_ERROR_ALLOC_FAILED;
+    *out_table = table;
+
+    if (thread_count > 1) return load_text_parallel(source, table, count, thread_count);
+
+    // 6. Parse key-value pairs in place
+    size_t parsed_lines = 0; // Count of *successfully* parsed lines
+
+    for (uint64_t i = 0; i < count; i++) {
+        length = next_line(source, &start);
+        if (length == SIZE_MAX) {
+            // File ended before we read 'count' items
+            load_error_at(source, source->bytes, source->line + 1);
+            return HT_LOAD_ERROR_PREMATURE_EOF;
         }
+
+        int key;
+        int value;
+        if (!parse_entry(source->data + start, source->data + start + length, &key, &value)) {
+            load_error_at(source, start, source->line);
+            continue;
+        }
+
+        if (!hash_table_insert(table, key, value)) return HT_LOAD_ERROR_ALLOC_FAILED;
+        parsed_lines++;
     }
 
     // Check if the number of successfully parsed lines matches the expected count
-    if (parsed_lines != count) {
-        error_code = HT_LOAD_ERROR_MALFORMED_LINE;
+    if (parsed_lines != count) return HT_LOAD_ERROR_MALFORMED_LINE;
+
+    return HT_LOAD_OK;
+}
+
+/**
+ * @brief hash_table_load_with_info() and hash_table_load_parallel() without timing
+ */
+static HashTable_LoadError load_file(
+    const char *filename,
+    HashTable **out_table,
+    HashTableLoadInfo *info,
+    size_t thread_count
+) {
+    // Initialize out_table to nullptr in case of early failure
+    *out_table = nullptr;
+
+    trace_load_start(filename);
+
+    // Parsed in place, read once from the start to the end
+    FileContents file;
+    HashTable_LoadError error_code = file_contents_open(filename, FILE_ACCESS_SEQUENTIAL, &file);
+    LoadSource source = {
+        .data = (const char *) file.data,
+        .bytes = file.bytes,
+        .position = 0,
+        .line = 0,
+        .error_offset = SIZE_MAX,
+        .error_line = 0
+    };
+    HashTable *table = nullptr;
+    size_t start;
+    size_t length;
+
+    if (error_code != HT_LOAD_OK) goto cleanup;
+
+    // 1. Read and validate the header
+    length = next_line(&source, &start);
+    if (length == SIZE_MAX) {
+        error_code = HT_LOAD_ERROR_EMPTY;
+        goto cleanup;
+    }
+
+    // 2. Check if the line starts with the required prefix
+    if (length < strlen(HEADER_PREFIX) || memcmp(source.data, HEADER_PREFIX, strlen(HEADER_PREFIX)) != 0) {
+        load_error_at(&source, 0, 1);
+        error_code = HT_LOAD_ERROR_INVALID_HEADER;
         goto cleanup;
     }
 
+    // The binary format continues after its header line
+    if (source.position == strlen(BINARY_HEADER_LINE) &&
+        memcmp(source.data, BINARY_HEADER_LINE, strlen(BINARY_HEADER_LINE)) == 0) {
+        error_code = load_binary(&source, &table, thread_count);
+    } else {
+        error_code = load_text(&source, &table, thread_count);
+    }
+
     // If we got here, all critical steps passed.
-    *out_table = table;
-    error_code = HT_LOAD_OK;
+    if (error_code == HT_LOAD_OK) *out_table = table;
 
 cleanup:
-    fclose(file);
+    file_contents_close(&file);
     if (error_code != HT_LOAD_OK && table != nullptr) {
         hash_table_destroy(table);
         *out_table = nullptr;
     }
 
+    if (info != nullptr) {
+        *info = (HashTableLoadInfo){
+            .bytes_read = source.position,
+            .error_offset = error_code != HT_LOAD_OK ? source.error_offset : SIZE_MAX,
+            .error_line = error_code != HT_LOAD_OK ? source.error_line : 0
+        };
+    }
+
+    trace_load_end(*out_table, filename, source.position);
+
     return error_code;
 }
 
+/** @brief Times a load, see load_file() */
+static HashTable_LoadError timed_load(
+    const char *filename,
+    HashTable **out_table,
+    HashTableLoadInfo *info,
+    size_t thread_count
+) {
+    if (!op_timing_enabled()) return load_file(filename, out_table, info, thread_count);
+
+    const OpTimer timer = op_timer_start(nullptr);
+    const HashTable_LoadError result = load_file(filename, out_table, info, thread_count);
+    op_timer_stop(&timer, HT_OP_LOAD, *out_table, 0);
+
+    return result;
+}
+
+/**
+ * @brief Loads a hash table from a specified file, reporting where it failed.
+ */
+HashTable_LoadError hash_table_load_with_info(const char *filename, HashTable **out_table, HashTableLoadInfo *info) {
+    return timed_load(filename, out_table, info, 1);
+}
+
+HashTable_LoadError hash_table_load_parallel(const char *filename, size_t thread_count, HashTable **out_table) {
+    if (thread_count > HT_PARALLEL_RESIZE_MAX_THREADS) thread_count = HT_PARALLEL_RESIZE_MAX_THREADS;
+    return timed_load(filename, out_table, nullptr, thread_count);
+}
+
+/**
+ * @brief Loads a hash table from a specified file.
+ */
+HashTable_LoadError hash_table_load(const char *filename, HashTable **out_table) {
+    return hash_table_load_with_info(filename, out_table, nullptr);
+}
+
 /**
  * @brief Converts a hash table load error code into a static, human-readable string.
  */
@@ -151,6 +1070,10 @@ const char *hash_table_error_string(HashTable_LoadError error_code) {
             return "Error: File ended prematurely. Item count mismatch.";
         case HT_LOAD_ERROR_MALFORMED_LINE:
             return "Error: File contains malformed key-value pairs or item count mismatch.";
+        case HT_LOAD_ERROR_CHECKSUM:
+            return "Error: Checksum mismatch, the file is corrupted.";
+        case HT_LOAD_ERROR_UNCLEAN_SHUTDOWN:
+            return "Error: The table file wasn't closed cleanly, its contents may be incomplete.";
         default:
             return "Error: Unknown error code.";
     }
@@ -162,6 +1085,8 @@ void hash_table_print(const HashTable *table, bool print_empty_buckets) {
         return;
     }
 
+    background_resize_wait(table);
+
     printf("################\n");
     printf("TABLE\n");
     printf("size: %zu\n", table->size);
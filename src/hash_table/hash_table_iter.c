@@ -0,0 +1,93 @@
+/**
+ * @file hash_table_iter.c
+ * @brief External iterator and resumable scan for HashTable
+ *
+ * Both walk the table in hash position order (see key_hash()). Since every bucket holds a
+ * contiguous range of positions in any table size, a position is a table-size-independent
+ * cursor: everything below it has been visited, even if the table was resized in between.
+ */
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+
+/** @brief End of the hash position space, the cursor of a finished iteration */
+static constexpr uint64_t HASH_POSITION_END = (uint64_t) 1 << 32;
+
+const Entry *hash_table_chain_at(const HashTable *table, uint32_t position, uint64_t *range_end) {
+    if (table->background != nullptr) return background_resize_chain_at(table, position, range_end);
+
+    const size_t hash = (size_t) (((uint64_t) position * table->size) >> 32);
+    *range_end = hash_range_start(hash + 1, table->size);
+
+    return table->buckets[hash];
+}
+
+void hash_table_iter_init(HashTableIter *iter, const HashTable *table) {
+    if (iter == nullptr) return;
+
+    *iter = (HashTableIter){
+        .table = table,
+        .position = 0
+    };
+}
+
+const Entry *hash_table_iter_next(HashTableIter *iter) {
+    if (iter == nullptr || iter->table == nullptr) return nullptr;
+
+    const HashTable *table = iter->table;
+    const Entry *result = nullptr;
+
+    background_resize_lock(table);
+
+    while (result == nullptr && iter->position < HASH_POSITION_END) {
+        uint64_t range_end;
+        const Entry *chain = hash_table_chain_at(table, (uint32_t) iter->position, &range_end);
+
+        // The entry with the smallest position not visited yet
+        uint64_t best = range_end;
+        for (const Entry *entry = chain; entry != nullptr; entry = entry->next) {
+            const uint64_t hash = key_hash(entry->key);
+            if (hash >= iter->position && hash < best) {
+                best = hash;
+                result = entry;
+            }
+        }
+
+        iter->position = result != nullptr ? best + 1 : range_end;
+    }
+
+    background_resize_unlock(table);
+
+    return result;
+}
+
+uint64_t hash_table_scan(
+    const HashTable *table,
+    uint64_t cursor,
+    size_t count,
+    void (*callback)(int key, int value, void *),
+    void *user_data
+) {
+    if (table == nullptr || cursor >= HASH_POSITION_END) return 0;
+    if (count == 0) count = 1;
+
+    background_resize_lock(table);
+
+    for (size_t visited = 0; visited < count && cursor < HASH_POSITION_END; visited++) {
+        uint64_t range_end;
+        const Entry *chain = hash_table_chain_at(table, (uint32_t) cursor, &range_end);
+
+        for (const Entry *entry = chain; entry != nullptr; entry = entry->next) {
+            const uint64_t hash = key_hash(entry->key);
+            if (hash >= cursor && hash < range_end) {
+                callback(entry->key, entry->value, user_data);
+            }
+        }
+
+        cursor = range_end;
+    }
+
+    background_resize_unlock(table);
+
+    return cursor < HASH_POSITION_END ? cursor : 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file hash_table_merkle.c
+ * @brief Merkle summary over hash position ranges, and table diffing
+ *
+ * The hash position space (see key_hash()) is split into MERKLE_LEAVES equal ranges.
+ * Each leaf holds the fingerprint of the entries in its range, and each inner node the sum of
+ * its two children, so the root equals the table fingerprint. The ranges don't depend on the
+ * table size, so replicas of any size can be compared node by node.
+ *
+ * The tree is stored as an implicit binary heap: node 1 is the root, node `i` has the children
+ * `2i` and `2i + 1`, and the leaves are the nodes `MERKLE_LEAVES` to `2 * MERKLE_LEAVES - 1`.
+ */
+
+#include <string.h>
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+
+/** @brief Bits of the hash position selecting the leaf */
+static constexpr int MERKLE_LEAF_BITS = 10;
+/** @brief Number of leaves, each covering 2^22 hash positions */
+static constexpr size_t MERKLE_LEAVES = (size_t) 1 << MERKLE_LEAF_BITS;
+
+/** @brief Tree node of the leaf covering a key */
+static size_t leaf_of(int key) {
+    return MERKLE_LEAVES + (key_hash(key) >> (32 - MERKLE_LEAF_BITS));
+}
+
+void fingerprint_add(HashTable *table, int key, uint64_t delta) {
+    table->fingerprint += delta;
+
+    if (table->merkle == nullptr) return;
+
+    for (size_t node = leaf_of(key); node > 0; node /= 2) {
+        table->merkle[node] += delta;
+    }
+}
+
+uint64_t *merkle_duplicate(const HashTable *table, struct table_memory *memory) {
+    if (table->merkle == nullptr) return nullptr;
+
+    uint64_t *merkle = (uint64_t *) memory_alloc(memory, sizeof(uint64_t) * 2 * MERKLE_LEAVES);
+    if (merkle == nullptr) return nullptr;
+
+    memcpy(merkle, table->merkle, sizeof(uint64_t) * 2 * MERKLE_LEAVES);
+    return merkle;
+}
+
+size_t merkle_bytes(const HashTable *table) {
+    return table->merkle != nullptr ? sizeof(uint64_t) * 2 * MERKLE_LEAVES : 0;
+}
+
+void merkle_reset(HashTable *table) {
+    if (table->merkle != nullptr) memset(table->merkle, 0, sizeof(uint64_t) * 2 * MERKLE_LEAVES);
+}
+
+void merkle_free(HashTable *table) {
+    memory_free(table->memory, table->merkle, merkle_bytes(table));
+    table->merkle = nullptr;
+}
+
+bool hash_table_enable_merkle(HashTable *table) {
+    if (table == nullptr) return false;
+    if (table->merkle != nullptr) return true;
+
+    background_resize_lock_idle(table);
+
+    // Allocated under the lock, a concurrent swap may replace the memory domain of the contents
+    uint64_t *merkle = (uint64_t *) memory_alloc(table->memory, sizeof(uint64_t) * 2 * MERKLE_LEAVES);
+    if (merkle == nullptr) {
+        background_resize_unlock(table);
+        return false;
+    }
+    memset(merkle, 0, sizeof(uint64_t) * 2 * MERKLE_LEAVES);
+
+    for (size_t i = 0; i < table->size; i++) {
+        for (const Entry *entry = table->buckets[i]; entry != nullptr; entry = entry->next) {
+            merkle[leaf_of(entry->key)] += entry_fingerprint(entry->key, entry->value);
+        }
+    }
+
+    for (size_t node = MERKLE_LEAVES - 1; node > 0; node--) {
+        merkle[node] = merkle[2 * node] + merkle[2 * node + 1];
+    }
+
+    table->merkle = merkle;
+
+    background_resize_unlock(table);
+
+    return true;
+}
+
+/**
+ * @brief Reports the entries of `table` in a leaf range that are missing from, or different in `other`
+ *
+ * @param table Table whose entries are walked
+ * @param other Table the entries are looked up in
+ * @param leaf Leaf node
+ * @param other_only Only report entries missing from `other`, the differing ones were reported already
+ * @param table_is_a `table` is the first table of the diff, decides the callback argument order
+ * @return Number of reported keys
+ */
+static size_t diff_leaf_entries(
+    const HashTable *table,
+    const HashTable *other,
+    size_t leaf,
+    bool other_only,
+    bool table_is_a,
+    void (*callback)(int key, const Entry *a, const Entry *b, void *),
+    void *user_data
+) {
+    const uint64_t first = (uint64_t) (leaf - MERKLE_LEAVES) << (32 - MERKLE_LEAF_BITS);
+    const uint64_t last = first + ((uint64_t) 1 << (32 - MERKLE_LEAF_BITS));
+    size_t differences = 0;
+
+    // Buckets holding positions of the range, the first and last one may hold other positions too
+    const size_t first_bucket = (size_t) ((first * table->size) >> 32);
+    const size_t last_bucket = (size_t) (((last - 1) * table->size) >> 32);
+
+    for (size_t i = first_bucket; i <= last_bucket; i++) {
+        for (const Entry *entry = table->buckets[i]; entry != nullptr; entry = entry->next) {
+            const uint64_t position = key_hash(entry->key);
+            if (position < first || position >= last) continue;
+
+            const Entry *found = hash_table_get(other, entry->key);
+            if (found != nullptr && (other_only || found->value == entry->value)) continue;
+
+            if (table_is_a) callback(entry->key, entry, found, user_data);
+            else callback(entry->key, found, entry, user_data);
+            differences++;
+        }
+    }
+
+    return differences;
+}
+
+/** @brief Descends into the mismatching subtrees of a node */
+static size_t diff_node(
+    const HashTable *a,
+    const HashTable *b,
+    size_t node,
+    void (*callback)(int key, const Entry *a, const Entry *b, void *),
+    void *user_data
+) {
+    // Without a summary on both sides, every subtree has to be checked
+    if (a->merkle != nullptr && b->merkle != nullptr && a->merkle[node] == b->merkle[node]) return 0;
+
+    if (node >= MERKLE_LEAVES) {
+        return diff_leaf_entries(a, b, node, false, true, callback, user_data) +
+               diff_leaf_entries(b, a, node, true, false, callback, user_data);
+    }
+
+    return diff_node(a, b, 2 * node, callback, user_data) +
+           diff_node(a, b, 2 * node + 1, callback, user_data);
+}
+
+size_t hash_table_diff(
+    const HashTable *a,
+    const HashTable *b,
+    void (*callback)(int key, const Entry *a, const Entry *b, void *),
+    void *user_data
+) {
+    if (a == nullptr || b == nullptr || callback == nullptr) return 0;
+
+    background_resize_wait(a);
+    background_resize_wait(b);
+
+    return diff_node(a, b, 1, callback, user_data);
+}
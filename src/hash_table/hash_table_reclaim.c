@@ -0,0 +1,125 @@
+/**
+ * @file hash_table_reclaim.c
+ * @brief Asynchronous destruction of tables on a reclaimer thread
+ *
+ * Tables passed to hash_table_destroy_async() are queued, and a single process-wide reclaimer
+ * thread destroys them in order, like the lazyfree thread of Redis. The thread is started by
+ * the first call and runs until the process exits.
+ *
+ * debugmalloc isn't thread-safe, so builds using it destroy the tables on the calling thread.
+ */
+
+#include <stdlib.h>
+#include <threads.h>
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+#ifndef CHASHTABLE_NO_DEBUGMALLOC
+#include "../debugmalloc/debugmalloc.h"
+#endif
+
+#ifdef CHASHTABLE_NO_DEBUGMALLOC
+
+/** @brief Queued table */
+struct reclaim_item {
+    HashTable *table;           /**< Table to destroy */
+    struct reclaim_item *next;  /**< Next queued table */
+};
+
+/** @brief State of the reclaimer thread, every field is protected by `lock` */
+static struct {
+    mtx_t lock;                 /**< Queue lock */
+    cnd_t wake;                 /**< Signals the reclaimer thread */
+    cnd_t idle;                 /**< Broadcast when the queue is drained */
+    bool started;               /**< The thread is running */
+    struct reclaim_item *head;  /**< Next table to destroy */
+    struct reclaim_item *tail;  /**< Last queued table */
+    size_t pending;             /**< Queued tables plus the one being destroyed */
+} reclaimer;
+
+static once_flag reclaimer_once = ONCE_FLAG_INIT;
+
+static int reclaimer_thread(void *arg) {
+    mtx_lock(&reclaimer.lock);
+
+    while (true) {
+        while (reclaimer.head == nullptr) {
+            cnd_wait(&reclaimer.wake, &reclaimer.lock);
+        }
+
+        struct reclaim_item *item = reclaimer.head;
+        reclaimer.head = item->next;
+        if (reclaimer.head == nullptr) reclaimer.tail = nullptr;
+
+        // Free without holding the lock, so callers can keep queueing
+        mtx_unlock(&reclaimer.lock);
+        hash_table_destroy(item->table);
+        free(item);
+        mtx_lock(&reclaimer.lock);
+
+        if (--reclaimer.pending == 0) cnd_broadcast(&reclaimer.idle);
+    }
+
+    return 0;
+}
+
+static void start_reclaimer(void) {
+    if (mtx_init(&reclaimer.lock, mtx_plain) != thrd_success) return;
+    if (cnd_init(&reclaimer.wake) != thrd_success) return;
+    if (cnd_init(&reclaimer.idle) != thrd_success) return;
+
+    thrd_t thread;
+    if (thrd_create(&thread, reclaimer_thread, nullptr) != thrd_success) return;
+    thrd_detach(thread);
+
+    reclaimer.started = true;
+}
+
+bool hash_table_destroy_async(HashTable *table) {
+    if (table == nullptr) return false;
+
+    call_once(&reclaimer_once, start_reclaimer);
+    if (!reclaimer.started) return hash_table_destroy(table);
+
+    struct reclaim_item *item = (struct reclaim_item *) malloc(sizeof(struct reclaim_item));
+    if (item == nullptr) return hash_table_destroy(table);
+
+    *item = (struct reclaim_item){
+        .table = table,
+        .next = nullptr
+    };
+
+    mtx_lock(&reclaimer.lock);
+
+    if (reclaimer.tail != nullptr) reclaimer.tail->next = item;
+    else reclaimer.head = item;
+    reclaimer.tail = item;
+    reclaimer.pending++;
+
+    cnd_signal(&reclaimer.wake);
+    mtx_unlock(&reclaimer.lock);
+
+    return true;
+}
+
+void hash_table_reclaim_wait(void) {
+    call_once(&reclaimer_once, start_reclaimer);
+    if (!reclaimer.started) return;
+
+    mtx_lock(&reclaimer.lock);
+    while (reclaimer.pending > 0) {
+        cnd_wait(&reclaimer.idle, &reclaimer.lock);
+    }
+    mtx_unlock(&reclaimer.lock);
+}
+
+#else
+
+bool hash_table_destroy_async(HashTable *table) {
+    return hash_table_destroy(table);
+}
+
+void hash_table_reclaim_wait(void) {
+}
+
+#endif
@@ -4,31 +4,54 @@
  */
 
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <threads.h>
 
 #include "hash_table.h"
 #include "hash_table_internal.h"
+#ifndef CHASHTABLE_NO_DEBUGMALLOC
 #include "../debugmalloc/debugmalloc.h"
+#endif
 
-Entry **create_buckets(size_t size) {
-    Entry **buckets = (Entry **) malloc(sizeof(Entry *) * size);
+Entry **create_buckets(struct table_memory *memory, size_t size) {
+    Entry **buckets = (Entry **) memory_alloc_bulk(memory, sizeof(Entry *) * size);
     if (buckets == nullptr) return nullptr;
 
-    // Set all buckets to nullptr
-    for (size_t i = 0; i < size; i++) {
-        buckets[i] = nullptr;
+    // Set all buckets to nullptr, unless the allocator returned zeroed pages
+    if (!memory_bulk_zeroed(memory)) {
+        for (size_t i = 0; i < size; i++) {
+            buckets[i] = nullptr;
+        }
     }
 
+    memory_prefault(memory, buckets, sizeof(Entry *) * size);
+
     return buckets;
 }
 
+void free_buckets(struct table_memory *memory, Entry **buckets, size_t size) {
+    memory_free_bulk(memory, buckets, sizeof(Entry *) * size);
+}
+
 HashTable *hash_table_create_with_size(size_t size) {
+    struct table_memory *memory = table_memory_create(nullptr);
+    if (memory == nullptr) return nullptr;
+
+    return create_table(size, memory);
+}
+
+HashTable *create_table(size_t size, struct table_memory *memory) {
     // Allocate memory
-    Entry **buckets = create_buckets(size);
-    if (buckets == nullptr) return nullptr;
+    Entry **buckets = create_buckets(memory, size);
+    if (buckets == nullptr) {
+        table_memory_release(memory);
+        return nullptr;
+    }
 
     HashTable *hash_table = (HashTable *) malloc(sizeof(HashTable));
     if (hash_table == nullptr) {
-        free(buckets);
+        free_buckets(memory, buckets, size);
+        table_memory_release(memory);
         return nullptr;
     }
 
@@ -37,25 +60,37 @@ HashTable *hash_table_create_with_size(size_t size) {
         .buckets = buckets,
         .size = size,
         .count = 0,
-        .load_threshold_count = calc_load_threshold_count(size)
+        .load_threshold_count = calc_load_threshold_count(size),
+        .fingerprint = 0,
+        .merkle = nullptr,
+        .parallel_resize_min_count = HT_PARALLEL_RESIZE_MIN_COUNT,
+        .resize_threads = HT_PARALLEL_RESIZE_THREADS,
+        .rehash_strategy = HT_REHASH_AUTO,
+        .resize_count = 0,
+        .resize_last_ns = 0,
+        .resize_total_ns = 0,
+        .background = nullptr,
+        .chunks = nullptr,
+        .nodes = nullptr,
+        .memory = memory
     };
 
     return hash_table;
 }
 
-void clear_buckets(Entry **buckets, size_t size) {
-    if (buckets == nullptr) return;
+void clear_buckets(HashTable *table) {
+    if (table->buckets == nullptr) return;
 
-    for (size_t i = 0; i < size; i++) {
-        Entry *head = buckets[i];
+    for (size_t i = 0; i < table->size; i++) {
+        Entry *head = table->buckets[i];
 
         while (head != nullptr) {
             Entry *tmp = head;
             head = head->next;
-            free(tmp);
+            entry_free(table, tmp);
         }
 
-        buckets[i] = nullptr;
+        table->buckets[i] = nullptr;
     }
 }
 
@@ -63,30 +98,260 @@ size_t calc_load_threshold_count(size_t size) {
     return (size_t) ((double) size * HT_LOAD_THRESHOLD);
 }
 
+bool hash_table_set_parallel_resize(HashTable *table, size_t min_count, size_t thread_count) {
+    if (table == nullptr) return false;
+
+    if (thread_count == 0) thread_count = 1;
+    if (thread_count > HT_PARALLEL_RESIZE_MAX_THREADS) thread_count = HT_PARALLEL_RESIZE_MAX_THREADS;
+
+    table->parallel_resize_min_count = min_count;
+    table->resize_threads = thread_count;
+
+    return true;
+}
+
+void rehash_range(Entry **old_buckets, size_t first, size_t last, Entry **new_buckets, size_t new_size) {
+    for (size_t i = first; i < last; i++) {
+        Entry *entry = old_buckets[i];
+
+        while (entry != nullptr) {
+            Entry *next = entry->next;
+            const size_t hash = hash_function(entry->key, new_size);
+
+            entry->next = new_buckets[hash];
+            new_buckets[hash] = entry;
+
+            entry = next;
+        }
+
+        old_buckets[i] = nullptr;
+    }
+}
+
+/**
+ * @brief Same as rehash_range(), but safe to run concurrently on disjoint old ranges
+ *
+ * Entries are pushed to the head of their new bucket with a compare-and-swap,
+ * since other threads may be pushing to the same bucket.
+ */
+static void rehash_range_atomic(Entry **old_buckets, size_t first, size_t last, Entry **new_buckets, size_t new_size) {
+    for (size_t i = first; i < last; i++) {
+        Entry *entry = old_buckets[i];
+
+        while (entry != nullptr) {
+            Entry *next = entry->next;
+
+            _Atomic(Entry *) *head = (_Atomic(Entry *) *) &new_buckets[hash_function(entry->key, new_size)];
+            Entry *expected = atomic_load_explicit(head, memory_order_relaxed);
+            do {
+                entry->next = expected;
+            } while (!atomic_compare_exchange_weak_explicit(
+                head, &expected, entry, memory_order_relaxed, memory_order_relaxed
+            ));
+
+            entry = next;
+        }
+
+        old_buckets[i] = nullptr;
+    }
+}
+
+/** @brief Arguments of a single rehash_parallel() worker */
+typedef struct {
+    Entry **old_buckets;
+    size_t first;
+    size_t last;
+    Entry **new_buckets;
+    size_t new_size;
+} RehashTask;
+
+static int rehash_worker(void *arg) {
+    const RehashTask *task = (const RehashTask *) arg;
+    rehash_range_atomic(task->old_buckets, task->first, task->last, task->new_buckets, task->new_size);
+    return 0;
+}
+
+void rehash_parallel(Entry **old_buckets, size_t old_size, Entry **new_buckets, size_t new_size, size_t thread_count) {
+    if (thread_count > HT_PARALLEL_RESIZE_MAX_THREADS) thread_count = HT_PARALLEL_RESIZE_MAX_THREADS;
+    if (thread_count < 1) thread_count = 1;
+
+    RehashTask tasks[HT_PARALLEL_RESIZE_MAX_THREADS];
+    thrd_t threads[HT_PARALLEL_RESIZE_MAX_THREADS];
+    bool started[HT_PARALLEL_RESIZE_MAX_THREADS];
+
+    // The calling thread takes the first range, helper threads the rest
+    for (size_t t = 0; t < thread_count; t++) {
+        tasks[t] = (RehashTask){
+            .old_buckets = old_buckets,
+            .first = old_size * t / thread_count,
+            .last = old_size * (t + 1) / thread_count,
+            .new_buckets = new_buckets,
+            .new_size = new_size
+        };
+
+        started[t] = t != 0 && thrd_create(&threads[t], rehash_worker, &tasks[t]) == thrd_success;
+    }
+
+    for (size_t t = 0; t < thread_count; t++) {
+        if (!started[t]) rehash_worker(&tasks[t]);
+    }
+
+    for (size_t t = 0; t < thread_count; t++) {
+        if (started[t]) thrd_join(threads[t], nullptr);
+    }
+}
+
+/** @brief An entry and its bucket index in the new array, used by rehash_radix() */
+typedef struct {
+    Entry *entry;
+    size_t hash;
+} RadixItem;
+
+bool rehash_radix(
+    Entry **old_buckets,
+    size_t old_size,
+    Entry **new_buckets,
+    size_t new_size,
+    size_t count,
+    struct table_memory *memory
+) {
+    const size_t partition_count = (new_size + HT_RADIX_PARTITION_BUCKETS - 1) / HT_RADIX_PARTITION_BUCKETS;
+    const size_t items_bytes = sizeof(RadixItem) * (count + 1);
+    const size_t offsets_bytes = sizeof(size_t) * (partition_count + 1);
+
+    RadixItem *items = (RadixItem *) memory_alloc_bulk(memory, items_bytes);
+    RadixItem *partitioned = (RadixItem *) memory_alloc_bulk(memory, items_bytes);
+    size_t *offsets = (size_t *) memory_alloc(memory, offsets_bytes);
+
+    if (items == nullptr || partitioned == nullptr || offsets == nullptr) {
+        memory_free_bulk(memory, items, items_bytes);
+        memory_free_bulk(memory, partitioned, items_bytes);
+        memory_free(memory, offsets, offsets_bytes);
+        return false;
+    }
+
+    for (size_t p = 0; p <= partition_count; p++) {
+        offsets[p] = 0;
+    }
+
+    // 1. Calculate the new bucket of every entry and count the entries of each partition
+    size_t n = 0;
+    for (size_t i = 0; i < old_size; i++) {
+        if (i + 16 < old_size && old_buckets[i + 16] != nullptr) __builtin_prefetch(old_buckets[i + 16]);
+        for (Entry *entry = old_buckets[i]; entry != nullptr; entry = entry->next) {
+            const size_t hash = hash_function(entry->key, new_size);
+            items[n++] = (RadixItem){.entry = entry, .hash = hash};
+            offsets[hash / HT_RADIX_PARTITION_BUCKETS + 1]++;
+        }
+        old_buckets[i] = nullptr;
+    }
+
+    // 2. Prefix sum gives the start of each partition
+    for (size_t p = 0; p < partition_count; p++) {
+        offsets[p + 1] += offsets[p];
+    }
+
+    // 3. Scatter the entries into their partitions
+    for (size_t k = 0; k < n; k++) {
+        partitioned[offsets[items[k].hash / HT_RADIX_PARTITION_BUCKETS]++] = items[k];
+    }
+
+    // 4. Link partition by partition, only one slice of the new array is touched at a time
+    for (size_t k = 0; k < n; k++) {
+        if (k + 16 < n) __builtin_prefetch(partitioned[k + 16].entry, 1);
+        Entry *entry = partitioned[k].entry;
+        entry->next = new_buckets[partitioned[k].hash];
+        new_buckets[partitioned[k].hash] = entry;
+    }
+
+    memory_free_bulk(memory, items, items_bytes);
+    memory_free_bulk(memory, partitioned, items_bytes);
+    memory_free(memory, offsets, offsets_bytes);
+
+    return true;
+}
+
+/**
+ * @brief Picks the rehash strategy of a resize
+ *
+ * The radix strategy is never picked automatically. It touches every entry twice, and
+ * benchmarks/bench_resize.c measured it slower than the serial relink up to 16M entries.
+ *
+ * @param table Table being resized
+ * @return Strategy to use, never HT_REHASH_AUTO
+ */
+static RehashStrategy select_rehash_strategy(const HashTable *table) {
+    if (table->rehash_strategy != HT_REHASH_AUTO) return table->rehash_strategy;
+
+    if (table->resize_threads > 1 && table->count >= table->parallel_resize_min_count) return HT_REHASH_PARALLEL;
+
+    return HT_REHASH_SERIAL;
+}
+
 void hash_table_resize(HashTable *table) {
-    const size_t new_size = next_prime(table->size * 2);
+    hash_table_resize_to(table, next_prime(table->size * 2));
+}
+
+void hash_table_reserve(HashTable *table, size_t count) {
+    const size_t size = next_prime((size_t) ((double) count / HT_LOAD_THRESHOLD));
+    if (size > table->size) hash_table_resize_to(table, size);
+}
+
+void hash_table_shrink_to_fit(HashTable *table) {
+    // Shrinking a table that may grow back soon isn't worth it
+    if (table->count >= table->load_threshold_count / 4) return;
+
+    // Leave the table half as loaded as the threshold
+    size_t size = next_prime((size_t) ((double) table->count / HT_LOAD_THRESHOLD) * 2);
+    if (size < HT_INITIAL_SIZE) size = HT_INITIAL_SIZE;
+    if (size < table->size) hash_table_resize_to(table, size);
+}
+
+void hash_table_resize_to(HashTable *table, size_t new_size) {
+    const uint64_t start = monotonic_ns();
     const size_t old_size = table->size;
 
+    // Entries shared with a copy can't be relinked, silently fail if they can't be duplicated
+    if (!cow_unshare(table)) return;
+
     // Try to allocate new buckets
-    Entry **new_buckets = create_buckets(new_size);
+    Entry **new_buckets = create_buckets(table->memory, new_size);
     // Silently fail
     if (new_buckets == nullptr) return;
 
-    // Swap buckets
+    trace_resize_start(table, new_size);
+
+    // Relink entries into new buckets
     Entry **old_buckets = table->buckets;
+    switch (select_rehash_strategy(table)) {
+        case HT_REHASH_PARALLEL:
+            rehash_parallel(old_buckets, old_size, new_buckets, new_size, table->resize_threads);
+            break;
+
+        case HT_REHASH_RADIX:
+            if (rehash_radix(old_buckets, old_size, new_buckets, new_size, table->count, table->memory)) break;
+            // Fall back to the serial strategy if the scratch buffers couldn't be allocated
+            rehash_range(old_buckets, 0, old_size, new_buckets, new_size);
+            break;
+
+        default:
+            rehash_range(old_buckets, 0, old_size, new_buckets, new_size);
+            break;
+    }
+
+    // Swap buckets
     table->buckets = new_buckets;
     table->size = new_size;
-    table->count = 0;
     table->load_threshold_count = calc_load_threshold_count(new_size);
 
-    // Rehash entries into new buckets
-    for (size_t i = 0; i < old_size; i++) {
-        Entry *bucket = old_buckets[i];
-        for (Entry *entry = bucket; entry != nullptr; entry = entry->next) {
-            hash_table_insert(table, entry->key, entry->value);
-        }
-    }
+    free_buckets(table->memory, old_buckets, old_size);
 
-    clear_buckets(old_buckets, old_size);
-    free(old_buckets);
+    const uint64_t elapsed = monotonic_ns() - start;
+    table->resize_count++;
+    table->resize_last_ns = elapsed;
+    table->resize_total_ns += elapsed;
+    INSTRUMENT_COUNT(HT_COUNTER_RESIZES, 1);
+    INSTRUMENT_COUNT(HT_COUNTER_RESIZE_NS, elapsed);
+    op_record(HT_OP_RESIZE, table, 0, elapsed, true);
+    trace_resize_end(table, old_size, elapsed);
 }
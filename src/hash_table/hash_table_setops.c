@@ -0,0 +1,312 @@
+/**
+ * @file hash_table_setops.c
+ * @brief Bulk operations: merge, intersect, subtract and retain
+ *
+ * The destination is modified in place. Lookups into the other table read its chains directly.
+ * When both tables have the same size, a key is in the same bucket in both, so they are walked
+ * bucket by bucket in a single pass without hashing any key. Removals unlink the rejected entries
+ * of every bucket in a single sweep, and shrink the table at most once at the end.
+ */
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+
+/** @brief Finds a key in a chain */
+static Entry *find_in_chain(Entry *chain, int key) {
+    for (Entry *entry = chain; entry != nullptr; entry = entry->next) {
+        if (entry->key == key) return entry;
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Inserts or merges a key-value pair into a bucket of the destination
+ * @param table Destination table
+ * @param bucket Bucket of the key in the destination
+ * @return false if an entry couldn't be allocated
+ */
+static bool merge_entry(
+    HashTable *table,
+    size_t bucket,
+    int key,
+    int value,
+    int (*conflict)(int key, int dst_value, int src_value, void *),
+    void *user_data
+) {
+    Entry *entry = find_in_chain(table->buckets[bucket], key);
+
+    if (entry != nullptr) {
+        const int merged = conflict != nullptr ? conflict(key, entry->value, value, user_data) : value;
+        if (merged == entry->value) return true;
+
+        // Duplicating a shared chunk replaces its entries
+        if (table->chunks != nullptr) {
+            if (!cow_own_range(table, bucket, bucket + 1)) return false;
+            entry = find_in_chain(table->buckets[bucket], key);
+        }
+
+        fingerprint_add(table, key, entry_fingerprint(key, merged) - entry_fingerprint(key, entry->value));
+        entry->value = merged;
+        return true;
+    }
+
+    if (table->chunks != nullptr && !cow_own_range(table, bucket, bucket + 1)) return false;
+
+    Entry *new_entry = (Entry *) memory_alloc(table->memory, sizeof(Entry));
+    if (new_entry == nullptr) return false;
+
+    *new_entry = (Entry){
+        .key = key,
+        .value = value,
+        .next = table->buckets[bucket]
+    };
+
+    table->buckets[bucket] = new_entry;
+    table->count++;
+    fingerprint_add(table, key, entry_fingerprint(key, value));
+
+    return true;
+}
+
+/**
+ * @brief Unlinks and frees the entries of a bucket rejected by a predicate
+ *
+ * @param table Table to filter
+ * @param bucket Bucket to filter
+ * @param keep Returns true for entries to keep. Called once per entry
+ * @param context Generic data passed to the predicate
+ * @param removed Incremented for every removed entry
+ * @return false if a shared chunk couldn't be duplicated, nothing is removed from the bucket in that case
+ */
+static bool retain_bucket(
+    HashTable *table,
+    size_t bucket,
+    bool (*keep)(const Entry *entry, size_t bucket, void *context),
+    void *context,
+    size_t *removed
+) {
+    // Verdicts of the entries already passed to the predicate: all kept but the last one
+    size_t known = 0;
+
+    // Only touch a shared chunk if something is removed from it
+    if (table->chunks != nullptr) {
+        const Entry *entry = table->buckets[bucket];
+        while (entry != nullptr && keep(entry, bucket, context)) {
+            entry = entry->next;
+            known++;
+        }
+
+        if (entry == nullptr) return true;
+        known++;
+
+        // The duplicate keeps the order of the chain, so the verdicts still apply to it
+        if (!cow_own_range(table, bucket, bucket + 1)) return false;
+    }
+
+    Entry **indirect = &table->buckets[bucket];
+    for (size_t position = 0; *indirect != nullptr; position++) {
+        Entry *entry = *indirect;
+
+        if (position < known ? position + 1 < known : keep(entry, bucket, context)) {
+            indirect = &entry->next;
+            continue;
+        }
+
+        *indirect = entry->next;
+        fingerprint_add(table, entry->key, 0 - entry_fingerprint(entry->key, entry->value));
+        entry_free(table, entry);
+        table->count--;
+        (*removed)++;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Sweeps every bucket of a table with retain_bucket(), then shrinks it if it became sparse
+ * @return Number of removed entries. Stops early if a shared chunk couldn't be duplicated
+ */
+static size_t retain_all(
+    HashTable *table,
+    bool (*keep)(const Entry *entry, size_t bucket, void *context),
+    void *context,
+    bool *success
+) {
+    size_t removed = 0;
+    *success = true;
+
+    for (size_t i = 0; i < table->size && *success; i++) {
+        *success = retain_bucket(table, i, keep, context, &removed);
+    }
+
+    if (removed > 0) hash_table_shrink_to_fit(table);
+
+    return removed;
+}
+
+/** @brief Membership test of a set operation */
+typedef struct {
+    const HashTable *other;  /**< Table the keys are looked up in */
+    bool same_size;          /**< Both tables have the same size, a key is in the same bucket in both */
+    bool keep_present;       /**< Keep the keys present in `other`, or the missing ones */
+} Membership;
+
+static bool keep_by_membership(const Entry *entry, size_t bucket, void *context) {
+    const Membership *membership = (const Membership *) context;
+    const HashTable *other = membership->other;
+    const size_t other_bucket = membership->same_size ? bucket : hash_function(entry->key, other->size);
+
+    return (find_in_chain(other->buckets[other_bucket], entry->key) != nullptr) == membership->keep_present;
+}
+
+static bool keep_none(const Entry *entry, size_t bucket, void *context) {
+    return false;
+}
+
+/** @brief User predicate of hash_table_retain() */
+typedef struct {
+    bool (*predicate)(int key, int value, void *);
+    void *user_data;
+} Predicate;
+
+static bool keep_by_predicate(const Entry *entry, size_t bucket, void *context) {
+    const Predicate *predicate = (const Predicate *) context;
+    return predicate->predicate(entry->key, entry->value, predicate->user_data);
+}
+
+/**
+ * @brief Deletes a key from the destination
+ * @return false if a shared chunk couldn't be duplicated
+ */
+static bool remove_key(HashTable *table, int key) {
+    const size_t bucket = hash_function(key, table->size);
+    if (find_in_chain(table->buckets[bucket], key) == nullptr) return true;
+    if (table->chunks != nullptr && !cow_own_range(table, bucket, bucket + 1)) return false;
+
+    for (Entry **indirect = &table->buckets[bucket]; *indirect != nullptr; indirect = &(*indirect)->next) {
+        if ((*indirect)->key == key) {
+            Entry *entry = *indirect;
+            *indirect = entry->next;
+            fingerprint_add(table, key, 0 - entry_fingerprint(key, entry->value));
+            entry_free(table, entry);
+            table->count--;
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool hash_table_merge(
+    HashTable *dst,
+    const HashTable *src,
+    int (*conflict)(int key, int dst_value, int src_value, void *),
+    void *user_data
+) {
+    if (dst == nullptr || src == nullptr || dst == src) return false;
+
+    bool success = true;
+
+    // src is only read, dst is locked for the whole merge
+    background_resize_wait(src);
+    background_resize_lock_idle(dst);
+
+    if (dst->size == src->size) {
+        // Bucket-parallel, then a single resize at the end
+        for (size_t i = 0; i < src->size && success; i++) {
+            for (const Entry *entry = src->buckets[i]; entry != nullptr && success; entry = entry->next) {
+                success = merge_entry(dst, i, entry->key, entry->value, conflict, user_data);
+            }
+        }
+
+        if (dst->count > dst->load_threshold_count) hash_table_reserve(dst, dst->count);
+    } else {
+        // Presize for the worst case, every key of src is new
+        hash_table_reserve(dst, dst->count + src->count);
+
+        for (size_t i = 0; i < src->size && success; i++) {
+            for (const Entry *entry = src->buckets[i]; entry != nullptr && success; entry = entry->next) {
+                success = merge_entry(dst, hash_function(entry->key, dst->size), entry->key, entry->value, conflict, user_data);
+            }
+        }
+
+        // The presizing may have failed silently
+        if (dst->count > dst->load_threshold_count) hash_table_reserve(dst, dst->count);
+    }
+
+    background_resize_unlock(dst);
+
+    return success;
+}
+
+bool hash_table_intersect(HashTable *dst, const HashTable *src) {
+    if (dst == nullptr || src == nullptr) return false;
+    if (dst == src) return true;
+
+    bool success = true;
+
+    background_resize_wait(src);
+    background_resize_lock_idle(dst);
+
+    // Every entry of dst has to be checked, whichever table is smaller
+    Membership membership = {
+        .other = src,
+        .same_size = dst->size == src->size,
+        .keep_present = true
+    };
+    retain_all(dst, keep_by_membership, &membership, &success);
+
+    background_resize_unlock(dst);
+
+    return success;
+}
+
+bool hash_table_subtract(HashTable *dst, const HashTable *src) {
+    if (dst == nullptr || src == nullptr) return false;
+
+    bool success = true;
+
+    background_resize_wait(src);
+    background_resize_lock_idle(dst);
+
+    if (dst == src) {
+        retain_all(dst, keep_none, nullptr, &success);
+    } else if (src->count < dst->count && src->size != dst->size) {
+        // Probe dst with the keys of the smaller src
+        for (size_t i = 0; i < src->size && success; i++) {
+            for (const Entry *entry = src->buckets[i]; entry != nullptr && success; entry = entry->next) {
+                success = remove_key(dst, entry->key);
+            }
+        }
+
+        if (success) hash_table_shrink_to_fit(dst);
+    } else {
+        Membership membership = {
+            .other = src,
+            .same_size = dst->size == src->size,
+            .keep_present = false
+        };
+        retain_all(dst, keep_by_membership, &membership, &success);
+    }
+
+    background_resize_unlock(dst);
+
+    return success;
+}
+
+size_t hash_table_retain(HashTable *table, bool (*predicate)(int key, int value, void *), void *user_data) {
+    if (table == nullptr || predicate == nullptr) return 0;
+
+    bool success;
+    Predicate context = {
+        .predicate = predicate,
+        .user_data = user_data
+    };
+
+    background_resize_lock_idle(table);
+    const size_t removed = retain_all(table, keep_by_predicate, &context, &success);
+    background_resize_unlock(table);
+
+    return removed;
+}
@@ -0,0 +1,183 @@
+/**
+ * @file hash_table_slowlog.c
+ * @brief Slow operation log and operation timing
+ *
+ * Operations taking at least the configured threshold are recorded into a fixed ring of
+ * HT_SLOWLOG_CAPACITY entries, like the SLOWLOG of Redis. While the log is disabled, the public
+ * operations skip timing entirely, see op_timing_enabled().
+ *
+ * The ring is lock-free, so any thread can record without blocking the others. A writer claims
+ * a sequence number with a single atomic increment, and its slot is guarded by a sequence lock:
+ * the slot sequence is odd while the entry is written and even once it is complete. Readers copy
+ * a slot and keep the copy only if the sequence didn't change meanwhile. A writer finding its
+ * slot taken by a concurrent writer drops its entry instead of waiting.
+ */
+
+#include <stdatomic.h>
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+
+/** @brief Ring slot, every field is read and written atomically */
+struct slowlog_slot {
+    _Atomic uint64_t sequence;      /**< 2 * id + 1 while written, 2 * id + 2 once complete, 0 if unused */
+    _Atomic uint64_t duration_ns;
+    _Atomic size_t chain_length;
+    _Atomic size_t table_size;
+    _Atomic size_t count;
+    _Atomic int op;
+    _Atomic int key;
+    _Atomic bool resized;
+};
+
+_Atomic uint64_t slowlog_threshold_ns = HT_SLOWLOG_DISABLED;
+
+static struct slowlog_slot slowlog[HT_SLOWLOG_CAPACITY];
+/** @brief Id of the next recorded entry */
+static _Atomic uint64_t slowlog_next_id = 0;
+/** @brief Entries with a smaller id were cleared by hash_table_slowlog_reset() */
+static _Atomic uint64_t slowlog_first_id = 0;
+
+/** @brief Writes an entry into the ring */
+static void slowlog_record(const HashTableSlowlogEntry *entry) {
+    const uint64_t id = atomic_fetch_add_explicit(&slowlog_next_id, 1, memory_order_relaxed);
+    struct slowlog_slot *slot = &slowlog[id % HT_SLOWLOG_CAPACITY];
+
+    // Skip the slot if a lapped writer is still in it, or a newer entry replaced it already
+    uint64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    if (sequence % 2 == 1 || sequence >= 2 * id + 1) return;
+    if (!atomic_compare_exchange_strong_explicit(
+        &slot->sequence, &sequence, 2 * id + 1, memory_order_relaxed, memory_order_relaxed
+    )) return;
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&slot->duration_ns, entry->duration_ns, memory_order_relaxed);
+    atomic_store_explicit(&slot->chain_length, entry->chain_length, memory_order_relaxed);
+    atomic_store_explicit(&slot->table_size, entry->table_size, memory_order_relaxed);
+    atomic_store_explicit(&slot->count, entry->count, memory_order_relaxed);
+    atomic_store_explicit(&slot->op, (int) entry->op, memory_order_relaxed);
+    atomic_store_explicit(&slot->key, entry->key, memory_order_relaxed);
+    atomic_store_explicit(&slot->resized, entry->resized, memory_order_relaxed);
+
+    atomic_store_explicit(&slot->sequence, 2 * id + 2, memory_order_release);
+}
+
+/**
+ * @brief Copies a complete entry out of the ring
+ * @return false if the slot doesn't hold the entry, or it was being written
+ */
+static bool slowlog_read(uint64_t id, HashTableSlowlogEntry *entry) {
+    struct slowlog_slot *slot = &slowlog[id % HT_SLOWLOG_CAPACITY];
+
+    const uint64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (sequence != 2 * id + 2) return false;
+
+    *entry = (HashTableSlowlogEntry){
+        .id = id,
+        .op = (HashTableOp) atomic_load_explicit(&slot->op, memory_order_relaxed),
+        .key = atomic_load_explicit(&slot->key, memory_order_relaxed),
+        .duration_ns = atomic_load_explicit(&slot->duration_ns, memory_order_relaxed),
+        .chain_length = atomic_load_explicit(&slot->chain_length, memory_order_relaxed),
+        .table_size = atomic_load_explicit(&slot->table_size, memory_order_relaxed),
+        .count = atomic_load_explicit(&slot->count, memory_order_relaxed),
+        .resized = atomic_load_explicit(&slot->resized, memory_order_relaxed)
+    };
+
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&slot->sequence, memory_order_relaxed) == sequence;
+}
+
+/** @brief Length of the chain holding a key, the table must be locked */
+static size_t chain_length(const HashTable *table, int key) {
+    size_t length = 0;
+    uint64_t range_end;
+
+    for (const Entry *entry = hash_table_chain_at(table, key_hash(key), &range_end); entry != nullptr; entry = entry->next) {
+        length++;
+    }
+
+    return length;
+}
+
+OpTimer op_timer_start(const HashTable *table) {
+    return (OpTimer){
+        .start_ns = monotonic_ns(),
+        // The maintenance thread updates the counter of background tables, which never resize inline
+        .resize_count = table != nullptr && table->background == nullptr ? table->resize_count : 0
+    };
+}
+
+void op_timer_stop(const OpTimer *timer, HashTableOp op, const HashTable *table, int key) {
+    const bool resized = table != nullptr && table->background == nullptr && table->resize_count != timer->resize_count;
+    op_record(op, table, key, monotonic_ns() - timer->start_ns, resized);
+}
+
+void op_record(HashTableOp op, const HashTable *table, int key, uint64_t elapsed_ns, bool resized) {
+    INSTRUMENT_LATENCY(op, elapsed_ns);
+
+    if (elapsed_ns < atomic_load_explicit(&slowlog_threshold_ns, memory_order_relaxed)) return;
+
+    HashTableSlowlogEntry entry = {
+        .id = 0,
+        .op = op,
+        .key = key,
+        .duration_ns = elapsed_ns,
+        .chain_length = 0,
+        .table_size = 0,
+        .count = 0,
+        .resized = resized
+    };
+
+    // Resizes are recorded by the thread resizing the table, every other operation has to lock it
+    const bool lock = table != nullptr && op != HT_OP_RESIZE;
+    if (lock) background_resize_lock(table);
+
+    if (table != nullptr) {
+        if (op == HT_OP_INSERT || op == HT_OP_GET || op == HT_OP_DELETE) entry.chain_length = chain_length(table, key);
+        entry.table_size = table->size;
+        entry.count = table->count;
+    }
+
+    if (lock) background_resize_unlock(table);
+
+    slowlog_record(&entry);
+}
+
+void hash_table_slowlog_set_threshold(uint64_t threshold_ns) {
+    atomic_store_explicit(&slowlog_threshold_ns, threshold_ns, memory_order_relaxed);
+}
+
+uint64_t hash_table_slowlog_threshold(void) {
+    return atomic_load_explicit(&slowlog_threshold_ns, memory_order_relaxed);
+}
+
+size_t hash_table_slowlog_get(HashTableSlowlogEntry *entries, size_t max_entries) {
+    if (entries == nullptr) return 0;
+
+    const uint64_t next_id = atomic_load_explicit(&slowlog_next_id, memory_order_acquire);
+    const uint64_t first_id = atomic_load_explicit(&slowlog_first_id, memory_order_relaxed);
+    size_t copied = 0;
+
+    // Newest first, at most one lap of the ring back
+    for (uint64_t id = next_id; id > first_id && next_id - id < HT_SLOWLOG_CAPACITY && copied < max_entries; id--) {
+        if (slowlog_read(id - 1, &entries[copied])) copied++;
+    }
+
+    return copied;
+}
+
+void hash_table_slowlog_reset(void) {
+    atomic_store_explicit(&slowlog_first_id, atomic_load_explicit(&slowlog_next_id, memory_order_relaxed), memory_order_relaxed);
+}
+
+const char *hash_table_op_name(HashTableOp op) {
+    switch (op) {
+        case HT_OP_INSERT: return "insert";
+        case HT_OP_GET: return "get";
+        case HT_OP_DELETE: return "delete";
+        case HT_OP_RESIZE: return "resize";
+        case HT_OP_SAVE: return "save";
+        case HT_OP_LOAD: return "load";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,213 @@
+/**
+ * @file hash_table_stats.c
+ * @brief Runtime statistics of a HashTable, and their Prometheus export
+ */
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+
+bool hash_table_stats(const HashTable *table, HashTableStats *stats) {
+    if (table == nullptr || stats == nullptr) return false;
+
+    *stats = (HashTableStats){
+        .count = 0,
+        .size = 0,
+        .load_factor = 0.0,
+        .empty_buckets = 0,
+        .longest_chain = 0,
+        .chain_histogram = {0},
+        .resize_count = 0,
+        .bucket_bytes = 0,
+        .entry_bytes = 0,
+        .overhead_bytes = 0,
+        .total_bytes = 0,
+        .allocated_bytes = 0
+    };
+
+    background_resize_lock_idle(table);
+
+    size_t block_entries = 0;
+    for (size_t i = 0; i < table->size; i++) {
+        size_t length = 0;
+        for (const Entry *entry = table->buckets[i]; entry != nullptr; entry = entry->next) {
+            if (entry_in_block(table, entry)) block_entries++;
+            length++;
+        }
+
+        if (length == 0) stats->empty_buckets++;
+        if (length > stats->longest_chain) stats->longest_chain = length;
+        stats->chain_histogram[length < HT_STATS_CHAIN_HISTOGRAM ? length : HT_STATS_CHAIN_HISTOGRAM - 1]++;
+    }
+
+    stats->count = table->count;
+    stats->size = table->size;
+    stats->load_factor = table->size > 0 ? (double) table->count / (double) table->size : 0.0;
+    stats->resize_count = table->resize_count;
+
+    // Entries of a node block are counted with the block, including its freed slots
+    stats->bucket_bytes = sizeof(Entry *) * table->size;
+    stats->entry_bytes = sizeof(Entry) * (table->count - block_entries) + node_block_bytes(table);
+    stats->overhead_bytes = sizeof(HashTable) + merkle_bytes(table) + cow_bytes(table) + background_resize_bytes(table);
+    stats->total_bytes = stats->bucket_bytes + stats->entry_bytes + stats->overhead_bytes;
+    stats->allocated_bytes = table_memory_live_bytes(table->memory);
+
+    background_resize_unlock(table);
+
+    return true;
+}
+
+/** @brief Writes the HELP and TYPE lines of a metric */
+static void write_metric_header(FILE *file, const char *name, const char *type, const char *help) {
+    fprintf(file, "# HELP %s %s\n", name, help);
+    fprintf(file, "# TYPE %s %s\n", name, type);
+}
+
+/** @brief Writes the chain length distribution as a histogram over the buckets */
+static void write_chain_histogram(FILE *file, const HashTableStats *stats) {
+    write_metric_header(file, "chashtable_chain_length", "histogram", "Number of entries per bucket");
+
+    size_t cumulative = 0;
+    for (size_t i = 0; i + 1 < HT_STATS_CHAIN_HISTOGRAM; i++) {
+        cumulative += stats->chain_histogram[i];
+        fprintf(file, "chashtable_chain_length_bucket{le=\"%zu\"} %zu\n", i, cumulative);
+    }
+
+    fprintf(file, "chashtable_chain_length_bucket{le=\"+Inf\"} %zu\n", stats->size);
+    fprintf(file, "chashtable_chain_length_sum %zu\n", stats->count);
+    fprintf(file, "chashtable_chain_length_count %zu\n", stats->size);
+}
+
+#ifdef CHASHTABLE_INSTRUMENT
+
+/** @brief Smallest and largest latency bucket bound of the Prometheus histograms, as powers of two nanoseconds */
+static constexpr int PROMETHEUS_LATENCY_MIN_EXPONENT = 6;
+static constexpr int PROMETHEUS_LATENCY_MAX_EXPONENT = 30;
+
+/** @brief Operation counters, labeled by operation and result */
+static const struct {
+    HashTableCounter counter;
+    const char *op;
+    const char *result;
+} OPERATION_COUNTERS[] = {
+    {HT_COUNTER_INSERT_NEW, "insert", "new"},
+    {HT_COUNTER_INSERT_UPDATES, "insert", "update"},
+    {HT_COUNTER_GET_HITS, "get", "hit"},
+    {HT_COUNTER_GET_MISSES, "get", "miss"},
+    {HT_COUNTER_DELETE_HITS, "delete", "hit"},
+    {HT_COUNTER_DELETE_MISSES, "delete", "miss"}
+};
+
+/**
+ * @brief Writes the latency histogram of an operation
+ *
+ * The instrumentation buckets split every power of two into 8, so they are merged into one
+ * bucket per power of two. The sum is estimated from the midpoints of the buckets.
+ */
+static void write_latency_histogram(FILE *file, const HashTableInstrumentation *snapshot, HashTableOp op) {
+    const char *name = hash_table_op_name(op);
+    uint64_t cumulative = 0;
+    double sum = 0.0;
+    size_t bucket = 0;
+
+    for (int exponent = PROMETHEUS_LATENCY_MIN_EXPONENT; exponent <= PROMETHEUS_LATENCY_MAX_EXPONENT; exponent++) {
+        const uint64_t bound = (uint64_t) 1 << exponent;
+
+        // Buckets ending at or below the bound
+        for (; bucket + 1 < HT_LATENCY_BUCKETS && hash_table_latency_bucket_value(bucket + 1) <= bound; bucket++) {
+            const uint64_t samples = snapshot->latency[op][bucket];
+            cumulative += samples;
+            sum += (double) samples * (double) (hash_table_latency_bucket_value(bucket) + hash_table_latency_bucket_value(bucket + 1)) / 2.0;
+        }
+
+        fprintf(
+            file,
+            "chashtable_operation_duration_seconds_bucket{op=\"%s\",le=\"%.9g\"} %llu\n",
+            name,
+            (double) bound / 1e9,
+            (unsigned long long) cumulative
+        );
+    }
+
+    for (; bucket < HT_LATENCY_BUCKETS; bucket++) {
+        const uint64_t samples = snapshot->latency[op][bucket];
+        cumulative += samples;
+        sum += (double) samples * (double) hash_table_latency_bucket_value(bucket);
+    }
+
+    fprintf(file, "chashtable_operation_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n", name, (unsigned long long) cumulative);
+    fprintf(file, "chashtable_operation_duration_seconds_sum{op=\"%s\"} %.9g\n", name, sum / 1e9);
+    fprintf(file, "chashtable_operation_duration_seconds_count{op=\"%s\"} %llu\n", name, (unsigned long long) cumulative);
+}
+
+/** @brief Writes the counters and latency histograms of the instrumentation */
+static void write_instrumentation(FILE *file) {
+    HashTableInstrumentation snapshot;
+    if (!hash_table_instrumentation_snapshot(&snapshot)) return;
+
+    write_metric_header(file, "chashtable_operations_total", "counter", "Operations of all tables by result");
+    for (size_t i = 0; i < sizeof(OPERATION_COUNTERS) / sizeof(OPERATION_COUNTERS[0]); i++) {
+        fprintf(
+            file,
+            "chashtable_operations_total{op=\"%s\",result=\"%s\"} %llu\n",
+            OPERATION_COUNTERS[i].op,
+            OPERATION_COUNTERS[i].result,
+            (unsigned long long) snapshot.counters[OPERATION_COUNTERS[i].counter]
+        );
+    }
+
+    write_metric_header(file, "chashtable_nodes_traversed_total", "counter", "Entries compared by inserts, gets and deletes of all tables");
+    fprintf(file, "chashtable_nodes_traversed_total %llu\n", (unsigned long long) snapshot.counters[HT_COUNTER_NODES_TRAVERSED]);
+
+    write_metric_header(file, "chashtable_operation_duration_seconds", "histogram", "Operation latency of all tables");
+    for (HashTableOp op = 0; op < HT_OP_COUNT; op++) {
+        write_latency_histogram(file, &snapshot, op);
+    }
+}
+
+#endif
+
+bool hash_table_stats_write_prometheus(const HashTable *table, FILE *file) {
+    if (file == nullptr) return false;
+
+    HashTableStats stats;
+    if (!hash_table_stats(table, &stats)) return false;
+
+    const HashTableResizeProgress progress = hash_table_resize_progress(table);
+
+    write_metric_header(file, "chashtable_entries", "gauge", "Number of entries");
+    fprintf(file, "chashtable_entries %zu\n", stats.count);
+
+    write_metric_header(file, "chashtable_buckets", "gauge", "Number of buckets");
+    fprintf(file, "chashtable_buckets %zu\n", stats.size);
+
+    write_metric_header(file, "chashtable_load_factor", "gauge", "Entries per bucket");
+    fprintf(file, "chashtable_load_factor %.9g\n", stats.load_factor);
+
+    write_metric_header(file, "chashtable_empty_buckets", "gauge", "Buckets without any entry");
+    fprintf(file, "chashtable_empty_buckets %zu\n", stats.empty_buckets);
+
+    write_metric_header(file, "chashtable_longest_chain", "gauge", "Entries in the longest chain");
+    fprintf(file, "chashtable_longest_chain %zu\n", stats.longest_chain);
+
+    write_chain_histogram(file, &stats);
+
+    write_metric_header(file, "chashtable_memory_bytes", "gauge", "Bytes allocated by the table");
+    fprintf(file, "chashtable_memory_bytes{kind=\"buckets\"} %zu\n", stats.bucket_bytes);
+    fprintf(file, "chashtable_memory_bytes{kind=\"entries\"} %zu\n", stats.entry_bytes);
+    fprintf(file, "chashtable_memory_bytes{kind=\"overhead\"} %zu\n", stats.overhead_bytes);
+
+    write_metric_header(file, "chashtable_allocated_bytes", "gauge", "Bytes live in the allocator of the table, shared with its copies");
+    fprintf(file, "chashtable_allocated_bytes %zu\n", stats.allocated_bytes);
+
+    write_metric_header(file, "chashtable_resizes_total", "counter", "Completed resizes");
+    fprintf(file, "chashtable_resizes_total %zu\n", stats.resize_count);
+
+    write_metric_header(file, "chashtable_resize_seconds_total", "counter", "Time spent resizing");
+    fprintf(file, "chashtable_resize_seconds_total %.9g\n", progress.total_duration_ms / 1e3);
+
+#ifdef CHASHTABLE_INSTRUMENT
+    write_instrumentation(file);
+#endif
+
+    return !ferror(file);
+}
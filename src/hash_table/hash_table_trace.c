@@ -0,0 +1,149 @@
+/**
+ * @file hash_table_trace.c
+ * @brief Static tracepoints and the trace hook
+ *
+ * Every event fires a USDT probe of the `chashtable` provider, and calls the registered hook.
+ * The probes are compiled in if <sys/sdt.h> is available (systemtap-sdt-dev), unless
+ * CHASHTABLE_NO_USDT is defined. An unattached probe is a single nop, attach to them with
+ * e.g. `bpftrace -e 'usdt:./CHashTable:chashtable:resize__end { printf("%d\n", arg3); }'`.
+ *
+ * Probes and their arguments:
+ * - resize__start(table, old_size, new_size, count)
+ * - resize__end(table, old_size, new_size, duration_ns)
+ * - save__start(table, filename, count)
+ * - save__end(table, filename, count, bytes, success)
+ * - load__start(filename)
+ * - load__end(table, filename, count, bytes, success)
+ * - long__chain(table, key, chain_length, size)
+ */
+
+#include <stdatomic.h>
+
+#include "hash_table.h"
+#include "hash_table_internal.h"
+
+#if !defined(CHASHTABLE_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HT_PROBE(name, ...) STAP_PROBEV(chashtable, name, __VA_ARGS__)
+#endif
+#endif
+
+#ifndef HT_PROBE
+#define HT_PROBE(name, ...) ((void) 0)
+#endif
+
+static _Atomic(void (*)(const HashTableTraceEvent *, void *)) trace_hook = nullptr;
+static _Atomic(void *) trace_user_data = nullptr;
+
+void hash_table_set_trace_hook(void (*hook)(const HashTableTraceEvent *event, void *), void *user_data) {
+    atomic_store_explicit(&trace_hook, nullptr, memory_order_release);
+    atomic_store_explicit(&trace_user_data, user_data, memory_order_release);
+    atomic_store_explicit(&trace_hook, hook, memory_order_release);
+}
+
+/** @brief Calls the registered hook, if any */
+static void call_hook(const HashTableTraceEvent *event) {
+    void (*hook)(const HashTableTraceEvent *, void *) = atomic_load_explicit(&trace_hook, memory_order_acquire);
+    if (hook == nullptr) return;
+
+    hook(event, atomic_load_explicit(&trace_user_data, memory_order_acquire));
+}
+
+/** @brief Checks if a hook is registered, so events aren't built for nothing */
+static bool hook_registered(void) {
+    return atomic_load_explicit(&trace_hook, memory_order_relaxed) != nullptr;
+}
+
+void trace_resize_start(const HashTable *table, size_t new_size) {
+    HT_PROBE(resize__start, table, table->size, new_size, table->count);
+    if (!hook_registered()) return;
+
+    call_hook(&(HashTableTraceEvent){
+        .type = HT_TRACE_RESIZE_START,
+        .table = table,
+        .old_size = table->size,
+        .size = new_size,
+        .count = table->count
+    });
+}
+
+void trace_resize_end(const HashTable *table, size_t old_size, uint64_t duration_ns) {
+    HT_PROBE(resize__end, table, old_size, table->size, duration_ns);
+    if (!hook_registered()) return;
+
+    call_hook(&(HashTableTraceEvent){
+        .type = HT_TRACE_RESIZE_END,
+        .table = table,
+        .old_size = old_size,
+        .size = table->size,
+        .count = table->count,
+        .duration_ns = duration_ns,
+        .success = true
+    });
+}
+
+void trace_save_start(const HashTable *table, const char *filename) {
+    HT_PROBE(save__start, table, filename, table->count);
+    if (!hook_registered()) return;
+
+    call_hook(&(HashTableTraceEvent){
+        .type = HT_TRACE_SAVE_START,
+        .table = table,
+        .filename = filename,
+        .count = table->count
+    });
+}
+
+void trace_save_end(const HashTable *table, const char *filename, size_t bytes, bool success) {
+    HT_PROBE(save__end, table, filename, table->count, bytes, success);
+    if (!hook_registered()) return;
+
+    call_hook(&(HashTableTraceEvent){
+        .type = HT_TRACE_SAVE_END,
+        .table = table,
+        .filename = filename,
+        .count = table->count,
+        .bytes = bytes,
+        .success = success
+    });
+}
+
+void trace_load_start(const char *filename) {
+    HT_PROBE(load__start, filename);
+    if (!hook_registered()) return;
+
+    call_hook(&(HashTableTraceEvent){
+        .type = HT_TRACE_LOAD_START,
+        .filename = filename
+    });
+}
+
+void trace_load_end(const HashTable *table, const char *filename, size_t bytes) {
+    const size_t count = table != nullptr ? table->count : 0;
+    HT_PROBE(load__end, table, filename, count, bytes, table != nullptr);
+    if (!hook_registered()) return;
+
+    call_hook(&(HashTableTraceEvent){
+        .type = HT_TRACE_LOAD_END,
+        .table = table,
+        .filename = filename,
+        .count = count,
+        .bytes = bytes,
+        .success = table != nullptr
+    });
+}
+
+void trace_long_chain(const HashTable *table, int key, size_t chain_length) {
+    HT_PROBE(long__chain, table, key, chain_length, table->size);
+    if (!hook_registered()) return;
+
+    call_hook(&(HashTableTraceEvent){
+        .type = HT_TRACE_LONG_CHAIN,
+        .table = table,
+        .key = key,
+        .chain_length = chain_length,
+        .size = table->size,
+        .count = table->count
+    });
+}
@@ -4,19 +4,50 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
-#include <limits.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
 
 #include "hash_table_internal.h"
 
+uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+uint32_t key_hash(int key) {
+    uint32_t h = (uint32_t) key;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+uint64_t entry_fingerprint(int key, int value) {
+    // SplitMix64 finalizer over the key-value pair
+    uint64_t h = ((uint64_t) (uint32_t) key << 32) | (uint32_t) value;
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9u;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebu;
+    h ^= h >> 31;
+    return h;
+}
+
 size_t hash_function(int key, size_t table_size) {
     // Sanity check
-    assert(table_size <= INT_MAX);
-    int mod = key % (int) table_size;
-    if (mod < 0) {
-        mod += (int) table_size;
-    }
-    return (size_t) mod;
+    assert(table_size <= UINT32_MAX);
+    return (size_t) (((uint64_t) key_hash(key) * table_size) >> 32);
+}
+
+uint64_t hash_range_start(size_t bucket, size_t table_size) {
+    // ceil(bucket * 2^32 / table_size), fits into 64 bits since bucket <= table_size <= 2^32
+    return (((uint64_t) bucket << 32) + table_size - 1) / table_size;
 }
 
 bool is_prime(size_t n) {
@@ -45,3 +76,150 @@ size_t next_prime(size_t n) {
         n += 2;
     }
 }
+
+/** @brief Reflected CRC-32C (Castagnoli) polynomial */
+static constexpr uint32_t CRC32C_POLYNOMIAL = 0x82f63b78u;
+
+/** @brief Byte-wise CRC-32C lookup table, filled on first use */
+static uint32_t crc32c_table[256];
+static once_flag crc32c_once = ONCE_FLAG_INIT;
+
+static void crc32c_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0u - (crc & 1u)));
+        }
+        crc32c_table[i] = crc;
+    }
+}
+
+/** @brief Table driven CRC-32C, on the pre- and post-inverted state */
+static uint32_t crc32c_software(uint32_t crc, const uint8_t *bytes, size_t length) {
+    call_once(&crc32c_once, crc32c_init_table);
+
+    for (size_t i = 0; i < length; i++) {
+        crc = crc32c_table[(crc ^ bytes[i]) & 0xffu] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+/** @brief CRC-32C with the SSE 4.2 crc32 instruction, 8 bytes at a time */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hardware(uint32_t crc, const uint8_t *bytes, size_t length) {
+    uint64_t crc64 = crc;
+    for (; length >= 8; bytes += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+    }
+
+    crc = (uint32_t) crc64;
+    for (; length > 0; bytes++, length--) {
+        crc = __builtin_ia32_crc32qi(crc, *bytes);
+    }
+
+    return crc;
+}
+
+#endif
+
+uint32_t crc32c(const void *data, size_t length) {
+    const uint8_t *bytes = (const uint8_t *) data;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (__builtin_cpu_supports("sse4.2")) return ~crc32c_hardware(~0u, bytes, length);
+#endif
+
+    return ~crc32c_software(~0u, bytes, length);
+}
+
+HashTable_LoadError file_contents_open(const char *filename, FileAccess access, FileContents *contents) {
+    *contents = (FileContents){.data = nullptr, .bytes = 0, .mapped = false};
+
+#ifdef HT_HAVE_MMAP
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0) return HT_LOAD_ERROR_FILE_OPEN;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return HT_LOAD_ERROR_FILE_OPEN;
+    }
+
+    contents->bytes = (size_t) st.st_size;
+    if (contents->bytes == 0) {
+        close(fd);
+        return HT_LOAD_OK;
+    }
+
+    // Shared, so processes opening the same file use the same pages of the page cache
+    void *data = mmap(nullptr, contents->bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return HT_LOAD_ERROR_ALLOC_FAILED;
+
+#if defined(MADV_SEQUENTIAL) && defined(MADV_RANDOM)
+    madvise(data, contents->bytes, access == FILE_ACCESS_SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM);
+#endif
+
+    contents->data = data;
+    contents->mapped = true;
+
+    return HT_LOAD_OK;
+#else
+    FILE *file = fopen(filename, "rb");
+    if (file == nullptr) return HT_LOAD_ERROR_FILE_OPEN;
+
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    HashTable_LoadError error_code = HT_LOAD_OK;
+    contents->bytes = size > 0 ? (size_t) size : 0;
+    if (contents->bytes > 0) {
+        void *data = malloc(contents->bytes);
+        if (data == nullptr) {
+            error_code = HT_LOAD_ERROR_ALLOC_FAILED;
+        } else if (fread(data, 1, contents->bytes, file) != contents->bytes) {
+            free(data);
+            error_code = HT_LOAD_ERROR_PREMATURE_EOF;
+        } else {
+            contents->data = data;
+        }
+    }
+
+    fclose(file);
+
+    return error_code;
+#endif
+}
+
+#ifdef HT_HAVE_MMAP
+bool file_reserve(int fd, size_t offset, size_t length) {
+    if (length == 0) return true;
+
+#if defined(_POSIX_ADVISORY_INFO) && _POSIX_ADVISORY_INFO > 0
+    return posix_fallocate(fd, (off_t) offset, (off_t) length) == 0;
+#else
+    // Writing allocates the blocks just as well, a byte per page is enough
+    static const char zero = 0;
+    for (size_t position = offset; position < offset + length; position += 4096) {
+        if (pwrite(fd, &zero, 1, (off_t) position) != 1) return false;
+    }
+
+    return pwrite(fd, &zero, 1, (off_t) (offset + length - 1)) == 1;
+#endif
+}
+#endif
+
+void file_contents_close(FileContents *contents) {
+#ifdef HT_HAVE_MMAP
+    if (contents->mapped) munmap((void *) contents->data, contents->bytes);
+#endif
+    if (!contents->mapped) free((void *) contents->data);
+
+    *contents = (FileContents){.data = nullptr, .bytes = 0, .mapped = false};
+}
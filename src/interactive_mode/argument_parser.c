@@ -3,6 +3,7 @@
  * @brief Argument parser API for interactive mode
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -61,6 +62,13 @@ ParsedInput get_input(FILE *input_stream, FILE *output_stream) {
     // Get input from input stream
     char line[MAX_CMD_LEN];
     if (fgets(line, sizeof(line), input_stream) == nullptr) {
+        // Interrupted by a signal, the caller handles it and prompts again
+        if (ferror(input_stream) && errno == EINTR) {
+            clearerr(input_stream);
+            fprintf(output_stream, "\n");
+            return result;
+        }
+
         print_error(output_stream, "Failed to read input");
         return result;
     }
@@ -83,7 +91,8 @@ ParsedInput get_input(FILE *input_stream, FILE *output_stream) {
         return result;
     }
 
-    const bool cmd_has_key_param = (result.cmd == CMD_ADD | result.cmd == CMD_GET | result.cmd == CMD_DEL);
+    const bool cmd_has_key_param = (result.cmd == CMD_ADD | result.cmd == CMD_GET | result.cmd == CMD_DEL |
+                                    result.cmd == CMD_SLOWLOG_SET);
     const bool cmd_has_value_param = result.cmd == CMD_ADD;
 
     // If the command has a key param try to parse it
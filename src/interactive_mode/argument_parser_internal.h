@@ -11,7 +11,7 @@
 
 constexpr size_t MAX_CMD_LEN = 128;
 constexpr char DELIMITERS[] = " \t\r\n";
-constexpr size_t CMD_COUNT = 8;
+constexpr size_t CMD_COUNT = 11;
 
 /** @brief Maps command string to enum */
 typedef struct {
@@ -27,6 +27,9 @@ constexpr CommandMap command_table[CMD_COUNT] = {
     {"save", CMD_SAVE},
     {"load", CMD_LOAD},
     {"print", CMD_PRINT},
+    {"slowlog", CMD_SLOWLOG},
+    {"slowlog_set", CMD_SLOWLOG_SET},
+    {"metrics", CMD_METRICS},
     {"exit", CMD_EXIT},
     {"help", CMD_HELP}
 };
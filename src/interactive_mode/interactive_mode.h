@@ -26,6 +26,9 @@ typedef enum {
     CMD_SAVE,
     CMD_LOAD,
     CMD_PRINT,
+    CMD_SLOWLOG,
+    CMD_SLOWLOG_SET,
+    CMD_METRICS,
     CMD_EXIT,
     CMD_HELP
 } Command;
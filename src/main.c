@@ -3,6 +3,7 @@
  * @brief Interactive program to play with the HashTable
  */
 
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -22,9 +23,68 @@ static constexpr char HELP_MESSAGE[] =
         "- `save`: saves the current table\n"
         "- `load`: loads the last saved table\n"
         "- `print`: prints the table\n"
+        "- `slowlog`: prints the slowest recent operations\n"
+        "- `slowlog_set {microseconds}`: logs operations at least this slow, a negative value disables the slowlog\n"
+        "- `metrics`: prints the table metrics in the Prometheus format\n"
         "- `exit`: exits interactive mode\n";
 
 static constexpr char SAVE_FILENAME[] = "interactive_mode_table.txt";
+static constexpr char METRICS_FILENAME[] = "interactive_mode_metrics.prom";
+static constexpr char METRICS_TMP_FILENAME[] = "interactive_mode_metrics.prom.tmp";
+
+/** @brief Set by SIGUSR1, the metrics are dumped by the main loop */
+static volatile sig_atomic_t metrics_requested = 0;
+
+static void request_metrics(int signal) {
+    metrics_requested = 1;
+}
+
+/**
+ * @brief Dumps the metrics of the table into METRICS_FILENAME
+ *
+ * Written into a temporary file first, then renamed, so scrapers like the node_exporter
+ * textfile collector never read a partial file.
+ */
+static void dump_metrics(const HashTable *table) {
+    FILE *file = fopen(METRICS_TMP_FILENAME, "w");
+    bool success = file != nullptr && hash_table_stats_write_prometheus(table, file);
+    if (file != nullptr && fclose(file) != 0) success = false;
+
+    if (success && rename(METRICS_TMP_FILENAME, METRICS_FILENAME) == 0) {
+        fprintf_color(stdout, OUTPUT_COLOR, "Metrics written to %s\n", METRICS_FILENAME);
+    } else {
+        remove(METRICS_TMP_FILENAME);
+        fprintf_color(stdout, ERROR_COLOR, "Failed to write metrics\n");
+    }
+}
+
+/** @brief Prints the entries of the slowlog, newest first */
+static void print_slowlog(void) {
+    static HashTableSlowlogEntry entries[HT_SLOWLOG_CAPACITY];
+    const size_t count = hash_table_slowlog_get(entries, HT_SLOWLOG_CAPACITY);
+
+    if (hash_table_slowlog_threshold() == HT_SLOWLOG_DISABLED) {
+        fprintf_color(stdout, OUTPUT_COLOR, "Slowlog is disabled, enable it with `slowlog_set`\n");
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const HashTableSlowlogEntry *entry = &entries[i];
+
+        fprintf_color(stdout, OUTPUT_COLOR, "#%llu %s", (unsigned long long) entry->id, hash_table_op_name(entry->op));
+        if (entry->op == HT_OP_INSERT || entry->op == HT_OP_GET || entry->op == HT_OP_DELETE) {
+            fprintf_color(stdout, OUTPUT_COLOR, " key=%d chain=%zu", entry->key, entry->chain_length);
+        }
+        fprintf_color(
+            stdout,
+            OUTPUT_COLOR,
+            " %.3f us size=%zu count=%zu%s\n",
+            (double) entry->duration_ns / 1e3,
+            entry->table_size,
+            entry->count,
+            entry->resized ? " resized" : ""
+        );
+    }
+}
 
 int main(void) {
     HashTable *table = hash_table_create();
@@ -35,10 +95,21 @@ int main(void) {
 
     printf("%s\n", WELCOME_MESSAGE);
 
+    // No SA_RESTART, so the signal interrupts the prompt and the metrics are dumped right away
+    struct sigaction action = {0};
+    action.sa_handler = request_metrics;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, nullptr);
+
     bool is_running = true;
     while (is_running) {
         const ParsedInput input = get_input(stdin, stdout);
 
+        if (metrics_requested) {
+            metrics_requested = 0;
+            dump_metrics(table);
+        }
+
         switch (input.cmd) {
             case CMD_ADD:
                 bool add_success = hash_table_insert(table, input.arg_key, input.arg_value);
@@ -77,15 +148,29 @@ int main(void) {
                     );
                     break;
                 }
-                HashTable *to_destory = table;
-                table = loaded_table;
-                hash_table_destroy(to_destory);
+                // The old contents are freed on the reclaimer thread, or right away in builds with debugmalloc
+                hash_table_swap(table, loaded_table);
+                hash_table_destroy_async(loaded_table);
                 break;
 
             case CMD_PRINT:
                 hash_table_print(table, false);
                 break;
 
+            case CMD_SLOWLOG:
+                print_slowlog();
+                break;
+
+            case CMD_SLOWLOG_SET:
+                hash_table_slowlog_set_threshold(
+                    input.arg_key < 0 ? HT_SLOWLOG_DISABLED : (uint64_t) input.arg_key * 1000
+                );
+                break;
+
+            case CMD_METRICS:
+                hash_table_stats_write_prometheus(table, stdout);
+                break;
+
             case CMD_EXIT:
                 is_running = false;
                 break;
@@ -105,6 +190,7 @@ int main(void) {
     }
 
     hash_table_destroy(table);
+    hash_table_reclaim_wait();
     remove(SAVE_FILENAME);
 
     return 0;
@@ -0,0 +1,242 @@
+#include <stdlib.h>
+
+#include "../munit.h"
+#include "../test_utils.h"
+
+/** @brief State of the counting allocator, refuses allocations above the budget */
+typedef struct {
+    size_t live_bytes;
+    size_t budget;
+    size_t allocations;
+    size_t bulk_allocations;
+} CountingAllocator;
+
+static void *counting_allocate(size_t size, void *user_data) {
+    CountingAllocator *counter = (CountingAllocator *) user_data;
+    if (counter->live_bytes + size > counter->budget) return nullptr;
+
+    counter->live_bytes += size;
+    counter->allocations++;
+    return malloc(size);
+}
+
+static void counting_deallocate(void *ptr, size_t size, void *user_data) {
+    CountingAllocator *counter = (CountingAllocator *) user_data;
+    counter->live_bytes -= size;
+    free(ptr);
+}
+
+static void *counting_allocate_bulk(size_t size, void *user_data) {
+    CountingAllocator *counter = (CountingAllocator *) user_data;
+    counter->bulk_allocations++;
+    return counting_allocate(size, user_data);
+}
+
+static HashTableAllocator counting_allocator(CountingAllocator *counter) {
+    return (HashTableAllocator){
+        .allocate = counting_allocate,
+        .deallocate = counting_deallocate,
+        .allocate_bulk = nullptr,
+        .deallocate_bulk = nullptr,
+        .user_data = counter,
+        .bulk_zeroed = false
+    };
+}
+
+static MunitResult
+test_alloc_accounting(const MunitParameter params[], void *fixture) {
+    CountingAllocator counter = {.budget = SIZE_MAX};
+    const HashTableAllocator allocator = counting_allocator(&counter);
+
+    HashTable *table = hash_table_create_with_allocator(&allocator);
+    munit_assert_not_null(table);
+    munit_assert_size(hash_table_allocated_bytes(table), ==, sizeof(Entry *) * HT_INITIAL_SIZE);
+    munit_assert_size(hash_table_allocated_bytes(table), ==, counter.live_bytes);
+
+    // Entries and resizes
+    for (int i = 0; i < 1000; i++) {
+        munit_assert_true(hash_table_insert(table, i, i));
+    }
+    munit_assert_size(table->resize_count, >, 0);
+    munit_assert_size(hash_table_allocated_bytes(table), ==, sizeof(Entry *) * table->size + sizeof(Entry) * 1000);
+    munit_assert_size(hash_table_allocated_bytes(table), ==, counter.live_bytes);
+
+    HashTableStats stats;
+    munit_assert_true(hash_table_stats(table, &stats));
+    munit_assert_size(stats.allocated_bytes, ==, counter.live_bytes);
+    munit_assert_size(stats.allocated_bytes, ==, stats.bucket_bytes + stats.entry_bytes);
+
+    for (int i = 0; i < 500; i++) {
+        munit_assert_true(hash_table_delete(table, i));
+    }
+    munit_assert_size(hash_table_allocated_bytes(table), ==, counter.live_bytes);
+
+    // A copy shares the entries and their accounting, a clone has its own
+    HashTable *copy = hash_table_copy(table);
+    HashTable *clone = hash_table_clone(table);
+    munit_assert_not_null(copy);
+    munit_assert_not_null(clone);
+    munit_assert_size(hash_table_allocated_bytes(copy), ==, hash_table_allocated_bytes(table));
+    munit_assert_size(
+        hash_table_allocated_bytes(table) + hash_table_allocated_bytes(clone), ==, counter.live_bytes
+    );
+
+    munit_assert_true(hash_table_insert(copy, -1, 0));
+    munit_assert_true(hash_table_delete(clone, 600));
+    munit_assert_true(hash_table_enable_merkle(clone));
+    munit_assert_size(
+        hash_table_allocated_bytes(table) + hash_table_allocated_bytes(clone), ==, counter.live_bytes
+    );
+
+    // Destroying the source keeps the entries still used by the copy
+    hash_table_destroy(table);
+    munit_assert_size(
+        hash_table_allocated_bytes(copy) + hash_table_allocated_bytes(clone), ==, counter.live_bytes
+    );
+
+    // The contents of a default table are swapped in, its allocator goes with them
+    HashTable *other = hash_table_create();
+    munit_assert_true(hash_table_insert(other, 1, 1));
+    const size_t other_bytes = hash_table_allocated_bytes(other);
+    munit_assert_true(hash_table_swap(clone, other));
+    munit_assert_size(hash_table_allocated_bytes(clone), ==, other_bytes);
+    munit_assert_size(
+        hash_table_allocated_bytes(copy) + hash_table_allocated_bytes(other), ==, counter.live_bytes
+    );
+
+    hash_table_destroy(copy);
+    hash_table_destroy(other);
+    munit_assert_size(counter.live_bytes, ==, 0);
+    munit_assert_size(counter.allocations, >, 0);
+
+    hash_table_destroy(clone);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_alloc_budget(const MunitParameter params[], void *fixture) {
+    CountingAllocator counter = {.budget = 4096};
+    const HashTableAllocator allocator = counting_allocator(&counter);
+
+    HashTable *table = hash_table_create_with_allocator(&allocator);
+    munit_assert_not_null(table);
+
+    // Inserts fail once the budget is spent, the table stays consistent
+    int inserted = 0;
+    while (hash_table_insert(table, inserted, inserted)) {
+        inserted++;
+    }
+    munit_assert_int(inserted, >, 0);
+    munit_assert_size(counter.live_bytes, <=, counter.budget);
+    munit_assert_size(hash_table_allocated_bytes(table), ==, counter.live_bytes);
+    munit_assert_size(table->count, ==, (size_t) inserted);
+
+    for (int i = 0; i < inserted; i++) {
+        munit_assert_not_null(hash_table_get(table, i));
+    }
+
+    // Freed memory can be reused
+    munit_assert_true(hash_table_delete(table, 0));
+    munit_assert_true(hash_table_insert(table, inserted, 0));
+
+    hash_table_destroy(table);
+    munit_assert_size(counter.live_bytes, ==, 0);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_alloc_bulk(const MunitParameter params[], void *fixture) {
+    CountingAllocator counter = {.budget = SIZE_MAX};
+    HashTableAllocator allocator = counting_allocator(&counter);
+
+    // Bulk functions come in pairs, and the single block functions are required
+    allocator.allocate_bulk = counting_allocate_bulk;
+    munit_assert_null(hash_table_create_with_allocator(&allocator));
+
+    allocator.deallocate_bulk = counting_deallocate;
+    allocator.allocate = nullptr;
+    munit_assert_null(hash_table_create_with_allocator(&allocator));
+
+    // Bucket arrays and node blocks are bulk allocations, entries aren't
+    allocator.allocate = counting_allocate;
+    HashTable *table = hash_table_create_with_allocator(&allocator);
+    munit_assert_not_null(table);
+    munit_assert_size(counter.bulk_allocations, ==, 1);
+
+    for (int i = 0; i < 30; i++) {
+        hash_table_insert(table, i, i);
+    }
+    munit_assert_size(counter.bulk_allocations, ==, 1);
+
+    HashTable *clone = hash_table_clone(table);
+    munit_assert_size(counter.bulk_allocations, ==, 3);
+
+    hash_table_destroy(clone);
+    hash_table_destroy(table);
+    munit_assert_size(counter.live_bytes, ==, 0);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_alloc_huge_pages(const MunitParameter params[], void *fixture) {
+    const HashTableAllocator allocator = hash_table_huge_page_allocator(HT_HUGE_PAGES_PREFAULT);
+    munit_assert_true(allocator.bulk_zeroed);
+
+    // Zeroed bulk blocks need bulk functions
+    HashTableAllocator invalid = counting_allocator(&(CountingAllocator){.budget = SIZE_MAX});
+    invalid.bulk_zeroed = true;
+    munit_assert_null(hash_table_create_with_allocator(&invalid));
+
+    // Grows past HT_HUGE_PAGE_SIZE, the larger bucket arrays are mapped and never cleared
+    HashTable *table = hash_table_create_with_allocator(&allocator);
+    munit_assert_not_null(table);
+
+    const int count = 400000;
+    for (int i = 0; i < count; i++) {
+        munit_assert_true(hash_table_insert(table, i, -i));
+    }
+    munit_assert_size(sizeof(Entry *) * table->size, >=, HT_HUGE_PAGE_SIZE);
+    munit_assert_size(hash_table_allocated_bytes(table), ==, sizeof(Entry *) * table->size + sizeof(Entry) * count);
+
+    for (int i = 0; i < count; i++) {
+        const Entry *entry = hash_table_get(table, i);
+        munit_assert_not_null(entry);
+        munit_assert_int(entry->value, ==, -i);
+    }
+
+    // Node blocks too, and the background resize faults the new array in without the lock
+    HashTable *clone = hash_table_clone(table);
+    munit_assert_true(hash_table_equal(table, clone));
+#ifdef CHASHTABLE_NO_DEBUGMALLOC
+    munit_assert_true(hash_table_enable_background_resize(clone));
+#endif
+
+    for (int i = count; i < count * 2; i++) {
+        munit_assert_true(hash_table_insert(clone, i, -i));
+    }
+    background_resize_wait(clone);
+    munit_assert_size(clone->count, ==, (size_t) count * 2);
+    munit_assert_size(clone->resize_count, >, 0);
+
+    const HashTableAllocator locked = hash_table_huge_page_allocator(HT_HUGE_PAGES_LOCK);
+    HashTable *locked_table = hash_table_create_with_allocator(&locked);
+    munit_assert_true(hash_table_merge(locked_table, table, nullptr, nullptr));
+    munit_assert_true(hash_table_equal(table, locked_table));
+
+    hash_table_destroy(locked_table);
+    hash_table_destroy(clone);
+    hash_table_destroy(table);
+
+    return MUNIT_OK;
+}
+
+MunitTest table_alloc[] = {
+    {"/accounting", test_alloc_accounting, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/budget", test_alloc_budget, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/bulk", test_alloc_bulk, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/huge_pages", test_alloc_huge_pages, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
+};
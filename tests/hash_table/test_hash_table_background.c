@@ -0,0 +1,175 @@
+#include <threads.h>
+
+#include "../munit.h"
+#include "../test_utils.h"
+
+static void count_entries(int key, int value, void *count) {
+    munit_assert_int(value, ==, key * 2);
+    *(size_t *) count += 1;
+}
+
+#ifdef CHASHTABLE_NO_DEBUGMALLOC
+static MunitResult
+test_background_resize(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+
+    munit_assert_false(hash_table_enable_background_resize(nullptr));
+    munit_assert_true(hash_table_enable_background_resize(table));
+    munit_assert_true(hash_table_enable_background_resize(table));
+
+    // Keep reading and writing while the maintenance thread migrates entries
+    for (int i = 0; i < 20000; i++) {
+        munit_assert_true(hash_table_insert(table, i, i * 2));
+
+        const Entry *entry = hash_table_get(table, i / 2);
+        munit_assert_not_null(entry);
+        munit_assert_int(entry->value, ==, (i / 2) * 2);
+    }
+
+    for (int i = 0; i < 20000; i += 4) {
+        munit_assert_true(hash_table_delete(table, i));
+        munit_assert_false(hash_table_delete(table, i));
+    }
+
+    // foreach waits for the running migration to finish
+    size_t count = 0;
+    hash_table_foreach(table, count_entries, &count);
+    munit_assert_size(count, ==, 15000);
+    munit_assert_size(table->count, ==, 15000);
+
+    const HashTableResizeProgress progress = hash_table_resize_progress(table);
+    munit_assert_false(progress.in_progress);
+    munit_assert_size(progress.resize_count, >, 0);
+    munit_assert_double(progress.total_duration_ms, >=, progress.last_duration_ms);
+    munit_assert_size(table->count, <=, table->load_threshold_count);
+
+    for (int i = 0; i < 20000; i++) {
+        const Entry *entry = hash_table_get(table, i);
+        if (i % 4 == 0) {
+            munit_assert_null(entry);
+        } else {
+            munit_assert_not_null(entry);
+            munit_assert_int(entry->value, ==, i * 2);
+        }
+    }
+
+    return MUNIT_OK;
+}
+#endif
+
+static MunitResult
+test_inline_resize_progress(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+
+    HashTableResizeProgress progress = hash_table_resize_progress(table);
+    munit_assert_size(progress.resize_count, ==, 0);
+
+    for (int i = 0; i < 1000; i++) {
+        hash_table_insert(table, i, i);
+    }
+
+    progress = hash_table_resize_progress(table);
+    munit_assert_false(progress.in_progress);
+    munit_assert_size(progress.resize_count, >, 0);
+
+    progress = hash_table_resize_progress(nullptr);
+    munit_assert_size(progress.resize_count, ==, 0);
+
+    return MUNIT_OK;
+}
+
+#ifdef CHASHTABLE_NO_DEBUGMALLOC
+static MunitResult
+test_operations_during_migration(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    munit_assert_true(hash_table_enable_background_resize(table));
+
+    for (int i = 0; i < 5000; i++) {
+        hash_table_insert(table, i, i * 2);
+    }
+    hash_table_foreach(table, count_entries, &(size_t){0});
+
+    // Cross the threshold with the migration paused after its first batch
+    background_resize_pause(table, true);
+    int key = 5000;
+    while (table->count <= table->load_threshold_count) {
+        hash_table_insert(table, key, key * 2);
+        key++;
+    }
+
+    HashTableResizeProgress progress = hash_table_resize_progress(table);
+    while (!progress.in_progress) {
+        thrd_yield();
+        progress = hash_table_resize_progress(table);
+    }
+
+    munit_assert_size(progress.migrated_buckets, >, 0);
+    munit_assert_size(progress.migrated_buckets, <, progress.total_buckets);
+
+    // Work against both arrays
+    for (int i = 0; i < 2000; i++, key++) {
+        munit_assert_true(hash_table_insert(table, key, key * 2));
+    }
+
+    for (int i = 0; i < key; i += 3) {
+        munit_assert_true(hash_table_delete(table, i));
+    }
+
+    int visits = 0;
+    HashTableIter iter;
+    hash_table_iter_init(&iter, table);
+    for (const Entry *entry = hash_table_iter_next(&iter); entry != nullptr; entry = hash_table_iter_next(&iter)) {
+        munit_assert_int(entry->key % 3, !=, 0);
+        munit_assert_int(entry->value, ==, entry->key * 2);
+        visits++;
+    }
+
+    for (int i = 0; i < key; i++) {
+        const Entry *entry = hash_table_get(table, i);
+        if (i % 3 == 0) munit_assert_null(entry);
+        else munit_assert_not_null(entry);
+    }
+
+    background_resize_pause(table, false);
+
+    size_t count = 0;
+    hash_table_foreach(table, count_entries, &count);
+    munit_assert_size(count, ==, (size_t) visits);
+    munit_assert_size(table->count, ==, (size_t) visits);
+
+    return MUNIT_OK;
+}
+#else
+static MunitResult
+test_background_unavailable(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+
+    // debugmalloc isn't thread-safe, so the table keeps resizing on the inserting thread
+    munit_assert_false(hash_table_enable_background_resize(table));
+
+    for (int i = 0; i < 1000; i++) {
+        munit_assert_true(hash_table_insert(table, i, i * 2));
+    }
+
+    const HashTableResizeProgress progress = hash_table_resize_progress(table);
+    munit_assert_false(progress.in_progress);
+    munit_assert_size(progress.resize_count, >, 0);
+
+    size_t count = 0;
+    hash_table_foreach(table, count_entries, &count);
+    munit_assert_size(count, ==, 1000);
+
+    return MUNIT_OK;
+}
+#endif
+
+MunitTest table_background[] = {
+#ifdef CHASHTABLE_NO_DEBUGMALLOC
+    {"/resize", test_background_resize, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/during_migration", test_operations_during_migration, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+#else
+    {"/unavailable", test_background_unavailable, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+#endif
+    {"/progress", test_inline_resize_progress, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
+};
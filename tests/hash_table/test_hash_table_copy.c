@@ -27,7 +27,212 @@ test_table_copy(const MunitParameter params[], void *fixture) {
     return MUNIT_OK;
 }
 
+static MunitResult
+test_copy_on_write(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+
+    for (int i = 0; i < 1000; i++) {
+        hash_table_insert(table, i, i);
+    }
+
+    HashTable *copy = hash_table_copy(table);
+    munit_assert_not_null(copy);
+
+    // Entries are shared until written
+    munit_assert_ptr_equal(hash_table_get(table, 1), hash_table_get(copy, 1));
+    munit_assert_ptr_equal(hash_table_get(table, 2), hash_table_get(copy, 2));
+
+    // Deleting a missing key doesn't duplicate its chunk
+    const size_t chunk = hash_function(1, copy->size) / HT_COW_CHUNK_BUCKETS;
+    int missing = 1000;
+    while (hash_function(missing, copy->size) / HT_COW_CHUNK_BUCKETS != chunk) missing++;
+    munit_assert_false(hash_table_delete(copy, missing));
+    munit_assert_ptr_equal(hash_table_get(table, 1), hash_table_get(copy, 1));
+
+    // Writes on either side stay private
+    hash_table_insert(table, 1, -1);
+    hash_table_delete(table, 2);
+    hash_table_insert(copy, 3, -3);
+    hash_table_insert(copy, 5000, 5000);
+
+    munit_assert_ptr_not_equal(hash_table_get(table, 1), hash_table_get(copy, 1));
+    munit_assert_int(hash_table_get(table, 1)->value, ==, -1);
+    munit_assert_int(hash_table_get(copy, 1)->value, ==, 1);
+    munit_assert_null(hash_table_get(table, 2));
+    munit_assert_int(hash_table_get(copy, 2)->value, ==, 2);
+    munit_assert_int(hash_table_get(table, 3)->value, ==, 3);
+    munit_assert_int(hash_table_get(copy, 3)->value, ==, -3);
+    munit_assert_null(hash_table_get(table, 5000));
+    munit_assert_size(table->count, ==, 999);
+    munit_assert_size(copy->count, ==, 1001);
+
+    // A copy of a copy, and a copy outliving its source
+    HashTable *second = hash_table_copy(copy);
+    munit_assert_not_null(second);
+    hash_table_destroy(copy);
+
+    // Resizing unshares everything before relinking
+    for (int i = 1000; i < 3000; i++) {
+        hash_table_insert(second, i, i * 2);
+    }
+
+    for (int i = 0; i < 1000; i++) {
+        const Entry *entry = hash_table_get(table, i);
+        if (i == 2) {
+            munit_assert_null(entry);
+            continue;
+        }
+
+        munit_assert_not_null(entry);
+        munit_assert_int(entry->value, ==, i == 1 ? -1 : i);
+
+        entry = hash_table_get(second, i);
+        munit_assert_not_null(entry);
+        munit_assert_int(entry->value, ==, i == 3 ? -3 : i);
+    }
+
+    munit_assert_int(hash_table_get(second, 2000)->value, ==, 4000);
+    munit_assert_size(second->count, ==, 3001);
+
+    hash_table_destroy(second);
+
+    return MUNIT_OK;
+}
+
+#ifdef CHASHTABLE_NO_DEBUGMALLOC
+static MunitResult
+test_copy_background(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    munit_assert_true(hash_table_enable_background_resize(table));
+
+    for (int i = 0; i < 5000; i++) {
+        hash_table_insert(table, i, i);
+    }
+
+    HashTable *copy = hash_table_copy(table);
+    munit_assert_not_null(copy);
+    munit_assert_true(hash_table_equal(copy, table));
+
+    // The migration started by these inserts unshares the source
+    for (int i = 5000; i < 20000; i++) {
+        hash_table_insert(table, i, i);
+    }
+    for (int i = 0; i < 5000; i += 2) {
+        hash_table_delete(table, i);
+    }
+
+    munit_assert_size(copy->count, ==, 5000);
+    for (int i = 0; i < 5000; i++) {
+        munit_assert_int(hash_table_get(copy, i)->value, ==, i);
+    }
+
+    hash_table_destroy(copy);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_copy_resize_start(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    munit_assert_true(hash_table_enable_background_resize(table));
+
+    // Copy right after each resize is requested, while the new array may still be prepared
+    int key = 0;
+    for (int round = 0; round < 6; round++) {
+        while (table->count <= table->load_threshold_count) {
+            hash_table_insert(table, key, -key);
+            key++;
+        }
+
+        HashTable *copy = hash_table_copy(table);
+        munit_assert_not_null(copy);
+        background_resize_wait(table);
+
+        munit_assert_size(copy->count, ==, (size_t) key);
+        for (int i = 0; i < key; i++) {
+            munit_assert_int(hash_table_get(copy, i)->value, ==, -i);
+        }
+        munit_assert_true(hash_table_equal(copy, table));
+        hash_table_destroy(copy);
+    }
+
+    // Every request resized once, a second resize would leave a quarter of the threshold
+    munit_assert_size(table->count, <=, table->load_threshold_count);
+    munit_assert_size(table->count * 3, >, table->load_threshold_count);
+
+    return MUNIT_OK;
+}
+#endif
+
+static MunitResult
+test_table_clone(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+
+    munit_assert_null(hash_table_clone(nullptr));
+
+    HashTable *empty = hash_table_clone(table);
+    munit_assert_not_null(empty);
+    munit_assert_size(empty->count, ==, 0);
+    hash_table_destroy(empty);
+
+    for (int i = 0; i < 1000; i++) {
+        hash_table_insert(table, i, i);
+    }
+
+    HashTable *clone = hash_table_clone(table);
+    munit_assert_not_null(clone);
+    munit_assert_true(hash_table_equal(table, clone));
+    munit_assert_size(clone->size, ==, table->size);
+
+    // Same chains in the same order, nothing shared
+    for (size_t i = 0; i < table->size; i++) {
+        const Entry *entry = table->buckets[i];
+        const Entry *cloned = clone->buckets[i];
+        for (; entry != nullptr && cloned != nullptr; entry = entry->next, cloned = cloned->next) {
+            munit_assert_ptr_not_equal(entry, cloned);
+            munit_assert_int(entry->key, ==, cloned->key);
+            munit_assert_int(entry->value, ==, cloned->value);
+        }
+        munit_assert_null(entry);
+        munit_assert_null(cloned);
+    }
+
+    // Entries of the block are freed one by one, the copy keeps the block alive
+    for (int i = 0; i < 1000; i += 2) {
+        munit_assert_true(hash_table_delete(clone, i));
+    }
+
+    HashTable *copy = hash_table_copy(clone);
+    munit_assert_not_null(copy);
+    hash_table_destroy(clone);
+
+    for (int i = 1000; i < 2000; i++) {
+        hash_table_insert(copy, i, i);
+    }
+
+    for (int i = 0; i < 2000; i++) {
+        const Entry *entry = hash_table_get(copy, i);
+        if (i < 1000 && i % 2 == 0) {
+            munit_assert_null(entry);
+        } else {
+            munit_assert_not_null(entry);
+            munit_assert_int(entry->value, ==, i);
+        }
+    }
+
+    munit_assert_size(table->count, ==, 1000);
+    hash_table_destroy(copy);
+
+    return MUNIT_OK;
+}
+
 MunitTest table_copy[] = {
     {"/copy", test_table_copy, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/copy_on_write", test_copy_on_write, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+#ifdef CHASHTABLE_NO_DEBUGMALLOC
+    {"/copy_background", test_copy_background, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/copy_resize_start", test_copy_resize_start, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+#endif
+    {"/clone", test_table_clone, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
     {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
 };
@@ -1,3 +1,7 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <threads.h>
+
 #include "../munit.h"
 #include "../test_utils.h"
 
@@ -23,8 +27,178 @@ test_destroy(const MunitParameter params[], void *fixture) {
     return MUNIT_OK;
 }
 
+static MunitResult
+test_clear(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+
+    for (int i = 0; i < 1000; i++) {
+        hash_table_insert(table, i, i);
+    }
+    munit_assert_true(hash_table_enable_merkle(table));
+    HashTable *snapshot = hash_table_copy(table);
+
+    const size_t size = table->size;
+    munit_assert_true(hash_table_clear(table));
+    munit_assert_false(hash_table_clear(nullptr));
+
+    munit_assert_size(table->count, ==, 0);
+    munit_assert_size(table->size, ==, size);
+    munit_assert_uint64(table->fingerprint, ==, 0);
+    munit_assert_uint64(table->merkle[1], ==, 0);
+    munit_assert_null(hash_table_get(table, 1));
+
+    // Refilling doesn't resize, the snapshot is untouched
+    const size_t resizes = table->resize_count;
+    for (int i = 0; i < 1000; i++) {
+        hash_table_insert(table, i, -i);
+    }
+    munit_assert_size(table->resize_count, ==, resizes);
+    munit_assert_size(snapshot->count, ==, 1000);
+    munit_assert_int(hash_table_get(snapshot, 5)->value, ==, 5);
+
+    hash_table_destroy(snapshot);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_swap_move(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    HashTable *other = hash_table_create();
+
+    hash_table_insert(table, 1, 10);
+    for (int i = 0; i < 100; i++) {
+        hash_table_insert(other, i, i * 2);
+    }
+    hash_table_set_parallel_resize(table, 0, 2);
+
+    munit_assert_true(hash_table_swap(table, other));
+    munit_assert_size(table->count, ==, 100);
+    munit_assert_size(other->count, ==, 1);
+    munit_assert_int(hash_table_get(table, 50)->value, ==, 100);
+    munit_assert_int(hash_table_get(other, 1)->value, ==, 10);
+
+    // Settings stay with the table
+    munit_assert_size(table->resize_threads, ==, 2);
+    munit_assert_size(other->resize_threads, ==, HT_PARALLEL_RESIZE_THREADS);
+
+    munit_assert_true(hash_table_swap(table, table));
+    munit_assert_false(hash_table_swap(table, nullptr));
+
+    munit_assert_true(hash_table_move_into(table, other));
+    munit_assert_size(table->count, ==, 1);
+    munit_assert_int(hash_table_get(table, 1)->value, ==, 10);
+    munit_assert_false(hash_table_move_into(table, table));
+
+    return MUNIT_OK;
+}
+
+/** @brief State of an allocator recording which thread frees the memory */
+typedef struct {
+    thrd_t caller;              /**< Thread running the test */
+    atomic_size_t live_bytes;   /**< Allocated and not yet freed */
+    atomic_size_t caller_frees; /**< Deallocations on the caller thread */
+    atomic_size_t other_frees;  /**< Deallocations on any other thread */
+    atomic_bool hold;           /**< Deallocations off the caller thread wait while set */
+} ThreadAllocator;
+
+static void *thread_allocate(size_t size, void *user_data) {
+    ThreadAllocator *state = (ThreadAllocator *) user_data;
+    atomic_fetch_add(&state->live_bytes, size);
+    return malloc(size);
+}
+
+static void thread_deallocate(void *ptr, size_t size, void *user_data) {
+    ThreadAllocator *state = (ThreadAllocator *) user_data;
+    const bool caller = thrd_equal(thrd_current(), state->caller);
+    while (!caller && atomic_load(&state->hold)) {
+        thrd_yield();
+    }
+
+    atomic_fetch_add(caller ? &state->caller_frees : &state->other_frees, 1);
+    atomic_fetch_sub(&state->live_bytes, size);
+    free(ptr);
+}
+
+static MunitResult
+test_destroy_async(const MunitParameter params[], void *fixture) {
+    munit_assert_false(hash_table_destroy_async(nullptr));
+
+    for (int t = 0; t < 4; t++) {
+        HashTable *table = hash_table_create();
+        for (int i = 0; i < 1000; i++) {
+            hash_table_insert(table, i, i);
+        }
+#ifdef CHASHTABLE_NO_DEBUGMALLOC
+        if (t % 2 == 1) munit_assert_true(hash_table_enable_background_resize(table));
+#endif
+
+        munit_assert_true(hash_table_destroy_async(table));
+    }
+
+    hash_table_reclaim_wait();
+
+    ThreadAllocator state = {.caller = thrd_current()};
+    const HashTableAllocator allocator = {
+        .allocate = thread_allocate,
+        .deallocate = thread_deallocate,
+        .allocate_bulk = nullptr,
+        .deallocate_bulk = nullptr,
+        .user_data = &state,
+        .bulk_zeroed = false
+    };
+
+    HashTable *tables[4];
+    for (int t = 0; t < 4; t++) {
+        tables[t] = hash_table_create_with_allocator(&allocator);
+        munit_assert_not_null(tables[t]);
+#ifdef CHASHTABLE_NO_DEBUGMALLOC
+        if (t % 2 == 1) munit_assert_true(hash_table_enable_background_resize(tables[t]));
+#endif
+        for (int i = 0; i < 1000; i++) {
+            munit_assert_true(hash_table_insert(tables[t], i, i));
+        }
+        background_resize_wait(tables[t]);
+    }
+
+    const size_t caller_frees = atomic_load(&state.caller_frees);
+    const size_t other_frees = atomic_load(&state.other_frees);
+
+#ifdef CHASHTABLE_NO_DEBUGMALLOC
+    // Nothing is freed until the reclaimer thread may go on
+    atomic_store(&state.hold, true);
+    for (int t = 0; t < 4; t++) {
+        munit_assert_true(hash_table_destroy_async(tables[t]));
+    }
+    munit_assert_size(atomic_load(&state.live_bytes), >, 0);
+    munit_assert_size(atomic_load(&state.other_frees), ==, other_frees);
+
+    atomic_store(&state.hold, false);
+    hash_table_reclaim_wait();
+
+    // Everything was freed off the caller thread, and the queue is drained
+    munit_assert_size(atomic_load(&state.live_bytes), ==, 0);
+    munit_assert_size(atomic_load(&state.caller_frees), ==, caller_frees);
+    munit_assert_size(atomic_load(&state.other_frees), >=, other_frees + 4 * 1000);
+#else
+    // debugmalloc isn't thread-safe, the tables are destroyed right away on the caller thread
+    for (int t = 0; t < 4; t++) {
+        munit_assert_true(hash_table_destroy_async(tables[t]));
+    }
+    munit_assert_size(atomic_load(&state.live_bytes), ==, 0);
+    munit_assert_size(atomic_load(&state.caller_frees), >=, caller_frees + 4 * 1000);
+    munit_assert_size(atomic_load(&state.other_frees), ==, other_frees);
+    hash_table_reclaim_wait();
+#endif
+
+    return MUNIT_OK;
+}
+
 MunitTest table_create_destroy[] = {
     {"/create", test_create, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
     {"/destroy", test_destroy, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/destroy_async", test_destroy_async, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/clear", test_clear, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/swap_move", test_swap_move, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
     {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
 };
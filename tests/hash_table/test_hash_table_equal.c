@@ -22,7 +22,45 @@ test_table_eq(const MunitParameter params[], void *fixture) {
     return MUNIT_OK;
 }
 
+static MunitResult
+test_table_fingerprint(const MunitParameter params[], void *fixture) {
+    HashTable *forward = hash_table_create();
+    HashTable *backward = hash_table_create();
+
+    // Same contents in a different order and table size
+    for (int i = 0; i < 1000; i++) {
+        hash_table_insert(forward, i, i * 3);
+        hash_table_insert(backward, 999 - i, (999 - i) * 3);
+    }
+    hash_table_insert(backward, 5000, 1);
+    hash_table_delete(backward, 5000);
+
+    munit_assert_uint64(forward->fingerprint, ==, backward->fingerprint);
+    munit_assert_true(hash_table_equal(forward, backward));
+
+    // An update keeps the count but changes the fingerprint
+    hash_table_insert(backward, 10, 0);
+    munit_assert_size(forward->count, ==, backward->count);
+    munit_assert_uint64(forward->fingerprint, !=, backward->fingerprint);
+    munit_assert_false(hash_table_equal(forward, backward));
+
+    hash_table_insert(backward, 10, 30);
+    munit_assert_uint64(forward->fingerprint, ==, backward->fingerprint);
+
+    // Deleting everything brings it back to the empty fingerprint
+    for (int i = 0; i < 1000; i++) {
+        hash_table_delete(forward, i);
+    }
+    munit_assert_uint64(forward->fingerprint, ==, 0);
+
+    hash_table_destroy(forward);
+    hash_table_destroy(backward);
+
+    return MUNIT_OK;
+}
+
 MunitTest table_equal[] = {
     {"/equal", test_table_eq, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/fingerprint", test_table_fingerprint, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
     {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
 };
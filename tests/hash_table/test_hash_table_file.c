@@ -0,0 +1,210 @@
+#include <signal.h>
+#include <stdio.h>
+#include <sys/resource.h>
+
+#include "../munit.h"
+#include "../test_utils.h"
+
+/** @brief Copies a file as it is on disk, like a snapshot taken by a crash */
+static void copy_file(const char *source, const char *destination) {
+    FILE *in = fopen(source, "rb");
+    FILE *out = fopen(destination, "wb");
+    munit_assert_not_null(in);
+    munit_assert_not_null(out);
+
+    int byte;
+    while ((byte = fgetc(in)) != EOF) {
+        fputc(byte, out);
+    }
+
+    fclose(in);
+    fclose(out);
+}
+
+static void insert_into_table(int key, int value, void *user_data) {
+    hash_table_insert((HashTable *) user_data, key, value);
+}
+
+static MunitResult
+test_file_operations(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    const char filename[] = "test_file_operations.htf";
+
+    HashTableFile *file = hash_table_file_create(filename);
+    munit_assert_not_null(file);
+
+    // Grows through several resizes, same operations on a HashTable for reference
+    for (int i = 0; i < 5000; i++) {
+        munit_assert_true(hash_table_file_insert(file, i * 7, i));
+        hash_table_insert(table, i * 7, i);
+    }
+    for (int i = 0; i < 5000; i += 3) {
+        munit_assert_true(hash_table_file_delete(file, i * 7));
+        hash_table_delete(table, i * 7);
+    }
+    for (int i = 0; i < 5000; i += 5) {
+        munit_assert_true(hash_table_file_insert(file, i * 7, -i));
+        hash_table_insert(table, i * 7, -i);
+    }
+    munit_assert_false(hash_table_file_delete(file, 3));
+
+    munit_assert_size(hash_table_file_count(file), ==, table->count);
+    for (int i = 0; i < 5000; i++) {
+        int value;
+        const Entry *entry = hash_table_get(table, i * 7);
+        munit_assert_int(hash_table_file_get(file, i * 7, &value), ==, entry != nullptr);
+        if (entry != nullptr) munit_assert_int(value, ==, entry->value);
+    }
+
+    HashTable *contents = hash_table_create();
+    hash_table_file_foreach(file, insert_into_table, contents);
+    munit_assert_true(hash_table_equal(table, contents));
+    hash_table_destroy(contents);
+
+    munit_assert_true(hash_table_file_close(file));
+    munit_assert_int(remove(filename), ==, 0);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_file_reopen(const MunitParameter params[], void *fixture) {
+    const char filename[] = "test_file_reopen.htf";
+
+    HashTableFile *file = hash_table_file_create(filename);
+    munit_assert_not_null(file);
+    for (int i = 0; i < 1000; i++) {
+        munit_assert_true(hash_table_file_insert(file, i, i * 2));
+    }
+    munit_assert_true(hash_table_file_close(file));
+
+    // Served straight from the file, and writable again
+    munit_assert_int(hash_table_file_open(filename, &file), ==, HT_LOAD_OK);
+    munit_assert_size(hash_table_file_count(file), ==, 1000);
+    for (int i = 0; i < 1000; i++) {
+        int value;
+        munit_assert_true(hash_table_file_get(file, i, &value));
+        munit_assert_int(value, ==, i * 2);
+    }
+    munit_assert_true(hash_table_file_delete(file, 0));
+    munit_assert_true(hash_table_file_insert(file, 5000, 1));
+    munit_assert_true(hash_table_file_close(file));
+
+    munit_assert_int(hash_table_file_open(filename, &file), ==, HT_LOAD_OK);
+    munit_assert_size(hash_table_file_count(file), ==, 1000);
+    munit_assert_false(hash_table_file_get(file, 0, nullptr));
+    munit_assert_true(hash_table_file_get(file, 5000, nullptr));
+    munit_assert_true(hash_table_file_close(file));
+
+    munit_assert_int(remove(filename), ==, 0);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_file_unclean(const MunitParameter params[], void *fixture) {
+    const char filename[] = "test_file_unclean.htf";
+    const char crashed[] = "test_file_unclean_crashed.htf";
+
+    HashTableFile *file = hash_table_file_create(filename);
+    munit_assert_not_null(file);
+
+    // Lookups don't dirty the file
+    munit_assert_false(hash_table_file_get(file, 1, nullptr));
+    copy_file(filename, crashed);
+    HashTableFile *copy = nullptr;
+    munit_assert_int(hash_table_file_open(crashed, &copy), ==, HT_LOAD_OK);
+    hash_table_file_close(copy);
+
+    // Modified since the last checkpoint, as if the process died now
+    munit_assert_true(hash_table_file_insert(file, 1, 1));
+    copy_file(filename, crashed);
+    munit_assert_int(hash_table_file_open(crashed, &copy), ==, HT_LOAD_ERROR_UNCLEAN_SHUTDOWN);
+    munit_assert_null(copy);
+
+    munit_assert_true(hash_table_file_checkpoint(file));
+    copy_file(filename, crashed);
+    munit_assert_int(hash_table_file_open(crashed, &copy), ==, HT_LOAD_OK);
+    munit_assert_true(hash_table_file_get(copy, 1, nullptr));
+    hash_table_file_close(copy);
+
+    munit_assert_true(hash_table_file_close(file));
+
+    // Damaged or foreign files
+    FILE *damaged = fopen(crashed, "r+b");
+    munit_assert_not_null(damaged);
+    fseek(damaged, 40, SEEK_SET);
+    fputc(0x7f, damaged);
+    fclose(damaged);
+    munit_assert_int(hash_table_file_open(crashed, &copy), ==, HT_LOAD_ERROR_CHECKSUM);
+
+    HashTable *table = hash_table_create();
+    munit_assert_true(hash_table_save(table, crashed));
+    munit_assert_int(hash_table_file_open(crashed, &copy), ==, HT_LOAD_ERROR_INVALID_HEADER);
+    hash_table_destroy(table);
+
+    munit_assert_int(hash_table_file_open("test_file_missing.htf", &copy), ==, HT_LOAD_ERROR_FILE_OPEN);
+
+    munit_assert_int(remove(crashed), ==, 0);
+    munit_assert_int(remove(filename), ==, 0);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_file_full(const MunitParameter params[], void *fixture) {
+    const char filename[] = "test_file_full.htf";
+
+    HashTableFile *file = hash_table_file_create(filename);
+    munit_assert_not_null(file);
+    int key = 0;
+    for (; key < 1000; key++) {
+        munit_assert_true(hash_table_file_insert(file, key, key));
+    }
+
+    // The file can't grow anymore, like on a full disk
+    struct stat st;
+    munit_assert_int(stat(filename, &st), ==, 0);
+    struct rlimit limit;
+    munit_assert_int(getrlimit(RLIMIT_FSIZE, &limit), ==, 0);
+    const struct rlimit saved = limit;
+    limit.rlim_cur = (rlim_t) st.st_size;
+    void (*handler)(int) = signal(SIGXFSZ, SIG_IGN);
+    munit_assert_int(setrlimit(RLIMIT_FSIZE, &limit), ==, 0);
+
+    // Inserts fail once the nodes run out, instead of faulting on unallocated pages
+    while (hash_table_file_insert(file, key, key)) {
+        key++;
+    }
+    munit_assert_true(hash_table_file_insert(file, 0, -1));
+
+    munit_assert_int(setrlimit(RLIMIT_FSIZE, &saved), ==, 0);
+    signal(SIGXFSZ, handler);
+
+    munit_assert_size(hash_table_file_count(file), ==, (size_t) key);
+    for (int i = 0; i < key; i++) {
+        int value;
+        munit_assert_true(hash_table_file_get(file, i, &value));
+        munit_assert_int(value, ==, i == 0 ? -1 : i);
+    }
+
+    // Grows again once there is room
+    munit_assert_true(hash_table_file_insert(file, key, key));
+    munit_assert_true(hash_table_file_close(file));
+
+    munit_assert_int(hash_table_file_open(filename, &file), ==, HT_LOAD_OK);
+    munit_assert_size(hash_table_file_count(file), ==, (size_t) key + 1);
+    munit_assert_true(hash_table_file_close(file));
+
+    munit_assert_int(remove(filename), ==, 0);
+
+    return MUNIT_OK;
+}
+
+MunitTest table_file[] = {
+    {"/operations", test_file_operations, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/reopen", test_file_reopen, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/unclean", test_file_unclean, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/full", test_file_full, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
+};
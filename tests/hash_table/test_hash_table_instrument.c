@@ -0,0 +1,161 @@
+#include <threads.h>
+
+#include "../munit.h"
+#include "../test_utils.h"
+
+static MunitResult
+test_latency_buckets(const MunitParameter params[], void *fixture) {
+    // Exact below 8 ns, 8 buckets per power of two above
+    for (uint64_t ns = 0; ns < 8; ns++) {
+        munit_assert_size(hash_table_latency_bucket(ns), ==, ns);
+    }
+    munit_assert_size(hash_table_latency_bucket(8), ==, 8);
+    munit_assert_size(hash_table_latency_bucket(15), ==, 15);
+    munit_assert_size(hash_table_latency_bucket(16), ==, 16);
+    munit_assert_size(hash_table_latency_bucket(17), ==, 16);
+    munit_assert_size(hash_table_latency_bucket(18), ==, 17);
+    munit_assert_size(hash_table_latency_bucket(UINT64_MAX), ==, HT_LATENCY_BUCKETS - 1);
+
+    // Every bucket starts at its lower bound, and values stay within 12.5% of it
+    for (size_t bucket = 0; bucket < HT_LATENCY_BUCKETS; bucket++) {
+        const uint64_t value = hash_table_latency_bucket_value(bucket);
+        munit_assert_size(hash_table_latency_bucket(value), ==, bucket);
+        if (bucket > 0) munit_assert_size(hash_table_latency_bucket(value - 1), ==, bucket - 1);
+    }
+
+    for (uint64_t ns = 1; ns < 1000000; ns = ns * 3 + 1) {
+        const uint64_t lower = hash_table_latency_bucket_value(hash_table_latency_bucket(ns));
+        munit_assert_uint64(lower, <=, ns);
+        munit_assert_uint64(ns - lower, <=, ns / 8);
+    }
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_latency_percentile(const MunitParameter params[], void *fixture) {
+    static HashTableInstrumentation snapshot = {0};
+
+    munit_assert_uint64(hash_table_latency_percentile(&snapshot, HT_OP_GET, 99.0), ==, 0);
+    munit_assert_uint64(hash_table_latency_percentile(nullptr, HT_OP_GET, 99.0), ==, 0);
+
+    // 98 fast gets and 2 slow ones
+    snapshot.latency[HT_OP_GET][hash_table_latency_bucket(100)] = 98;
+    snapshot.latency[HT_OP_GET][hash_table_latency_bucket(100000)] = 2;
+
+    const uint64_t fast = hash_table_latency_bucket_value(hash_table_latency_bucket(100));
+    const uint64_t slow = hash_table_latency_bucket_value(hash_table_latency_bucket(100000));
+    munit_assert_uint64(hash_table_latency_percentile(&snapshot, HT_OP_GET, 0.0), ==, fast);
+    munit_assert_uint64(hash_table_latency_percentile(&snapshot, HT_OP_GET, 50.0), ==, fast);
+    munit_assert_uint64(hash_table_latency_percentile(&snapshot, HT_OP_GET, 98.0), ==, fast);
+    munit_assert_uint64(hash_table_latency_percentile(&snapshot, HT_OP_GET, 99.0), ==, slow);
+    munit_assert_uint64(hash_table_latency_percentile(&snapshot, HT_OP_GET, 100.0), ==, slow);
+    munit_assert_uint64(hash_table_latency_percentile(&snapshot, HT_OP_INSERT, 99.0), ==, 0);
+
+    return MUNIT_OK;
+}
+
+#ifdef CHASHTABLE_INSTRUMENT
+
+/** @brief Sum of a latency histogram */
+static uint64_t latency_samples(const HashTableInstrumentation *snapshot, HashTableOp op) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < HT_LATENCY_BUCKETS; i++) {
+        total += snapshot->latency[op][i];
+    }
+
+    return total;
+}
+
+static int lookup_thread(void *arg) {
+    const HashTable *table = (const HashTable *) arg;
+
+    for (int i = 0; i < 100; i++) {
+        hash_table_get(table, i);
+    }
+
+    return 0;
+}
+
+static MunitResult
+test_counters(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    static HashTableInstrumentation snapshot;
+
+    hash_table_instrumentation_reset();
+    munit_assert_true(hash_table_instrumentation_snapshot(&snapshot));
+    munit_assert_uint64(snapshot.counters[HT_COUNTER_INSERT_NEW], ==, 0);
+    munit_assert_uint64(latency_samples(&snapshot, HT_OP_INSERT), ==, 0);
+
+    for (int i = 0; i < 100; i++) {
+        hash_table_insert(table, i, i);
+    }
+    for (int i = 0; i < 10; i++) {
+        hash_table_insert(table, i, -i);
+    }
+    for (int i = 0; i < 20; i++) {
+        hash_table_get(table, i * 10);
+    }
+    hash_table_delete(table, 5);
+    hash_table_delete(table, 5);
+
+    munit_assert_true(hash_table_instrumentation_snapshot(&snapshot));
+    munit_assert_uint64(snapshot.counters[HT_COUNTER_INSERT_NEW], ==, 100);
+    munit_assert_uint64(snapshot.counters[HT_COUNTER_INSERT_UPDATES], ==, 10);
+    munit_assert_uint64(snapshot.counters[HT_COUNTER_GET_HITS], ==, 10);
+    munit_assert_uint64(snapshot.counters[HT_COUNTER_GET_MISSES], ==, 10);
+    munit_assert_uint64(snapshot.counters[HT_COUNTER_DELETE_HITS], ==, 1);
+    munit_assert_uint64(snapshot.counters[HT_COUNTER_DELETE_MISSES], ==, 1);
+    // Every update and hit compares at least the matching entry
+    munit_assert_uint64(snapshot.counters[HT_COUNTER_NODES_TRAVERSED], >=, 21);
+    munit_assert_uint64(snapshot.counters[HT_COUNTER_RESIZES], ==, table->resize_count);
+    munit_assert_uint64(snapshot.counters[HT_COUNTER_RESIZE_NS], ==, table->resize_total_ns);
+
+    munit_assert_uint64(latency_samples(&snapshot, HT_OP_INSERT), ==, 110);
+    munit_assert_uint64(latency_samples(&snapshot, HT_OP_GET), ==, 20);
+    munit_assert_uint64(latency_samples(&snapshot, HT_OP_DELETE), ==, 2);
+    munit_assert_uint64(latency_samples(&snapshot, HT_OP_RESIZE), ==, table->resize_count);
+
+    // The counts of an exited thread are kept
+    thrd_t thread;
+    munit_assert_int(thrd_create(&thread, lookup_thread, table), ==, thrd_success);
+    thrd_join(thread, nullptr);
+
+    munit_assert_true(hash_table_instrumentation_snapshot(&snapshot));
+    munit_assert_uint64(snapshot.counters[HT_COUNTER_GET_HITS], ==, 10 + 99);
+    munit_assert_uint64(snapshot.counters[HT_COUNTER_GET_MISSES], ==, 10 + 1);
+    munit_assert_uint64(latency_samples(&snapshot, HT_OP_GET), ==, 120);
+
+    hash_table_instrumentation_reset();
+    munit_assert_true(hash_table_instrumentation_snapshot(&snapshot));
+    munit_assert_uint64(snapshot.counters[HT_COUNTER_GET_HITS], ==, 0);
+    munit_assert_uint64(latency_samples(&snapshot, HT_OP_GET), ==, 0);
+
+    return MUNIT_OK;
+}
+
+#else
+
+static MunitResult
+test_counters(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    HashTableInstrumentation snapshot;
+
+    hash_table_insert(table, 1, 1);
+
+    // Compiled out, nothing is counted
+    munit_assert_false(hash_table_instrumentation_snapshot(&snapshot));
+    munit_assert_uint64(snapshot.counters[HT_COUNTER_INSERT_NEW], ==, 0);
+    hash_table_instrumentation_reset();
+
+    return MUNIT_OK;
+}
+
+#endif
+
+MunitTest table_instrument[] = {
+    {"/latency_buckets", test_latency_buckets, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/latency_percentile", test_latency_percentile, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/counters", test_counters, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
+};
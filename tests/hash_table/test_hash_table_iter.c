@@ -0,0 +1,154 @@
+#include "../munit.h"
+#include "../test_utils.h"
+
+static void count_visits(int key, int value, void *visits) {
+    munit_assert_int(value, ==, key + 1);
+    if (key < 1000) ((int *) visits)[key]++;
+}
+
+static MunitResult
+test_iter(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+
+    for (int i = 0; i < 1000; i++) {
+        hash_table_insert(table, i, i + 1);
+    }
+
+    int visits[1000] = {0};
+    int visited = 0;
+    int next_key = 1000;
+    const size_t resizes_before = hash_table_resize_progress(table).resize_count;
+
+    HashTableIter iter;
+    hash_table_iter_init(&iter, table);
+
+    const Entry *entry;
+    while ((entry = hash_table_iter_next(&iter)) != nullptr) {
+        munit_assert_int(entry->value, ==, entry->key + 1);
+        if (entry->key < 1000) visits[entry->key]++;
+        visited++;
+
+        // Interleave inserts, they trigger several resizes during the iteration
+        for (int i = 0; i < 5 && next_key < 5000; i++, next_key++) {
+            hash_table_insert(table, next_key, next_key + 1);
+        }
+    }
+
+    munit_assert_size(hash_table_resize_progress(table).resize_count, >, resizes_before);
+    for (int i = 0; i < 1000; i++) {
+        munit_assert_int(visits[i], ==, 1);
+    }
+
+    // A finished iterator stays finished
+    munit_assert_null(hash_table_iter_next(&iter));
+    munit_assert_int(visited, <=, next_key);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_iter_early_stop(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+
+    HashTableIter iter;
+    hash_table_iter_init(&iter, table);
+    munit_assert_null(hash_table_iter_next(&iter));
+
+    hash_table_iter_init(&iter, nullptr);
+    munit_assert_null(hash_table_iter_next(&iter));
+
+    for (int i = 0; i < 100; i++) {
+        hash_table_insert(table, i, i + 1);
+    }
+
+    hash_table_iter_init(&iter, table);
+    const Entry *first = hash_table_iter_next(&iter);
+    munit_assert_not_null(first);
+
+    // Deleting the returned entry doesn't invalidate the iterator
+    hash_table_delete(table, first->key);
+
+    int visited = 1;
+    while (hash_table_iter_next(&iter) != nullptr) {
+        visited++;
+        if (visited == 50) break;
+    }
+
+    munit_assert_int(visited, ==, 50);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_scan(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+
+    for (int i = 0; i < 1000; i++) {
+        hash_table_insert(table, i, i + 1);
+    }
+
+    int visits[1000] = {0};
+    int next_key = 1000;
+    int calls = 0;
+    const size_t resizes_before = hash_table_resize_progress(table).resize_count;
+
+    uint64_t cursor = 0;
+    do {
+        cursor = hash_table_scan(table, cursor, 3, count_visits, visits);
+        calls++;
+
+        // Resize between calls
+        for (int i = 0; i < 20 && next_key < 5000; i++, next_key++) {
+            hash_table_insert(table, next_key, next_key + 1);
+        }
+    } while (cursor != 0);
+
+    munit_assert_int(calls, >, 1);
+    munit_assert_size(hash_table_resize_progress(table).resize_count, >, resizes_before);
+    for (int i = 0; i < 1000; i++) {
+        munit_assert_int(visits[i], ==, 1);
+    }
+
+    munit_assert_uint64(hash_table_scan(nullptr, 0, 1, count_visits, visits), ==, 0);
+
+    return MUNIT_OK;
+}
+
+#ifdef CHASHTABLE_NO_DEBUGMALLOC
+static MunitResult
+test_scan_background_resize(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    munit_assert_true(hash_table_enable_background_resize(table));
+
+    for (int i = 0; i < 1000; i++) {
+        hash_table_insert(table, i, i + 1);
+    }
+
+    // Migrations run while the scan is in progress
+    int visits[1000] = {0};
+    int next_key = 1000;
+    uint64_t cursor = 0;
+    do {
+        cursor = hash_table_scan(table, cursor, 1, count_visits, visits);
+        for (int i = 0; i < 50 && next_key < 20000; i++, next_key++) {
+            hash_table_insert(table, next_key, next_key + 1);
+        }
+    } while (cursor != 0);
+
+    for (int i = 0; i < 1000; i++) {
+        munit_assert_int(visits[i], ==, 1);
+    }
+
+    return MUNIT_OK;
+}
+#endif
+
+MunitTest table_iter[] = {
+    {"/iter", test_iter, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/iter_early_stop", test_iter_early_stop, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/scan", test_scan, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+#ifdef CHASHTABLE_NO_DEBUGMALLOC
+    {"/scan_background", test_scan_background_resize, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+#endif
+    {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
+};
@@ -0,0 +1,91 @@
+#include "../munit.h"
+#include "../test_utils.h"
+
+typedef struct {
+    int keys[8];
+    size_t count;
+} Differences;
+
+static void record_difference(int key, const Entry *a, const Entry *b, void *user_data) {
+    Differences *differences = (Differences *) user_data;
+    munit_assert_size(differences->count, <, 8);
+
+    // The entries belong to the reported key, and they really differ
+    if (a != nullptr) munit_assert_int(a->key, ==, key);
+    if (b != nullptr) munit_assert_int(b->key, ==, key);
+    munit_assert_true(a == nullptr || b == nullptr || a->value != b->value);
+
+    differences->keys[differences->count++] = key;
+}
+
+static bool has_difference(const Differences *differences, int key) {
+    for (size_t i = 0; i < differences->count; i++) {
+        if (differences->keys[i] == key) return true;
+    }
+    return false;
+}
+
+static MunitResult
+test_merkle_diff(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    HashTable *replica = hash_table_create_with_size(101);
+
+    munit_assert_false(hash_table_enable_merkle(nullptr));
+
+    // Built from the existing entries, then kept up to date
+    for (int i = 0; i < 2000; i++) {
+        hash_table_insert(table, i, i);
+    }
+    munit_assert_true(hash_table_enable_merkle(table));
+    munit_assert_true(hash_table_enable_merkle(replica));
+    for (int i = 1999; i >= 0; i--) {
+        hash_table_insert(replica, i, i);
+    }
+
+    munit_assert_uint64(table->merkle[1], ==, table->fingerprint);
+    munit_assert_size(table->size, !=, replica->size);
+
+    Differences differences = {.count = 0};
+    munit_assert_size(hash_table_diff(table, replica, record_difference, &differences), ==, 0);
+    munit_assert_size(differences.count, ==, 0);
+
+    hash_table_insert(replica, 10, -10);
+    hash_table_delete(replica, 20);
+    hash_table_insert(replica, 5000, 5000);
+    hash_table_insert(table, 6000, 6000);
+    munit_assert_uint64(replica->merkle[1], ==, replica->fingerprint);
+
+    munit_assert_size(hash_table_diff(table, replica, record_difference, &differences), ==, 4);
+    munit_assert_size(differences.count, ==, 4);
+    munit_assert_true(has_difference(&differences, 10));
+    munit_assert_true(has_difference(&differences, 20));
+    munit_assert_true(has_difference(&differences, 5000));
+    munit_assert_true(has_difference(&differences, 6000));
+
+    // Without a summary on one side, the same keys are found
+    HashTable *plain = hash_table_create();
+    for (int i = 0; i < 2000; i++) {
+        if (i != 20) hash_table_insert(plain, i, i == 10 ? -10 : i);
+    }
+    hash_table_insert(plain, 5000, 5000);
+
+    differences.count = 0;
+    munit_assert_size(hash_table_diff(table, plain, record_difference, &differences), ==, 4);
+    munit_assert_true(has_difference(&differences, 6000));
+
+    // Copies inherit the summary
+    HashTable *copy = hash_table_copy(table);
+    munit_assert_not_null(copy->merkle);
+    munit_assert_size(hash_table_diff(table, copy, record_difference, &differences), ==, 0);
+
+    hash_table_destroy(copy);
+    hash_table_destroy(plain);
+    hash_table_destroy(replica);
+
+    return MUNIT_OK;
+}
+
+MunitTest table_merkle[] = {
+    {"/diff", test_merkle_diff, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
+};
@@ -1,4 +1,6 @@
+#include <signal.h>
 #include <stdio.h>
+#include <sys/resource.h>
 
 #include "../munit.h"
 #include "../test_utils.h"
@@ -30,6 +32,60 @@ test_save_success(const MunitParameter params[], void *fixture) {
     return MUNIT_OK;
 }
 
+static void print_entry(int key, int value, void *file) {
+    fprintf((FILE *) file, "%d=%d\n", key, value);
+}
+
+static MunitResult
+test_save_buffered(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+
+    // Every digit count and both signs, the extremes too
+    const int keys[] = {0, 7, -7, 42, -100, 99999, -123456, 1000000000, INT32_MAX, INT32_MIN};
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        hash_table_insert(table, keys[i], keys[sizeof(keys) / sizeof(keys[0]) - 1 - i]);
+    }
+    for (int i = 0; i < 3000; i++) {
+        hash_table_insert(table, i * 1013, -i * 37);
+    }
+
+    const char filename[] = "test_save_buffered.txt";
+    const char reference[] = "test_save_buffered_reference.txt";
+
+    // The text is the same as printf formats it, whatever the buffer size
+    FILE *file = fopen(reference, "w");
+    munit_assert_not_null(file);
+    fprintf(file, "CHashTable v1.0\n%zu\n", table->count);
+    hash_table_foreach(table, print_entry, file);
+    fprintf(file, "\n");
+    fclose(file);
+
+    const size_t buffer_sizes[] = {0, 100, 4096, HT_SAVE_BUFFER_SIZE};
+    for (size_t i = 0; i < sizeof(buffer_sizes) / sizeof(buffer_sizes[0]); i++) {
+        munit_assert_true(hash_table_save_buffered(table, filename, buffer_sizes[i]));
+
+        FILE *saved = fopen(filename, "rb");
+        FILE *expected = fopen(reference, "rb");
+        int byte;
+        do {
+            byte = fgetc(saved);
+            munit_assert_int(byte, ==, fgetc(expected));
+        } while (byte != EOF);
+        fclose(saved);
+        fclose(expected);
+
+        HashTable *loaded = nullptr;
+        munit_assert_int(hash_table_load(filename, &loaded), ==, HT_LOAD_OK);
+        munit_assert_true(hash_table_equal(table, loaded));
+        hash_table_destroy(loaded);
+    }
+
+    munit_assert_int(remove(reference), ==, 0);
+    munit_assert_int(remove(filename), ==, 0);
+
+    return MUNIT_OK;
+}
+
 static MunitResult
 test_load_errors(const MunitParameter params[], void *fixture) {
     HashTable *table = nullptr;
@@ -96,13 +152,360 @@ test_load_success(const MunitParameter params[], void *fixture) {
     munit_assert_int(e1->value, ==, 2);
     munit_assert_int(e2->value, ==, 3);
 
+    hash_table_destroy(table);
+
+    return MUNIT_OK;
+}
+
+/** @brief Writes a string into a file */
+static void write_file(const char *filename, const char *contents) {
+    FILE *file = fopen(filename, "wb");
+    munit_assert_not_null(file);
+    fputs(contents, file);
+    fclose(file);
+}
+
+static MunitResult
+test_load_parsing(const MunitParameter params[], void *fixture) {
+    const char filename[] = "test_load_parsing.txt";
+    HashTable *table = nullptr;
+    HashTableLoadInfo info;
+
+    // Whitespace, signs, the int limits, long numbers, CRLF and no newline at the end
+    write_file(
+        filename,
+        "CHashTable v1.0\r\n6\r\n -5 = +7 \r\n2147483647=-2147483648\n-2147483648=2147483647\n"
+        "1234567890=-1000000000\n00000000000000000042=1\n7=8 trailing"
+    );
+    munit_assert_int(hash_table_load_with_info(filename, &table, &info), ==, HT_LOAD_OK);
+    munit_assert_size(info.error_offset, ==, SIZE_MAX);
+    munit_assert_size(table->count, ==, 6);
+    munit_assert_int(hash_table_get(table, -5)->value, ==, 7);
+    munit_assert_int(hash_table_get(table, INT32_MAX)->value, ==, INT32_MIN);
+    munit_assert_int(hash_table_get(table, INT32_MIN)->value, ==, INT32_MAX);
+    munit_assert_int(hash_table_get(table, 1234567890)->value, ==, -1000000000);
+    munit_assert_int(hash_table_get(table, 42)->value, ==, 1);
+    munit_assert_int(hash_table_get(table, 7)->value, ==, 8);
+    hash_table_destroy(table);
+
+    // The first malformed line is reported, out of range values are malformed too
+    write_file(filename, "CHashTable v1.0\n4\n1=2\n2147483648=3\n3=\n4=5\n");
+    munit_assert_int(hash_table_load_with_info(filename, &table, &info), ==, HT_LOAD_ERROR_MALFORMED_LINE);
+    munit_assert_null(table);
+    munit_assert_size(info.error_line, ==, 4);
+    munit_assert_size(info.error_offset, ==, 16 + 2 + 4);
+
+    write_file(filename, "CHashTable v1.0\n3\n1=2\n");
+    munit_assert_int(hash_table_load_with_info(filename, &table, &info), ==, HT_LOAD_ERROR_PREMATURE_EOF);
+    munit_assert_size(info.error_line, ==, 4);
+    munit_assert_size(info.error_offset, ==, info.bytes_read);
+
+    write_file(filename, "CHashTable v1.0\n-1\n");
+    munit_assert_int(hash_table_load_with_info(filename, &table, &info), ==, HT_LOAD_ERROR_MALFORMED_COUNT);
+    munit_assert_size(info.error_line, ==, 2);
+
+    munit_assert_int(remove(filename), ==, 0);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_binary(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+
+    // More than one block, with negative keys and values
+    for (int i = -35000; i < 35000; i++) {
+        hash_table_insert(table, i * 7, -i);
+    }
+
+    const char filename[] = "test_binary.bin";
+    munit_assert_true(hash_table_save_binary(table, filename));
+
+    HashTable *loaded = nullptr;
+    munit_assert_int(hash_table_load(filename, &loaded), ==, HT_LOAD_OK);
+    munit_assert_not_null(loaded);
+    munit_assert_true(hash_table_equal(table, loaded));
+
+    // The saved size is recreated, the load never resizes
+    munit_assert_size(loaded->size, ==, table->size);
+    munit_assert_size(loaded->resize_count, ==, 0);
+    hash_table_destroy(loaded);
+
+    // An empty table
+    HashTable *empty = hash_table_create();
+    munit_assert_true(hash_table_save_binary(empty, filename));
+    munit_assert_int(hash_table_load(filename, &loaded), ==, HT_LOAD_OK);
+    munit_assert_size(loaded->count, ==, 0);
+    hash_table_destroy(loaded);
+    hash_table_destroy(empty);
+
+    munit_assert_int(remove(filename), ==, 0);
+
+    return MUNIT_OK;
+}
+
+/** @brief Copies the first `length` bytes of a file, flipping the byte at `flip` unless it is negative */
+static void copy_damaged(const char *source, const char *destination, long length, long flip) {
+    FILE *in = fopen(source, "rb");
+    FILE *out = fopen(destination, "wb");
+    munit_assert_not_null(in);
+    munit_assert_not_null(out);
+
+    for (long i = 0; i < length; i++) {
+        const int byte = fgetc(in);
+        munit_assert_int(byte, !=, EOF);
+        fputc(i == flip ? byte ^ 0x40 : byte, out);
+    }
+
+    fclose(in);
+    fclose(out);
+}
+
+static MunitResult
+test_binary_errors(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    for (int i = 0; i < 100; i++) {
+        hash_table_insert(table, i, i);
+    }
+
+    const char filename[] = "test_binary_errors.bin";
+    const char damaged[] = "test_binary_errors_damaged.bin";
+    munit_assert_true(hash_table_save_binary(table, filename));
+
+    // Header line, binary header, 100 entries and the block checksum
+    const long header_bytes = 16 + 28;
+    const long file_bytes = header_bytes + 100 * 8 + 4;
+
+    HashTable *loaded = nullptr;
+    copy_damaged(filename, damaged, header_bytes - 1, -1);
+    munit_assert_int(hash_table_load(damaged, &loaded), ==, HT_LOAD_ERROR_MISSING_COUNT);
+
+    copy_damaged(filename, damaged, file_bytes, 20);
+    munit_assert_int(hash_table_load(damaged, &loaded), ==, HT_LOAD_ERROR_CHECKSUM);
+
+    copy_damaged(filename, damaged, file_bytes, header_bytes + 10 * 8);
+    HashTableLoadInfo info;
+    munit_assert_int(hash_table_load_with_info(damaged, &loaded, &info), ==, HT_LOAD_ERROR_CHECKSUM);
+    munit_assert_size(info.error_offset, ==, header_bytes);
+
+    copy_damaged(filename, damaged, file_bytes - 1, -1);
+    munit_assert_int(hash_table_load(damaged, &loaded), ==, HT_LOAD_ERROR_PREMATURE_EOF);
+    munit_assert_null(loaded);
+
+    munit_assert_int(remove(damaged), ==, 0);
+    munit_assert_int(remove(filename), ==, 0);
+
+    return MUNIT_OK;
+}
+
+/** @brief Checks that a parallel load of a file gives the same result as a serial one, for a few thread counts */
+static void assert_parallel_load(const char *filename, HashTable_LoadError expected) {
+    HashTable *serial = nullptr;
+    munit_assert_int(hash_table_load(filename, &serial), ==, expected);
+
+    const size_t thread_counts[] = {1, 2, 3, 8};
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        HashTable *parallel = nullptr;
+        munit_assert_int(hash_table_load_parallel(filename, thread_counts[i], &parallel), ==, expected);
+
+        if (expected == HT_LOAD_OK) {
+            munit_assert_true(hash_table_equal(serial, parallel));
+            munit_assert_size(parallel->fingerprint, ==, serial->fingerprint);
+            hash_table_destroy(parallel);
+        } else {
+            munit_assert_null(parallel);
+        }
+    }
+
+    hash_table_destroy(serial);
+}
+
+static MunitResult
+test_load_parallel(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+
+    assert_parallel_load("../tests/fixtures/ht_valid.txt", HT_LOAD_OK);
+    assert_parallel_load("../tests/fixtures/ht_emtpy.txt", HT_LOAD_ERROR_EMPTY);
+    assert_parallel_load("../tests/fixtures/ht_invalid_header.txt", HT_LOAD_ERROR_INVALID_HEADER);
+    assert_parallel_load("../tests/fixtures/ht_no_count.txt", HT_LOAD_ERROR_MISSING_COUNT);
+    assert_parallel_load("../tests/fixtures/ht_malformed_count.txt", HT_LOAD_ERROR_MALFORMED_COUNT);
+    assert_parallel_load("../tests/fixtures/ht_premature_eof.txt", HT_LOAD_ERROR_PREMATURE_EOF);
+
+    // Duplicate keys split between threads, the last one wins
+    const char filename[] = "test_load_parallel.txt";
+    FILE *file = fopen(filename, "wb");
+    munit_assert_not_null(file);
+    fprintf(file, "CHashTable v1.0\n40000\n");
+    for (int i = 0; i < 40000; i++) {
+        fprintf(file, "%d=%d\n", (i * 37) % 25000 - 12500, i);
+    }
+    fclose(file);
+    assert_parallel_load(filename, HT_LOAD_OK);
+
+    // Errors in any part, and lines past the count are ignored
+    write_file(filename, "CHashTable v1.0\n6\n1=1\n2=2\n3=3\n4=4\n5=x\n6=6\n");
+    assert_parallel_load(filename, HT_LOAD_ERROR_MALFORMED_LINE);
+    write_file(filename, "CHashTable v1.0\n6\n1=1\n=2\n3=3\n4=4\n5=x\n6=6\n");
+    assert_parallel_load(filename, HT_LOAD_ERROR_MALFORMED_LINE);
+    write_file(filename, "CHashTable v1.0\n6\n1=1\n2=2\n3=3\n4=4\n5=5\n");
+    assert_parallel_load(filename, HT_LOAD_ERROR_PREMATURE_EOF);
+    write_file(filename, "CHashTable v1.0\n3\n1=1\n2=2\n3=3\nnot=read\n");
+    assert_parallel_load(filename, HT_LOAD_OK);
+
+    // Binary files of several blocks, whole, damaged and cut short
+    for (int i = -25000; i < 25000; i++) {
+        hash_table_insert(table, i * 3, i);
+    }
+    const char binary[] = "test_load_parallel.bin";
+    const char damaged[] = "test_load_parallel_damaged.bin";
+    munit_assert_true(hash_table_save_binary(table, binary));
+    assert_parallel_load(binary, HT_LOAD_OK);
+
+    FILE *saved = fopen(binary, "rb");
+    munit_assert_not_null(saved);
+    fseek(saved, 0, SEEK_END);
+    const long file_bytes = ftell(saved);
+    fclose(saved);
+
+    copy_damaged(binary, damaged, file_bytes, file_bytes / 2);
+    assert_parallel_load(damaged, HT_LOAD_ERROR_CHECKSUM);
+    copy_damaged(binary, damaged, file_bytes - 1, -1);
+    assert_parallel_load(damaged, HT_LOAD_ERROR_PREMATURE_EOF);
+
+    munit_assert_int(remove(damaged), ==, 0);
+    munit_assert_int(remove(binary), ==, 0);
+    munit_assert_int(remove(filename), ==, 0);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_image(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+
+    // Includes INT32_MIN, so the empty slots get another key
+    for (int i = 0; i < 20000; i++) {
+        hash_table_insert(table, INT32_MIN + i * 3, i);
+    }
+
+    const char filename[] = "test_image.img";
+    munit_assert_true(hash_table_save_image(table, filename));
+
+    HashTableImage *image = nullptr;
+    munit_assert_int(hash_table_open_image(filename, &image), ==, HT_LOAD_OK);
+    munit_assert_not_null(image);
+    munit_assert_size(hash_table_image_count(image), ==, table->count);
+
+    for (int i = 0; i < 20000; i++) {
+        int value = -1;
+        munit_assert_true(hash_table_image_get(image, INT32_MIN + i * 3, &value));
+        munit_assert_int(value, ==, i);
+        munit_assert_false(hash_table_image_get(image, INT32_MIN + i * 3 + 1, &value));
+    }
+
+    // Saving over an open image leaves it readable
+    hash_table_insert(table, 5, 5);
+    munit_assert_true(hash_table_save_image(table, filename));
+    munit_assert_false(hash_table_image_get(image, 5, nullptr));
+    hash_table_close_image(image);
+
+    munit_assert_int(hash_table_open_image(filename, &image), ==, HT_LOAD_OK);
+    munit_assert_true(hash_table_image_get(image, 5, nullptr));
+    hash_table_close_image(image);
+
+    // An empty table
+    HashTable *empty = hash_table_create();
+    munit_assert_true(hash_table_save_image(empty, filename));
+    munit_assert_int(hash_table_open_image(filename, &image), ==, HT_LOAD_OK);
+    munit_assert_size(hash_table_image_count(image), ==, 0);
+    munit_assert_false(hash_table_image_get(image, 0, nullptr));
+    hash_table_close_image(image);
+    hash_table_destroy(empty);
+
+    munit_assert_int(remove(filename), ==, 0);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_image_errors(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    for (int i = 0; i < 100; i++) {
+        hash_table_insert(table, i, i);
+    }
+
+    const char filename[] = "test_image_errors.img";
+    const char damaged[] = "test_image_errors_damaged.img";
+    munit_assert_true(hash_table_save_image(table, filename));
+
+    // Header, then 256 slots for 100 entries
+    const long header_bytes = 64;
+    const long file_bytes = header_bytes + 256 * 8;
+
+    HashTableImage *image = nullptr;
+    munit_assert_int(hash_table_open_image("test_image_missing.img", &image), ==, HT_LOAD_ERROR_FILE_OPEN);
+    munit_assert_null(image);
+
+    copy_damaged(filename, damaged, 0, -1);
+    munit_assert_int(hash_table_open_image(damaged, &image), ==, HT_LOAD_ERROR_EMPTY);
+
+    copy_damaged(filename, damaged, header_bytes - 1, -1);
+    munit_assert_int(hash_table_open_image(damaged, &image), ==, HT_LOAD_ERROR_MISSING_COUNT);
+
+    copy_damaged(filename, damaged, file_bytes, 11);
+    munit_assert_int(hash_table_open_image(damaged, &image), ==, HT_LOAD_ERROR_INVALID_HEADER);
+
+    copy_damaged(filename, damaged, file_bytes, 24);
+    munit_assert_int(hash_table_open_image(damaged, &image), ==, HT_LOAD_ERROR_CHECKSUM);
+
+    copy_damaged(filename, damaged, file_bytes - 8, -1);
+    munit_assert_int(hash_table_open_image(damaged, &image), ==, HT_LOAD_ERROR_PREMATURE_EOF);
+    munit_assert_null(image);
+
+    // Neither format is mistaken for the other
+    HashTable *loaded = nullptr;
+    munit_assert_int(hash_table_load(filename, &loaded), ==, HT_LOAD_ERROR_INVALID_HEADER);
+    munit_assert_true(hash_table_save_binary(table, damaged));
+    munit_assert_int(hash_table_open_image(damaged, &image), ==, HT_LOAD_ERROR_INVALID_HEADER);
+
+    // No room for a larger image, like on a full disk. The save fails and keeps the old image
+    for (int i = 100; i < 1000; i++) {
+        hash_table_insert(table, i, i);
+    }
+    struct rlimit limit;
+    munit_assert_int(getrlimit(RLIMIT_FSIZE, &limit), ==, 0);
+    const struct rlimit saved = limit;
+    limit.rlim_cur = (rlim_t) file_bytes;
+    void (*handler)(int) = signal(SIGXFSZ, SIG_IGN);
+    munit_assert_int(setrlimit(RLIMIT_FSIZE, &limit), ==, 0);
+
+    munit_assert_false(hash_table_save_image(table, filename));
+
+    munit_assert_int(setrlimit(RLIMIT_FSIZE, &saved), ==, 0);
+    signal(SIGXFSZ, handler);
+
+    munit_assert_null(fopen("test_image_errors.img.tmp", "rb"));
+    munit_assert_int(hash_table_open_image(filename, &image), ==, HT_LOAD_OK);
+    munit_assert_size(hash_table_image_count(image), ==, 100);
+    hash_table_close_image(image);
+
+    munit_assert_int(remove(damaged), ==, 0);
+    munit_assert_int(remove(filename), ==, 0);
+
     return MUNIT_OK;
 }
 
 MunitTest table_persistence[] = {
     {"/save_error", test_save_errors, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
     {"/save_success", test_save_success, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/save_buffered", test_save_buffered, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
     {"/load_error", test_load_errors, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
     {"/load_success", test_load_success, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/load_parsing", test_load_parsing, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/binary", test_binary, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/binary_errors", test_binary_errors, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/load_parallel", test_load_parallel, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/image", test_image, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/image_errors", test_image_errors, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
     {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
 };
@@ -39,11 +39,78 @@ test_data_persists_after_resize(const MunitParameter params[], void *fixture) {
     return MUNIT_OK;
 }
 
+static MunitResult
+test_parallel_resize(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+
+    munit_assert_false(hash_table_set_parallel_resize(nullptr, 0, 4));
+    munit_assert_true(hash_table_set_parallel_resize(table, 100, 4));
+
+    // Resizes above 100 entries are multithreaded
+    for (int i = 0; i < 20000; i++) {
+        hash_table_insert(table, i - 10000, i);
+    }
+
+    munit_assert_size(table->count, ==, 20000);
+    munit_assert_size(table->count, <=, table->load_threshold_count);
+
+    for (int i = 0; i < 20000; i++) {
+        const Entry *entry = hash_table_get(table, i - 10000);
+        munit_assert_not_null(entry);
+        munit_assert_int(entry->value, ==, i);
+    }
+
+    // Every entry has been relinked exactly once
+    size_t linked = 0;
+    for (size_t i = 0; i < table->size; i++) {
+        for (const Entry *entry = table->buckets[i]; entry != nullptr; entry = entry->next) {
+            munit_assert_size(hash_function(entry->key, table->size), ==, i);
+            linked++;
+        }
+    }
+    munit_assert_size(linked, ==, 20000);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_radix_resize(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    table->rehash_strategy = HT_REHASH_RADIX;
+
+    // Grow past a single radix partition
+    for (int i = 0; i < 60000; i++) {
+        hash_table_insert(table, i * 7919, -i);
+    }
+
+    munit_assert_size(table->size, >, HT_RADIX_PARTITION_BUCKETS);
+    munit_assert_size(table->count, ==, 60000);
+
+    for (int i = 0; i < 60000; i++) {
+        const Entry *entry = hash_table_get(table, i * 7919);
+        munit_assert_not_null(entry);
+        munit_assert_int(entry->value, ==, -i);
+    }
+
+    size_t linked = 0;
+    for (size_t i = 0; i < table->size; i++) {
+        for (const Entry *entry = table->buckets[i]; entry != nullptr; entry = entry->next) {
+            munit_assert_size(hash_function(entry->key, table->size), ==, i);
+            linked++;
+        }
+    }
+    munit_assert_size(linked, ==, 60000);
+
+    return MUNIT_OK;
+}
+
 MunitTest table_resize[] = {
     {"/resize", test_resizing, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
     {
         "/data_persists", test_data_persists_after_resize, hash_table_setup, hash_table_teardown,
         MUNIT_TEST_OPTION_NONE, nullptr
     },
+    {"/parallel", test_parallel_resize, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/radix", test_radix_resize, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
     {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
 };
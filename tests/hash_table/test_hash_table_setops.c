@@ -0,0 +1,198 @@
+#include "../munit.h"
+#include "../test_utils.h"
+
+static int sum_values(int key, int dst_value, int src_value, void *user_data) {
+    *(int *) user_data += 1;
+    return dst_value + src_value;
+}
+
+/** @brief Table holding keys [first, last) with value = key * factor */
+static HashTable *range_table(size_t size, int first, int last, int factor) {
+    HashTable *table = hash_table_create_with_size(size);
+    for (int i = first; i < last; i++) {
+        hash_table_insert(table, i, i * factor);
+    }
+    return table;
+}
+
+static MunitResult
+test_merge(const MunitParameter params[], void *fixture) {
+    // Different sizes, dst is presized and grown at most once
+    HashTable *dst = range_table(HT_INITIAL_SIZE, 0, 1000, 1);
+    HashTable *src = range_table(HT_INITIAL_SIZE, 500, 3000, 2);
+    munit_assert_size(dst->size, !=, src->size);
+
+    const size_t resizes = dst->resize_count;
+    int conflicts = 0;
+    munit_assert_true(hash_table_merge(dst, src, sum_values, &conflicts));
+    munit_assert_size(dst->resize_count - resizes, <=, 1);
+    munit_assert_int(conflicts, ==, 500);
+    munit_assert_size(dst->count, ==, 3000);
+
+    HashTable *expected = hash_table_create();
+    for (int i = 0; i < 3000; i++) {
+        hash_table_insert(expected, i, i < 500 ? i : i < 1000 ? i * 3 : i * 2);
+    }
+    munit_assert_true(hash_table_equal(dst, expected));
+    munit_assert_uint64(dst->fingerprint, ==, expected->fingerprint);
+
+    // Same size, walked bucket by bucket, src wins without a conflict function
+    HashTable *same = range_table(dst->size, 2000, 4000, -1);
+    munit_assert_true(hash_table_merge(dst, same, nullptr, nullptr));
+    munit_assert_size(dst->count, ==, 4000);
+    munit_assert_int(hash_table_get(dst, 1999)->value, ==, 1999 * 2);
+    munit_assert_int(hash_table_get(dst, 2000)->value, ==, -2000);
+    munit_assert_int(hash_table_get(dst, 3999)->value, ==, -3999);
+    munit_assert_size(dst->count, <=, dst->load_threshold_count);
+
+    munit_assert_false(hash_table_merge(dst, dst, nullptr, nullptr));
+    munit_assert_false(hash_table_merge(nullptr, src, nullptr, nullptr));
+
+    hash_table_destroy(same);
+    hash_table_destroy(expected);
+    hash_table_destroy(src);
+    hash_table_destroy(dst);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_intersect_subtract(const MunitParameter params[], void *fixture) {
+    HashTable *evens = hash_table_create();
+    for (int i = 0; i < 2000; i += 2) {
+        hash_table_insert(evens, i, 0);
+    }
+
+    // Both the bucket-parallel and the hashing walk
+    const size_t sizes[] = {evens->size, HT_INITIAL_SIZE};
+    for (size_t s = 0; s < 2; s++) {
+        HashTable *table = range_table(sizes[s], 0, 1000, 1);
+        munit_assert_true(hash_table_intersect(table, evens));
+        munit_assert_size(table->count, ==, 500);
+        for (int i = 0; i < 1000; i++) {
+            if (i % 2 == 0) munit_assert_int(hash_table_get(table, i)->value, ==, i);
+            else munit_assert_null(hash_table_get(table, i));
+        }
+        hash_table_destroy(table);
+
+        table = range_table(sizes[s], 0, 1000, 1);
+        munit_assert_true(hash_table_subtract(table, evens));
+        munit_assert_size(table->count, ==, 500);
+        for (int i = 0; i < 1000; i++) {
+            if (i % 2 == 0) munit_assert_null(hash_table_get(table, i));
+            else munit_assert_int(hash_table_get(table, i)->value, ==, i);
+        }
+        hash_table_destroy(table);
+    }
+
+    // Probing with the smaller table
+    HashTable *few = range_table(HT_INITIAL_SIZE, 0, 10, 1);
+    munit_assert_true(hash_table_subtract(evens, few));
+    munit_assert_size(evens->count, ==, 995);
+    munit_assert_null(hash_table_get(evens, 8));
+    munit_assert_not_null(hash_table_get(evens, 10));
+
+    munit_assert_true(hash_table_subtract(few, few));
+    munit_assert_size(few->count, ==, 0);
+    munit_assert_uint64(few->fingerprint, ==, 0);
+
+    hash_table_destroy(few);
+    hash_table_destroy(evens);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_setops_copy_on_write(const MunitParameter params[], void *fixture) {
+    HashTable *table = range_table(HT_INITIAL_SIZE, 0, 1000, 1);
+    HashTable *snapshot = hash_table_copy(table);
+    HashTable *other = range_table(table->size, 500, 1500, 2);
+
+    munit_assert_true(hash_table_merge(table, other, nullptr, nullptr));
+    munit_assert_true(hash_table_subtract(table, snapshot));
+    munit_assert_size(table->count, ==, 500);
+
+    // The snapshot still holds the original entries
+    munit_assert_size(snapshot->count, ==, 1000);
+    for (int i = 0; i < 1000; i++) {
+        munit_assert_int(hash_table_get(snapshot, i)->value, ==, i);
+    }
+
+    hash_table_destroy(other);
+    hash_table_destroy(snapshot);
+    hash_table_destroy(table);
+
+    return MUNIT_OK;
+}
+
+static bool keep_below(int key, int value, void *user_data) {
+    return key % 10 >= *(int *) user_data;
+}
+
+/** @brief keep_below() that also counts its calls */
+typedef struct {
+    int threshold;
+    size_t calls;
+} CountedThreshold;
+
+static bool keep_below_counted(int key, int value, void *user_data) {
+    CountedThreshold *counted = (CountedThreshold *) user_data;
+    counted->calls++;
+    return keep_below(key, value, &counted->threshold);
+}
+
+static MunitResult
+test_retain(const MunitParameter params[], void *fixture) {
+    HashTable *table = range_table(HT_INITIAL_SIZE, 0, 10000, 1);
+    const size_t size = table->size;
+
+    // Purge 30%, not sparse enough to shrink
+    int threshold = 3;
+    munit_assert_size(hash_table_retain(table, keep_below, &threshold), ==, 3000);
+    munit_assert_size(table->count, ==, 7000);
+    munit_assert_size(table->size, ==, size);
+
+    HashTable *expected = hash_table_create();
+    for (int i = 0; i < 10000; i++) {
+        if (i % 10 >= 3) hash_table_insert(expected, i, i);
+    }
+    munit_assert_true(hash_table_equal(table, expected));
+
+    // Keep 10%, shrunk once at the end
+    const size_t resizes = table->resize_count;
+    threshold = 9;
+    munit_assert_size(hash_table_retain(table, keep_below, &threshold), ==, 6000);
+    munit_assert_size(table->count, ==, 1000);
+    munit_assert_size(table->size, <, size);
+    munit_assert_size(table->resize_count, ==, resizes + 1);
+    munit_assert_size(table->count, <=, table->load_threshold_count);
+
+    for (int i = 0; i < 10000; i++) {
+        const Entry *entry = hash_table_get(table, i);
+        if (i % 10 == 9) munit_assert_not_null(entry);
+        else munit_assert_null(entry);
+    }
+
+    // A table shared with a copy still calls the predicate once per entry
+    HashTable *snapshot = hash_table_copy(expected);
+    CountedThreshold counted = {.threshold = 5, .calls = 0};
+    munit_assert_size(hash_table_retain(expected, keep_below_counted, &counted), ==, 2000);
+    munit_assert_size(counted.calls, ==, 7000);
+    munit_assert_size(snapshot->count, ==, 7000);
+
+    munit_assert_size(hash_table_retain(nullptr, keep_below, &threshold), ==, 0);
+
+    hash_table_destroy(snapshot);
+    hash_table_destroy(expected);
+    hash_table_destroy(table);
+
+    return MUNIT_OK;
+}
+
+MunitTest table_setops[] = {
+    {"/merge", test_merge, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/intersect_subtract", test_intersect_subtract, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/copy_on_write", test_setops_copy_on_write, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/retain", test_retain, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
+};
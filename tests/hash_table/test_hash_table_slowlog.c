@@ -0,0 +1,97 @@
+#include <stdio.h>
+
+#include "../munit.h"
+#include "../test_utils.h"
+
+static MunitResult
+test_slowlog(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    static HashTableSlowlogEntry entries[HT_SLOWLOG_CAPACITY];
+
+    // Disabled by default, nothing is recorded
+    munit_assert_uint64(hash_table_slowlog_threshold(), ==, HT_SLOWLOG_DISABLED);
+    hash_table_slowlog_reset();
+    hash_table_insert(table, 1, 1);
+    munit_assert_size(hash_table_slowlog_get(entries, HT_SLOWLOG_CAPACITY), ==, 0);
+
+    // A zero threshold records every operation
+    hash_table_slowlog_set_threshold(0);
+    munit_assert_uint64(hash_table_slowlog_threshold(), ==, 0);
+
+    hash_table_insert(table, 2, 2);
+    hash_table_get(table, 2);
+    hash_table_delete(table, 1);
+
+    munit_assert_size(hash_table_slowlog_get(entries, HT_SLOWLOG_CAPACITY), ==, 3);
+    munit_assert_int(entries[0].op, ==, HT_OP_DELETE);
+    munit_assert_int(entries[0].key, ==, 1);
+    munit_assert_size(entries[0].count, ==, 1);
+    munit_assert_int(entries[1].op, ==, HT_OP_GET);
+    munit_assert_int(entries[1].key, ==, 2);
+    munit_assert_size(entries[1].chain_length, >=, 1);
+    munit_assert_size(entries[1].table_size, ==, HT_INITIAL_SIZE);
+    munit_assert_int(entries[2].op, ==, HT_OP_INSERT);
+    munit_assert_uint64(entries[0].id, ==, entries[1].id + 1);
+    munit_assert_uint64(entries[1].id, ==, entries[2].id + 1);
+
+    // Limited by the array length, newest first
+    munit_assert_size(hash_table_slowlog_get(entries, 1), ==, 1);
+    munit_assert_int(entries[0].op, ==, HT_OP_DELETE);
+
+    // The insert crossing the threshold is logged after the resize it triggered
+    hash_table_slowlog_reset();
+    munit_assert_size(hash_table_slowlog_get(entries, HT_SLOWLOG_CAPACITY), ==, 0);
+
+    int key = 100;
+    while (table->resize_count == 0) {
+        hash_table_insert(table, key++, 0);
+    }
+
+    munit_assert_size(hash_table_slowlog_get(entries, 2), ==, 2);
+    munit_assert_int(entries[0].op, ==, HT_OP_INSERT);
+    munit_assert_true(entries[0].resized);
+    munit_assert_size(entries[0].table_size, ==, table->size);
+    munit_assert_int(entries[1].op, ==, HT_OP_RESIZE);
+    munit_assert_true(entries[1].resized);
+    munit_assert_uint64(entries[1].duration_ns, ==, table->resize_last_ns);
+
+    // Only the newest entries are kept
+    for (int i = 0; i < (int) HT_SLOWLOG_CAPACITY * 2; i++) {
+        hash_table_get(table, i);
+    }
+    munit_assert_size(hash_table_slowlog_get(entries, HT_SLOWLOG_CAPACITY), ==, HT_SLOWLOG_CAPACITY);
+    munit_assert_int(entries[0].key, ==, HT_SLOWLOG_CAPACITY * 2 - 1);
+    munit_assert_int(entries[HT_SLOWLOG_CAPACITY - 1].key, ==, HT_SLOWLOG_CAPACITY);
+
+    // Saves and loads are recorded too
+    char filename[64];
+    snprintf(filename, sizeof(filename), "slowlog_test_%u.txt", munit_rand_uint32());
+    hash_table_slowlog_reset();
+    munit_assert_true(hash_table_save(table, filename));
+
+    HashTable *loaded;
+    munit_assert_int(hash_table_load(filename, &loaded), ==, HT_LOAD_OK);
+    remove(filename);
+
+    // The load finishes after the inserts it made
+    const size_t count = hash_table_slowlog_get(entries, HT_SLOWLOG_CAPACITY);
+    munit_assert_int(entries[0].op, ==, HT_OP_LOAD);
+    munit_assert_size(entries[0].count, ==, table->count);
+
+    bool saved = false;
+    for (size_t i = 0; i < count; i++) {
+        saved |= entries[i].op == HT_OP_SAVE;
+    }
+    munit_assert_true(saved);
+
+    hash_table_destroy(loaded);
+    hash_table_slowlog_set_threshold(HT_SLOWLOG_DISABLED);
+    hash_table_slowlog_reset();
+
+    return MUNIT_OK;
+}
+
+MunitTest table_slowlog[] = {
+    {"/slowlog", test_slowlog, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
+};
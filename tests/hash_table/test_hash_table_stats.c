@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../munit.h"
+#include "../test_utils.h"
+
+static MunitResult
+test_stats(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    HashTableStats stats;
+
+    munit_assert_false(hash_table_stats(nullptr, &stats));
+    munit_assert_false(hash_table_stats(table, nullptr));
+
+    munit_assert_true(hash_table_stats(table, &stats));
+    munit_assert_size(stats.count, ==, 0);
+    munit_assert_size(stats.empty_buckets, ==, HT_INITIAL_SIZE);
+    munit_assert_size(stats.chain_histogram[0], ==, HT_INITIAL_SIZE);
+    munit_assert_size(stats.longest_chain, ==, 0);
+
+    for (int i = 0; i < 1000; i++) {
+        hash_table_insert(table, i, i);
+    }
+
+    munit_assert_true(hash_table_stats(table, &stats));
+    munit_assert_size(stats.count, ==, 1000);
+    munit_assert_size(stats.size, ==, table->size);
+    munit_assert_double_equal(stats.load_factor, 1000.0 / (double) table->size, 9);
+    munit_assert_size(stats.resize_count, ==, table->resize_count);
+
+    // The histogram covers every bucket and every entry
+    size_t buckets = 0;
+    size_t entries = 0;
+    for (size_t i = 0; i < HT_STATS_CHAIN_HISTOGRAM; i++) {
+        buckets += stats.chain_histogram[i];
+        entries += i * stats.chain_histogram[i];
+    }
+    munit_assert_size(buckets, ==, stats.size);
+    munit_assert_size(entries, ==, stats.count);
+    munit_assert_size(stats.chain_histogram[0], ==, stats.empty_buckets);
+    munit_assert_size(stats.chain_histogram[stats.longest_chain], >, 0);
+
+    munit_assert_size(stats.bucket_bytes, ==, stats.size * sizeof(Entry *));
+    munit_assert_size(stats.entry_bytes, ==, 1000 * sizeof(Entry));
+    munit_assert_size(stats.total_bytes, ==, stats.bucket_bytes + stats.entry_bytes + stats.overhead_bytes);
+
+    // Freed slots of a node block still count
+    HashTable *clone = hash_table_clone(table);
+    hash_table_delete(clone, 1);
+    hash_table_insert(clone, 5000, 1);
+
+    HashTableStats clone_stats;
+    munit_assert_true(hash_table_stats(clone, &clone_stats));
+    munit_assert_size(clone_stats.entry_bytes, >, 1001 * sizeof(Entry));
+
+    hash_table_destroy(clone);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_prometheus(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+
+    for (int i = 0; i < 100; i++) {
+        hash_table_insert(table, i, i);
+    }
+
+    FILE *file = tmpfile();
+    munit_assert_not_null(file);
+
+    munit_assert_false(hash_table_stats_write_prometheus(nullptr, file));
+    munit_assert_false(hash_table_stats_write_prometheus(table, nullptr));
+    munit_assert_true(hash_table_stats_write_prometheus(table, file));
+
+    static char text[65536];
+    rewind(file);
+    const size_t length = fread(text, 1, sizeof(text) - 1, file);
+    text[length] = '\0';
+    fclose(file);
+
+    char expected[128];
+    munit_assert_not_null(strstr(text, "# TYPE chashtable_entries gauge\nchashtable_entries 100\n"));
+    snprintf(expected, sizeof(expected), "chashtable_buckets %zu\n", table->size);
+    munit_assert_not_null(strstr(text, expected));
+    snprintf(expected, sizeof(expected), "chashtable_resizes_total %zu\n", table->resize_count);
+    munit_assert_not_null(strstr(text, expected));
+
+    // The chain histogram counts every bucket, and sums to the entry count
+    snprintf(expected, sizeof(expected), "chashtable_chain_length_bucket{le=\"+Inf\"} %zu\n", table->size);
+    munit_assert_not_null(strstr(text, expected));
+    munit_assert_not_null(strstr(text, "chashtable_chain_length_sum 100\n"));
+
+#ifdef CHASHTABLE_INSTRUMENT
+    munit_assert_not_null(strstr(text, "# TYPE chashtable_operation_duration_seconds histogram\n"));
+    munit_assert_not_null(strstr(text, "chashtable_operations_total{op=\"insert\",result=\"new\"} "));
+    munit_assert_not_null(strstr(text, "chashtable_operation_duration_seconds_bucket{op=\"get\",le=\"+Inf\"} "));
+#else
+    munit_assert_null(strstr(text, "chashtable_operations_total"));
+#endif
+
+    return MUNIT_OK;
+}
+
+MunitTest table_stats[] = {
+    {"/stats", test_stats, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/prometheus", test_prometheus, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
+};
@@ -0,0 +1,150 @@
+#include <stdio.h>
+
+#include "../munit.h"
+#include "../test_utils.h"
+
+/** @brief Events received by the hook */
+typedef struct {
+    HashTableTraceEvent events[64];
+    size_t count;
+} TraceLog;
+
+static void record_event(const HashTableTraceEvent *event, void *user_data) {
+    TraceLog *log = (TraceLog *) user_data;
+    if (log->count < 64) log->events[log->count++] = *event;
+}
+
+/** @brief Index of the first recorded event of a type, -1 if there is none */
+static int find_event(const TraceLog *log, HashTableTraceType type) {
+    for (size_t i = 0; i < log->count; i++) {
+        if (log->events[i].type == type) return (int) i;
+    }
+
+    return -1;
+}
+
+static MunitResult
+test_trace_resize(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    static TraceLog log;
+    log.count = 0;
+
+    hash_table_set_trace_hook(record_event, &log);
+
+    int key = 0;
+    while (table->resize_count == 0) {
+        hash_table_insert(table, key++, 0);
+    }
+
+    hash_table_set_trace_hook(nullptr, nullptr);
+    hash_table_insert(table, key, 0);
+    hash_table_resize(table);
+
+    const int start = find_event(&log, HT_TRACE_RESIZE_START);
+    const int end = find_event(&log, HT_TRACE_RESIZE_END);
+    munit_assert_int(start, >=, 0);
+    munit_assert_int(end, >, start);
+    munit_assert_size(log.events[start].old_size, ==, HT_INITIAL_SIZE);
+    munit_assert_size(log.events[start].size, ==, log.events[end].size);
+    munit_assert_size(log.events[end].old_size, ==, HT_INITIAL_SIZE);
+    munit_assert_size(log.events[end].count, ==, (size_t) key);
+    munit_assert_true(log.events[end].success);
+    munit_assert_ptr_equal(log.events[end].table, table);
+
+    // Unregistered, the later resize wasn't reported
+    munit_assert_size(log.count, ==, 2);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_trace_long_chain(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    static TraceLog log;
+    log.count = 0;
+
+    // Keys of the same bucket, few enough not to trigger a resize
+    int keys[HT_TRACE_LONG_CHAIN_LENGTH];
+    size_t found = 0;
+    for (int key = 0; found < HT_TRACE_LONG_CHAIN_LENGTH; key++) {
+        if (hash_function(key, table->size) == 0) keys[found++] = key;
+    }
+
+    hash_table_set_trace_hook(record_event, &log);
+
+    for (size_t i = 0; i < HT_TRACE_LONG_CHAIN_LENGTH; i++) {
+        hash_table_insert(table, keys[i], (int) i);
+    }
+    munit_assert_int(find_event(&log, HT_TRACE_LONG_CHAIN), ==, -1);
+
+    // The first key sits at the end of the chain
+    hash_table_get(table, keys[0]);
+    munit_assert_size(log.count, ==, 1);
+    munit_assert_int(log.events[0].type, ==, HT_TRACE_LONG_CHAIN);
+    munit_assert_int(log.events[0].key, ==, keys[0]);
+    munit_assert_size(log.events[0].chain_length, ==, HT_TRACE_LONG_CHAIN_LENGTH);
+
+    hash_table_get(table, keys[HT_TRACE_LONG_CHAIN_LENGTH - 1]);
+    munit_assert_size(log.count, ==, 1);
+
+    hash_table_set_trace_hook(nullptr, nullptr);
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_trace_save_load(const MunitParameter params[], void *fixture) {
+    HashTable *table = (HashTable *) fixture;
+    static TraceLog log;
+    log.count = 0;
+
+    for (int i = 0; i < 10; i++) {
+        hash_table_insert(table, i, i);
+    }
+
+    char filename[64];
+    snprintf(filename, sizeof(filename), "trace_test_%u.txt", munit_rand_uint32());
+
+    hash_table_set_trace_hook(record_event, &log);
+
+    munit_assert_true(hash_table_save(table, filename));
+    HashTable *loaded;
+    munit_assert_int(hash_table_load(filename, &loaded), ==, HT_LOAD_OK);
+    remove(filename);
+
+    HashTable *missing;
+    munit_assert_int(hash_table_load(filename, &missing), ==, HT_LOAD_ERROR_FILE_OPEN);
+
+    hash_table_set_trace_hook(nullptr, nullptr);
+
+    munit_assert_size(log.count, ==, 6);
+    munit_assert_int(log.events[0].type, ==, HT_TRACE_SAVE_START);
+    munit_assert_size(log.events[0].count, ==, 10);
+    munit_assert_int(log.events[1].type, ==, HT_TRACE_SAVE_END);
+    munit_assert_true(log.events[1].success);
+    munit_assert_size(log.events[1].bytes, >, 0);
+
+    munit_assert_int(log.events[2].type, ==, HT_TRACE_LOAD_START);
+    munit_assert_string_equal(log.events[2].filename, filename);
+    munit_assert_int(log.events[3].type, ==, HT_TRACE_LOAD_END);
+    munit_assert_ptr_equal(log.events[3].table, loaded);
+    munit_assert_size(log.events[3].count, ==, 10);
+    // The trailing newline isn't read
+    munit_assert_size(log.events[3].bytes, >, 0);
+    munit_assert_size(log.events[3].bytes, <=, log.events[1].bytes);
+
+    munit_assert_int(log.events[5].type, ==, HT_TRACE_LOAD_END);
+    munit_assert_false(log.events[5].success);
+    munit_assert_null(log.events[5].table);
+
+    hash_table_destroy(loaded);
+
+    return MUNIT_OK;
+}
+
+MunitTest table_trace[] = {
+    {"/resize", test_trace_resize, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/long_chain", test_trace_long_chain, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/save_load", test_trace_save_load, hash_table_setup, hash_table_teardown, MUNIT_TEST_OPTION_NONE, nullptr},
+    {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
+};
@@ -1,21 +1,37 @@
+#include <limits.h>
+
 #include "../munit.h"
 #include "../test_utils.h"
 
 static MunitResult
-test_hash_function_positive(const MunitParameter params[], void *fixture) {
-    munit_assert_size(hash_function(0, 10), ==, 0);
-    munit_assert_size(hash_function(10, 10), ==, 0);
-    munit_assert_size(hash_function(2, 10), ==, 2);
-    munit_assert_size(hash_function(12, 10), ==, 2);
+test_hash_function_range(const MunitParameter params[], void *fixture) {
+    const size_t sizes[4] = {1, 10, HT_INITIAL_SIZE, 7919};
+    const int keys[6] = {0, 1, -1, 12, INT_MAX, INT_MIN};
+
+    for (int s = 0; s < 4; s++) {
+        for (int k = 0; k < 6; k++) {
+            munit_assert_size(hash_function(keys[k], sizes[s]), <, sizes[s]);
+        }
+    }
+
+    munit_assert_size(hash_function(12345, 1), ==, 0);
 
     return MUNIT_OK;
 }
 
 static MunitResult
-test_hash_function_negative(const MunitParameter params[], void *fixture) {
-    munit_assert_size(hash_function(-1, 10), ==, 9);
-    munit_assert_size(hash_function(-12, 10), ==, 8);
-    munit_assert_size(hash_function(-10, 10), ==, 0);
+test_hash_function_ranges(const MunitParameter params[], void *fixture) {
+    // Every bucket holds a contiguous range of hash positions
+    for (int key = -500; key < 500; key++) {
+        const size_t bucket = hash_function(key, HT_INITIAL_SIZE);
+        munit_assert_uint64(hash_range_start(bucket, HT_INITIAL_SIZE), <=, key_hash(key));
+        munit_assert_uint64(hash_range_start(bucket + 1, HT_INITIAL_SIZE), >, key_hash(key));
+    }
+
+    munit_assert_uint64(hash_range_start(0, 10), ==, 0);
+    munit_assert_uint64(hash_range_start(10, 10), ==, (uint64_t) 1 << 32);
+    munit_assert_uint32(key_hash(0), ==, 0);
+    munit_assert_uint32(key_hash(1), !=, key_hash(2));
 
     return MUNIT_OK;
 }
@@ -43,10 +59,23 @@ test_next_prime(const MunitParameter params[], void *fixture) {
     return MUNIT_OK;
 }
 
+static MunitResult
+test_crc32c(const MunitParameter params[], void *fixture) {
+    munit_assert_uint32(crc32c("", 0), ==, 0);
+    munit_assert_uint32(crc32c("123456789", 9), ==, 0xe3069283u);
+
+    // Longer than a word, with an unaligned tail
+    const char text[] = "The quick brown fox jumps over the lazy dog";
+    munit_assert_uint32(crc32c(text, sizeof(text) - 1), ==, 0x22620404u);
+
+    return MUNIT_OK;
+}
+
 MunitTest utils[] = {
-    {"/hash_function_positive", test_hash_function_positive, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
-    {"/hash_function_negative", test_hash_function_negative, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/hash_function_range", test_hash_function_range, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/hash_function_ranges", test_hash_function_ranges, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
     {"/is_prime", test_is_prime, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
     {"/next_prime", test_next_prime, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
+    {"/crc32c", test_crc32c, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr},
     {nullptr, nullptr, nullptr, nullptr, MUNIT_TEST_OPTION_NONE, nullptr}
 };
@@ -4,7 +4,7 @@
 #include "../munit.h"
 #include "../../src/interactive_mode/argument_parser_internal.h"
 
-static constexpr size_t INVALID_INPUTS_COUNT = 10;
+static constexpr size_t INVALID_INPUTS_COUNT = 12;
 static constexpr char invalid_inputs[INVALID_INPUTS_COUNT][32] = {
     "add 1 a",
     "add a 1",
@@ -14,15 +14,18 @@ static constexpr char invalid_inputs[INVALID_INPUTS_COUNT][32] = {
     "get",
     "del a",
     "del",
+    "slowlog_set a",
+    "slowlog_set",
     "makosretes",
     ""
 };
 
-static constexpr size_t VALID_INPUTS_COUNT = 3;
+static constexpr size_t VALID_INPUTS_COUNT = 4;
 static constexpr char valid_inputs[VALID_INPUTS_COUNT][32] = {
     "add 1 2",
     "get 1",
-    "del 1"
+    "del 1",
+    "slowlog_set 1"
 };
 
 static ParsedInput mock_input(const char *input) {
@@ -6,9 +6,19 @@ extern MunitTest table_insert_get[];
 extern MunitTest table_delete[];
 extern MunitTest table_resize[];
 extern MunitTest table_foreach[];
+extern MunitTest table_iter[];
 extern MunitTest table_persistence[];
+extern MunitTest table_file[];
 extern MunitTest table_equal[];
 extern MunitTest table_copy[];
+extern MunitTest table_merkle[];
+extern MunitTest table_setops[];
+extern MunitTest table_stats[];
+extern MunitTest table_alloc[];
+extern MunitTest table_instrument[];
+extern MunitTest table_slowlog[];
+extern MunitTest table_trace[];
+extern MunitTest table_background[];
 extern MunitTest utils[];
 extern MunitTest argument_parser[];
 
@@ -19,9 +29,19 @@ static MunitSuite sub_suites[] = {
     {"/delete", table_delete, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
     {"/resize", table_resize, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
     {"/foreach", table_foreach, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
+    {"/iter", table_iter, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
     {"/persistence", table_persistence, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
+    {"/file", table_file, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
     {"/equal", table_equal, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
     {"/copy", table_copy, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
+    {"/merkle", table_merkle, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
+    {"/setops", table_setops, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
+    {"/stats", table_stats, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
+    {"/alloc", table_alloc, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
+    {"/instrument", table_instrument, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
+    {"/slowlog", table_slowlog, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
+    {"/trace", table_trace, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
+    {"/background", table_background, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
     {"/utils", utils, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
     {"/parser", argument_parser, nullptr, 1, MUNIT_SUITE_OPTION_NONE},
     {nullptr, nullptr, nullptr, 0, MUNIT_SUITE_OPTION_NONE}